@@ -6,29 +6,178 @@
  * This file contains LRUCache class as well as the underlying implementations.
  *
  * The implementation adheres to the LRU cache constaints as follows:
- *   1. LRUCache(int capacity):
+ *   1. LRUCache<Key, Value, Hash, Policy>(int capacity):
  *          Initializes the LRU cache with positive size capacity.
- *   2. int get(int key):
- *          Returns the value of the key if the key exists, otherwise returns -1.
- *   3. void put(int key, int value):
+ *   2. std::optional<Value> get(const Key& key):
+ *          Returns the value of the key if the key exists, otherwise returns an
+ *      empty optional, so that no value (like -1) is mistaken for a miss.
+ *   3. void put(const Key& key, const Value& value):
  *          Updates the value of the key if the key exists. Otherwise, adds the 
  *      key-value pair to the cache. If the number of keys exceeds the capacity
  *      from this operation, evicts the least recently used key from the cache.
+ *      put(Key&& key, Value&& value) moves them into the cache instead.
+ *   4. Value& emplace(key, args...):
+ *          Same as put, with the value built in place from args, and returns it
+ *   5. Value* get_ptr(const Key& key) / const Value* peek_ptr(const Key& key):
+ *          Point to the value held by the cache, without copying it out, or are
+ *      nullptr for a miss - valid until the next put, emplace or clear. The
+ *      ConcurrentLRUCache has get_with(key, visit) for it, under the lock
+ *   6. multi_get(keys, count, values) / multi_put(keys, values, count):
+ *          A batch of gets or puts, with the keys of a batch hashed and their
+ *      slots and Nodes prefetched up front, so that the cache misses overlap.
+ *      The ConcurrentLRUCache takes each shard's lock once per batch
+ *   7. put(key, value, ttl) / expire(max_slots):
+ *          A put of an entry that expires once the ttl is up, and a sweep of the
+ *      next max_slots slots of the map for the expired ones (each put sweeps a
+ *      couple as well). Only with an ExpiringPolicy
+ *   8. get_or_compute(key, loader):
+ *          Returns the value of the key, putting loader(key) for it on a miss
+ *      (held clean by a write-back cache, as is the value of a fill).
+ *      In the ConcurrentLRUCache, the concurrent misses of a key share the one
+ *      load: the first caller runs the loader and the others wait for it
+ *   9. save_snapshot(path) / load_snapshot(path):
+ *          Write the entries MRU to LRU to a compact binary file (put in place
+ *      of the last one by a rename), and replace the entries with the MRU ones
+ *      of such a file that fit, read memory mapped and added straight to the
+ *      map and the list in their recency order, for a warm restart. The
+ *      ConcurrentLRUCache's encodes a shard at a time under its lock, and
+ *      writes it out with no lock held, paced to a rate of bytes if given,
+ *      and a SnapshotCheckpointer takes one every period in the background.
+ *      It's as of the point in time it was started at: a shard changed before
+ *      it's got to has its entries taken for it first, so what's put while
+ *      it's taken goes in the next one
+ *  10. co_await async_get(key, executor) / async_get_or_compute(key, loader,
+ *      executor) / async_put(key, value):
+ *          The ConcurrentLRUCache's get, get_or_compute and put for C++20
+ *      coroutines, that allocate no frame of their own. A hit on an entry held
+ *      in memory completes inline, and only a miss of the tier or a load
+ *      suspends the coroutine, handing the call to executor(task), which
+ *      resumes it when done
+ *  11. for_each(visit) / erase_if(pred) / bulk_load(first, last):
+ *          Visit the entries MRU to LRU, and erase those that pred holds for (a
+ *      dirty one is written back, but none demoted or notified of). The
+ *      ConcurrentLRUCache's run a shard a task on a work stealing pool of
+ *      threads, and its bulk_load puts a range of key-value pairs, same as a
+ *      put of each in order, partitioned by shard in parallel, and each shard
+ *      filled by one thread under one take of its lock
  *
  * Exception Safety:
  *   1. LRUCache(int capacity): When initialised with negative size, it throws
  *      exception of type InvalidCapacity that is derived from std::exception
- *   2. int get(int key): Doesn't throw
- *   3. void put(int key, int value): May throw a bad_alloc, but, leaves the 
- *      underlying data structures in the previous stable state.
+ *   2. get(key): Doesn't throw, unless copying the Value out throws (or, in a
+ *      tiered cache, putting back the entry a miss takes from the tier does)
+ *   3. put(key, value), emplace(key, args...): May throw a bad_alloc (or
+ *      whatever copying the Key or building the Value throws), but, leaves the
+ *      underlying data structures in the previous stable state. A weighted put
+ *      that throws may have evicted entries to make room, but adds none
  *
- * Thread-Safety: Not added. Can be incorporated easily as and when needed.
+ * Memory: All of the storage is sized for the capacity by the constructor, the
+ *      map's slots and the slab or array of the Nodes, so no put ever grows
+ *      the map or reallocates the Nodes (HeapLinkedLRUPolicy alone allocates a
+ *      Node a put, until full). warm_reserve() faults their pages in as well.
+ *      A TagProbedPolicy's map does rehash in place, in the same slots, once
+ *      its erases have used its EMPTY slots up, an O(slots) pass within the
+ *      put it falls to, timed as a CacheOp::Rehash of its own.
+ *      FixedLRUCache<Key, Value, N> sizes it all at compile time instead, the
+ *      Nodes in a std::array linked by their slots, and the keys matched by
+ *      their 7-bit tags a TagGroup at a time (up to 64 entries) or else mapped
+ *      by a TagHashIndex held inline, so it allocates nothing, ever, and can be
+ *      embedded in another object or be thread_local
+ *
+ * Thread-Safety: LRUCache itself isn't thread safe. ConcurrentLRUCache is the
+ *      thread safe one, which splits the keys across independently locked
+ *      LRUCache shards (one per hardware thread, by default), and needs to be
+ *      built with thread support (-pthread). With RecencyPromotion::Deferred,
+ *      gets share the shard's lock and their hits are replayed in batches
+ *
+ * Storage Engines:
+ *   The Policy parameter of LRUCache picks the recency list it's built on:
+ *   1. LinkedLRUPolicy: (default) LRUTwoWayList<SlabNodeAllocator>, pointer
+ *      linked Nodes that are all carved out of one slab pre-sized from capacity
+ *   2. HeapLinkedLRUPolicy: LRUTwoWayList<HeapNodeAllocator>, pointer linked
+ *      Nodes, one new per Node
+ *   3. IndexedLRUPolicy: IndexedTwoWayList, Nodes in one flat std::vector,
+ *      linked by 32-bit slots
+ *   4. ClockPolicy: ClockList, approximate LRU (CLOCK), a hit only sets the
+ *      Node's reference bit and a sweeping hand picks the victim to evict
+ *   5. SegmentedLRUPolicy: SegmentedLRUList, scan resistant segmented LRU, a
+ *      new key is on probation until hit again, which protects it, and the
+ *      victim is the probation LRU one, so a scan only evicts its own keys
+ *   6. WindowTinyLFUPolicy: WindowTinyLFUList, W-TinyLFU, a new key goes to a
+ *      small window LRU, and to the segmented LRU main part from there only
+ *      if a count-min sketch of the keys seen (4-bit counters, one cache line
+ *      a key, halved every 10 x capacity adds) has it as more frequent than
+ *      the main part's victim, else the window's LRU key is the one evicted
+ *   7. HugePageLRUPolicy: LRUTwoWayList<HugePageNodeAllocator>, the slab of
+ *      the Nodes and the map's slots both mapped in huge pages (1GB or 2MB
+ *      ones from the hugetlb pool, else transparent ones), so a very large
+ *      cache misses the TLB far less. A ConcurrentLRUCache of it spreads its
+ *      shards over the NUMA nodes, each shard's memory bound to its node
+ *   CountedPolicy<any of the above> counts the hits, misses, puts, updates,
+ *   evictions and bytes held, as relaxed atomics per cache (or per shard) that
+ *   stats() reads without locking. Without it, they're compiled out entirely
+ *   InstrumentedPolicy<any of the above, N> times one in N gets, puts, and
+ *   the evictions, allocations and rehashes within the puts, into rdtsc
+ *   based HDR style histograms (latencies(op)), and calls the hook set by
+ *   set_trace_hook after every op. Without it, that's all compiled out too
+ *   WeightedPolicy<any of the above, Weigher> weighs each entry (by default,
+ *   the bytes of its key and value) and, built with a WeightBudget, keeps the
+ *   total weight under it, evicting as many entries as a heavy put needs. An
+ *   entry weighing more than the whole budget is refused with a length_error
+ *   ExpiringPolicy<any of the above, Clock> times the entries put with a ttl
+ *   by a coarse monotonic ms clock (no syscall a read). An expired entry is a
+ *   miss, and is freed by the get that finds it or by the incremental sweep
+ *   of the map, and counted as an eviction
+ *   TieredPolicy<any of the above> demotes the entries it evicts to a FlashTier
+ *   (given to the constructor, and shared by the shards of a concurrent one)
+ *   instead of dropping them, and a get that misses takes the key's entry back
+ *   from there. The tier is a log on flash, a ring of segments in one file,
+ *   each filled in memory and written out whole by a thread of its own, with
+ *   an in-memory index of the keys, so a lookup is one pread at most (which
+ *   a ConcurrentLRUCache does under the key's shard's lock, stalling it)
+ *   NotifyingPolicy<any of the above> puts each entry it evicts or expires on
+ *   an EvictionQueue (set by set_eviction_queue), a bounded lock free queue
+ *   whose own thread calls its listener with them in batches, so that what's
+ *   done with them is kept off the puts. An entry finding it full is dropped
+ *   and counted, rather than the put waiting on the listener
+ *   TagProbedPolicy<any of the above> builds the map on a TagHashIndex, which
+ *   mixes the key's hash (so strided int keys spread out too), keeps 7 bits
+ *   of it a slot in a control byte, and compares 32 (AVX2), 16 (SSE2, NEON)
+ *   or 8 (plain 64-bit word) of those a probe, picked when it's compiled
+ *   WriteBackPolicy<any of the above> has a put mark its entry dirty (its
+ *   Node keeping its place in an array of the dirty ones, set once the put
+ *   has gone through), rather than writing it through to the store behind
+ *   the cache, and writes the dirty ones back through a WriteBackQueue (set
+ *   by set_write_back_queue) when they're evicted, or flushed by flush_dirty,
+ *   every period with a WriteBackFlusher, at the cost of the dirty ones
+ *   alone. The puts of a key in between collapse into one write, and the
+ *   queue's own thread calls the store's writer with them in batches
  *
  * Usage:
  *   1. This code can be run from any online C++ compiler or by generating a
- *      binary output file by using a stand-alone compiler
+ *      binary output file by using a stand-alone compiler (C++17 or later)
  *   2. If the implementation of LRUCache is to be linked with other, just
  *      comment out the main function at the end of the file and go ahead
+ *   3. Defining LRUCACHE_COUNT_ALLOCATIONS (-DLRUCACHE_COUNT_ALLOCATIONS) has
+ *      the tests replace the global operator new, to check that a FixedLRUCache
+ *      never allocates. It's off by default, and is for the test build alone
+ *
+ * Benchmarks:
+ *   LRUCacheBench.cpp runs every engine through uniform, zipfian, scan heavy
+ *   and replayed trace keys, over a sweep of capacities and thread counts, and
+ *   writes the ops/sec, hit ratio and p50/p99/p999 latency of each run
+ *      g++ -O2 -std=c++17 -pthread LRUCacheBench.cpp -o LRUCacheBench
+ *      ./LRUCacheBench [no. of ops per run] [trace file of int keys]
+ *
+ * Traces:
+ *   A TracedCache over a live cache records the keys of its gets and puts to a
+ *   compact binary trace (TraceWriter, delta and varint encoded, 1-2 bytes a
+ *   record on a skewed stream), which TraceReader reads back memory mapped.
+ *   LRUCacheReplay.cpp prints the LRU hit ratio curve of a trace over all the
+ *   capacities in one stack distance (Mattson) pass, and replays it through
+ *   each engine at the capacities given
+ *      g++ -O2 -std=c++17 -pthread LRUCacheReplay.cpp -o LRUCacheReplay
+ *      ./LRUCacheReplay <trace file> [capacity ...]
  *
  * Refactoring:
  *      This file can be refactored into multiple header and implementation
@@ -47,47 +196,530 @@
 #define _LRUCACHE_H_ 1
 
 #include <iostream>
-#include <unordered_map>
+#include <string>
 #include <list>
 #include <stdexcept>
 #include <chrono>
 #include <memory>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <optional>
+#include <functional>
+#include <future>
+#include <condition_variable>
+#include <thread>
+#include <cassert>
+#include <random>
+#include <fstream>
+#include <cmath>
+#include <cctype>
+#include <unordered_map>
+#include <filesystem>
+#include <ctime>
+#include <tuple>
+#include <iterator>
+#include <system_error>
+#include <deque>
+#include <array>
+#include <cerrno>
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define LRUCACHE_HAS_COROUTINES 1
+#endif
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LRUCACHE_HAS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define LRUCACHE_HAS_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LRUCACHE_HAS_NEON 1
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define LRUCACHE_HAS_MMAP 1
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 using namespace std;
 
 constexpr auto KEY_NOT_FOUND_RET_VAL = -1;
 
+// To keep the independently locked parts of a cache off each other's cache lines
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Hints the CPU to start loading the cache line of the address, ahead of its use,
+// so that the misses of a batch of lookups overlap instead of following each other
+inline void prefetch_line(const void *address) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+inline size_t page_size() noexcept
+{
+#ifdef LRUCACHE_HAS_MMAP
+    static size_t const size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+// Faults in the pages of a block of raw storage (that holds no objects yet) ahead
+// of its use, by writing a byte to each of them, so that the first fill of a cache
+// doesn't take a page fault every page it goes into
+inline void prefault_raw(void *raw, size_t bytes) noexcept
+{
+    volatile unsigned char *const bytes_at = static_cast<unsigned char*>(raw);
+    for ( size_t offset = 0; offset < bytes; offset += page_size() )
+    {
+        bytes_at[offset] = 0;
+    }
+}
+
+// Same as above, for a block that can't be written to, like the reserved part of
+// a std::vector: the kernel populates its pages where it can (Linux 5.14 and on),
+// otherwise they are left to be faulted in on their first use
+inline void prefault_reserved(const void *reserved, size_t bytes) noexcept
+{
+#if defined(LRUCACHE_HAS_MMAP) && defined(MADV_POPULATE_WRITE)
+    uintptr_t const begin = reinterpret_cast<uintptr_t>(reserved) & ~(uintptr_t{page_size()} - 1);
+    uintptr_t const end = reinterpret_cast<uintptr_t>(reserved) + bytes;
+    ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_POPULATE_WRITE);
+#else
+    (void)reserved;
+    (void)bytes;
+#endif
+}
+
+// The NUMA nodes of the host, as listed in sysfs, or just the 1 where there's none
+inline size_t numa_node_count() noexcept
+{
+    static size_t const count = []() noexcept
+    {
+        size_t nodes = 0;
+        std::error_code error;
+        for ( std::filesystem::directory_iterator entry("/sys/devices/system/node", error), end;
+              !error && (entry != end); entry.increment(error) )
+        {
+            std::string const name = entry->path().filename().string();
+            if ( (4 < name.size()) && (0 == name.compare(0, 4, "node")) && std::isdigit(static_cast<unsigned char>(name[4])) )
+            {
+                ++nodes;
+            }
+        }
+        return std::max<size_t>(1, nodes);
+    }();
+    return count;
+}
+
+// The NUMA node the HugePageRegions this thread maps are bound to, -1 for none, when
+// the kernel puts each page on the node of the CPU that first touches it
+inline int& numa_allocation_node() noexcept
+{
+    static thread_local int node = -1;
+    return node;
+}
+
+// Binds the HugePageRegions this thread maps within the scope to the given node
+class NumaNodeScope
+{
+    int const _previous;
+
+  public:
+    explicit NumaNodeScope(int node) noexcept
+     : _previous(numa_allocation_node())
+    {
+        numa_allocation_node() = node;
+    }
+
+    NumaNodeScope(const NumaNodeScope&) = delete;
+    NumaNodeScope& operator=(const NumaNodeScope&) = delete;
+
+    ~NumaNodeScope()
+    {
+        numa_allocation_node() = _previous;
+    }
+};
+
+// Has the pages of a mapping that aren't faulted in yet come from the node's memory
+// (MPOL_PREFERRED, so from another node's when it runs out, rather than failing)
+// by the mbind syscall, as there's no need for libnuma for that. Best effort only
+inline void bind_to_numa_node(void *mapped, size_t bytes, int node) noexcept
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    if ( (0 <= node) && (node < 63) )
+    {
+        unsigned long const node_mask = 1ul << node;
+        ::syscall(SYS_mbind, mapped, bytes, 1 /* MPOL_PREFERRED */, &node_mask, 64ul, 0u);
+    }
+#else
+    (void)mapped;
+    (void)bytes;
+    (void)node;
+#endif
+}
+
+// The raw storage regions the Nodes of a slab and the slots of a map are carved out
+// of, sized once for the capacity. HeapRegion is just ::operator new storage
+class HeapRegion
+{
+    void *_data;
+
+  public:
+    explicit HeapRegion(size_t bytes)
+     : _data(::operator new(bytes))
+    { }
+
+    HeapRegion(const HeapRegion&) = delete;
+    HeapRegion& operator=(const HeapRegion&) = delete;
+
+    ~HeapRegion()
+    {
+        ::operator delete(_data);
+    }
+
+    void* data() const noexcept
+    {
+        return _data;
+    }
+
+    // the size of the pages it's in, as far as it's known
+    size_t page_bytes() const noexcept
+    {
+        return page_size();
+    }
+};
+
+// HugePageRegion maps its storage off the heap, anonymous and in huge pages, so the
+// TLB covers a region of GBs with a few entries and no malloc arena fragments over
+// hundreds of millions of Nodes: 1 GB pages for a region of a GB or more, else 2 MB
+// ones, from the hugetlb pool (vm.nr_hugepages), falling back to the transparent
+// huge pages of a plain mapping (MADV_HUGEPAGE) when the pool has none to spare
+// The region is bound to the NUMA node of numa_allocation_node(), if any, before any
+// of its pages are faulted in. Where there's no mmap, it's a HeapRegion after all
+class HugePageRegion
+{
+    void *_data{nullptr};
+    size_t _bytes{0};
+    size_t _page_bytes{0};
+
+    static constexpr size_t HUGE_PAGE_BYTES = size_t{2} << 20;
+    static constexpr size_t GIGANTIC_PAGE_BYTES = size_t{1} << 30;
+
+#ifdef LRUCACHE_HAS_MMAP
+    // maps the bytes rounded up to the pages, returns false if the pages aren't there
+    bool map(size_t bytes, size_t page_bytes, int flags) noexcept
+    {
+        size_t const rounded = (bytes + page_bytes - 1) / page_bytes * page_bytes;
+        void *const mapped = ::mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        if ( MAP_FAILED == mapped )
+        {
+            return false;
+        }
+        _data = mapped;
+        _bytes = rounded;
+        _page_bytes = page_bytes;
+        return true;
+    }
+#endif
+
+  public:
+    explicit HugePageRegion(size_t bytes)
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        bool mapped = false;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_1GB)
+        mapped = (bytes >= GIGANTIC_PAGE_BYTES) && map(bytes, GIGANTIC_PAGE_BYTES, MAP_HUGETLB | MAP_HUGE_1GB);
+#endif
+#if defined(MAP_HUGETLB)
+        mapped = mapped || ((bytes >= HUGE_PAGE_BYTES / 2) && map(bytes, HUGE_PAGE_BYTES, MAP_HUGETLB));
+#endif
+        if ( !mapped )
+        {
+            if ( !map(bytes, page_size(), 0) )
+            {
+                throw std::bad_alloc();
+            }
+#if defined(MADV_HUGEPAGE)
+            ::madvise(_data, _bytes, MADV_HUGEPAGE);
+#endif
+        }
+        bind_to_numa_node(_data, _bytes, numa_allocation_node());
+#else
+        _data = ::operator new(bytes);
+        _bytes = bytes;
+        _page_bytes = page_size();
+#endif
+    }
+
+    HugePageRegion(const HugePageRegion&) = delete;
+    HugePageRegion& operator=(const HugePageRegion&) = delete;
+
+    ~HugePageRegion()
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        ::munmap(_data, _bytes);
+#else
+        ::operator delete(_data);
+#endif
+    }
+
+    void* data() const noexcept
+    {
+        return _data;
+    }
+
+    // the huge pages it's mapped in, or the base pages when it fell back to the
+    // transparent ones, which may or may not be huge in the end
+    size_t page_bytes() const noexcept
+    {
+        return _page_bytes;
+    }
+};
+
+// InlineRegion is storage of a size fixed at compile time, held right inside the
+// object holding the index or slab carved out of it, so it takes no allocation
+template <size_t BYTES>
+class InlineRegion
+{
+    alignas(std::max_align_t) mutable std::array<unsigned char, BYTES> _data;
+
+  public:
+    explicit InlineRegion(size_t bytes) noexcept
+    {
+        assert( bytes <= BYTES ); // what it's carved into was sized at compile time too
+        (void)bytes;
+    }
+
+    InlineRegion(const InlineRegion&) = delete;
+    InlineRegion& operator=(const InlineRegion&) = delete;
+
+    void* data() const noexcept
+    {
+        return _data.data();
+    }
+
+    // the size of the pages it's in, as far as it's known
+    size_t page_bytes() const noexcept
+    {
+        return page_size();
+    }
+};
+
 // A simple Node struct for Two Way linked list implementation
 // A combination of shared_ptr and weak_ptr could have been used
 // for prev/next pointers. But felt it could be an overkill given the
 // no. of copies to be made when Nodes are moved around
+template <class Key, class Value>
 struct TwoWayListNode
 {
-    int _key{0};
-    int _value{0};
+    Key _key;
+    Value _value;
     TwoWayListNode *_prev{nullptr};
     TwoWayListNode *_next{nullptr};
 
-    TwoWayListNode(int key, int value) noexcept
-     : _key(key),
-       _value(value),
+    // the value is built in place from the args, std::in_place marking this out
+    // from the copy and move constructors
+    template <class K, class... Args>
+    TwoWayListNode(std::in_place_t, K&& key, Args&&... args)
+     : _key(std::forward<K>(key)),
+       _value(std::forward<Args>(args)...),
        _prev(nullptr),
        _next(nullptr)
     { }
 };
 
+// Node allocator policies for the LRUTwoWayList below, templated on the Node
+// Each policy hands out the TwoWayListNodes for add_to_front and takes them
+// all back in release_all when the list is cleared or destroyed.
+//
+// HeapNodeAllocator: a plain new/delete per Node, as the list originally did.
+// Warm-up costs one malloc per key and clear() one free per key, but no memory
+// is held for the keys that are never added.
+template <class Node>
+class HeapNodeAllocator
+{
+  public:
+    explicit HeapNodeAllocator(size_t /*capacity*/) noexcept
+    { }
+
+    // nothing to pre-fault, each Node being allocated as the list fills up
+    void warm_reserve() noexcept
+    { }
+
+    template <class... Args>
+    Node* allocate(Args&&... args)
+    {
+        return new Node(std::forward<Args>(args)...);
+    }
+
+    // deletes the one Node, that's been unlinked from the list
+    void release(Node *node) noexcept
+    {
+        delete node;
+    }
+
+    // walk the list from the given front and delete every Node on the way
+    void release_all(Node *front) noexcept
+    {
+        while ( nullptr != front )
+        {
+            Node *next = front->_next;
+            delete front;
+            front = next;
+        }
+    }
+};
+
+// SlabNodeAllocator: pre-sizes one contiguous block for the capacity no. of
+// Nodes up front, so warm-up is a single allocation and the Nodes sit next to
+// each other in memory instead of being scattered over the heap.
+// When the Nodes are trivially destructible (say, for int keys and values),
+// releasing all of them is O(1), else each of them is destroyed in place
+// The block is a Region (see HeapRegion), HugePageNodeAllocator's being huge pages
+template <class Node, class Region>
+class RegionSlabNodeAllocator
+{
+    // raw storage only - the Nodes are constructed in place as they are handed out
+    Region _region;
+    size_t _slots{0}; // no. of Nodes the slab can hold
+    size_t _used{0}; // no. of Nodes handed out so far
+    // the released Nodes, to be handed out again before the rest of the slab, each
+    // holding the pointer to the next one in its (by then raw) storage
+    Node *_free{nullptr};
+
+    Node* slab() const noexcept
+    {
+        return static_cast<Node*>(_region.data());
+    }
+
+    static Node* next_free(Node *released) noexcept
+    {
+        Node *next;
+        std::memcpy(&next, static_cast<void*>(released), sizeof(next));
+        return next;
+    }
+
+  public:
+    explicit RegionSlabNodeAllocator(size_t capacity)
+     : _region(capacity * sizeof(Node)),
+       _slots(capacity)
+    { }
+
+    // faults in the part of the slab the Nodes haven't been handed out of yet
+    void warm_reserve() noexcept
+    {
+        prefault_raw(slab() + _used, (_slots - _used) * sizeof(Node));
+    }
+
+    size_t page_bytes() const noexcept
+    {
+        return _region.page_bytes();
+    }
+
+    template <class... Args>
+    Node* allocate(Args&&... args)
+    {
+        if ( nullptr != _free )
+        {
+            Node *const released = _free;
+            Node *const next = next_free(released);
+            Node *node = ::new (static_cast<void*>(released)) Node(std::forward<Args>(args)...);
+            _free = next; // only once the Node is constructed, in case the key or value throws
+            return node;
+        }
+
+        if ( _used == _slots ) // the list never holds more than capacity Nodes
+        {
+            throw std::bad_alloc();
+        }
+
+        Node *node = ::new (slab() + _used) Node(std::forward<Args>(args)...);
+        ++_used; // only once the Node is constructed, in case the key or value throws
+        return node;
+    }
+
+    // destroys the one Node, that's been unlinked from the list, and keeps its
+    // storage for the next allocate
+    void release(Node *node) noexcept
+    {
+        node->~Node();
+        std::memcpy(static_cast<void*>(node), &_free, sizeof(_free));
+        _free = node;
+    }
+
+    // the whole slab is reused from the start, so there is nothing to walk,
+    // unless the Nodes have destructors to run
+    void release_all(Node *front) noexcept
+    {
+        if constexpr ( !std::is_trivially_destructible<Node>::value )
+        {
+            while ( nullptr != front )
+            {
+                Node *next = front->_next;
+                front->~Node();
+                front = next;
+            }
+        }
+
+        _used = 0;
+        _free = nullptr;
+    }
+};
+
+template <class Node>
+using SlabNodeAllocator = RegionSlabNodeAllocator<Node, HeapRegion>;
+
+template <class Node>
+using HugePageNodeAllocator = RegionSlabNodeAllocator<Node, HugePageRegion>;
+
 // A Custom-made doubly linked list that provides the operations needed
 // for implementing the LRU cache constrains
 // It either adds a new Node to the front, or rolls over the found Node
 // to the front, such that:
 //   The front of the list is MRU - i.e. the most recently used
 //   The back of the list is LRU - i.e. the least recently used 
+// The Nodes are owned by the list and come from the given NodeAllocator policy
+template <class Key, class Value, template <class> class NodeAllocator = SlabNodeAllocator>
 class LRUTwoWayList
 {
+  public:
+    using node_type = TwoWayListNode<Key, Value>;
+    using handle_type = node_type*; // what the LRUCache keeps in its map
+
+  private:
     size_t _size{0};
 
-    TwoWayListNode *_front{nullptr}; // head of the Two Way list
-    TwoWayListNode *_back{nullptr}; // tail of the Two Way list
+    node_type *_front{nullptr}; // head of the Two Way list
+    node_type *_back{nullptr}; // tail of the Two Way list
+
+    NodeAllocator<node_type> _allocator; // where the Nodes come from
 
     // if either the front or back is empty, the list is empty
     constexpr bool empty() const noexcept
@@ -96,15 +728,28 @@ class LRUTwoWayList
     }
 
   public:
-    explicit LRUTwoWayList() noexcept
+    // capacity is the max no. of Nodes the list will ever hold at a time
+    explicit LRUTwoWayList(size_t capacity)
      : _front(nullptr),
-       _back(nullptr)
+       _back(nullptr),
+       _allocator(capacity)
     { }
 
-    // Allocates a new node and adds to the front of the list and returns the same
-    TwoWayListNode* add_to_front(int key, int value)
+    // the list owns its Nodes, so it cannot be copied around
+    LRUTwoWayList(const LRUTwoWayList&) = delete;
+    LRUTwoWayList& operator= (const LRUTwoWayList&) = delete;
+
+    ~LRUTwoWayList()
+    {
+        this->clear();
+    }
+
+    // Allocates a new node, with its value built in place from the args,
+    // and adds to the front of the list and returns the same
+    template <class K, class... Args>
+    node_type* add_to_front(K&& key, Args&&... args)
     {
-        TwoWayListNode *new_node = new TwoWayListNode(key, value);
+        node_type *new_node = _allocator.allocate(std::in_place, std::forward<K>(key), std::forward<Args>(args)...);
 
         // At the very begining - case of the first node being added
         if ( (nullptr == _front) && (nullptr == _back) )
@@ -124,7 +769,7 @@ class LRUTwoWayList
     }
 
     // Move the given node to the front by making necessary re-links
-    void move_to_front(TwoWayListNode *given_node)
+    void move_to_front(node_type *given_node)
     {
         if ( _front == given_node ) // already at the front, so no-op
         {
@@ -149,12 +794,58 @@ class LRUTwoWayList
         _front = given_node;
     }
 
-    constexpr TwoWayListNode* front() const noexcept
+    // Puts the victim Node, reused for a new key, back in as the newest one, which
+    // for a plain LRU list is no different from a hit
+    void readmit(node_type *reused_node)
+    {
+        move_to_front(reused_node);
+    }
+
+    // Unlinks the given node and hands it back to the allocator - the other Nodes
+    // stay where they are, so relocated (see IndexedTwoWayList::remove) is never called
+    template <class Relocated>
+    void remove(node_type *given_node, Relocated&& /*relocated*/) noexcept
+    {
+        if ( _front == given_node )
+        {
+            _front = given_node->_next;
+        }
+        else
+        {
+            given_node->_prev->_next = given_node->_next;
+        }
+
+        if ( _back == given_node )
+        {
+            _back = given_node->_prev;
+        }
+        else
+        {
+            given_node->_next->_prev = given_node->_prev;
+        }
+
+        _allocator.release(given_node);
+        --_size;
+    }
+
+    constexpr node_type* front() const noexcept
     {
         return _front;
     }
 
-    constexpr TwoWayListNode* back() const noexcept
+    // the handle is the Node itself for this list
+    constexpr node_type& node(node_type *handle) const noexcept
+    {
+        return *handle;
+    }
+
+    constexpr node_type* back() const noexcept
+    {
+        return _back;
+    }
+
+    // the Node to evict when the list is at capacity, which is the LRU one at the back
+    constexpr node_type* victim() const noexcept
     {
         return _back;
     }
@@ -164,12 +855,28 @@ class LRUTwoWayList
         return _size;
     }
 
+    // Faults in the storage of the Nodes yet to be added, ahead of the fill
+    void warm_reserve() noexcept
+    {
+        _allocator.warm_reserve();
+    }
+
+    // Releases all the Nodes back to the allocator and empties the list
+    void clear() noexcept
+    {
+        _allocator.release_all(_front);
+        _front = _back = nullptr;
+        _size = 0;
+    }
+
     // just our operator friend to write to cout for testing output
-    friend ostream& operator<< (ostream& os, const LRUTwoWayList& list);
+    template <class K, class V, template <class> class Allocator>
+    friend ostream& operator<< (ostream& os, const LRUTwoWayList<K, V, Allocator>& list);
 };
 
 // Iterate over the list from front to back and write to output stream
-ostream& operator<< (ostream& os, const LRUTwoWayList& list)
+template <class Key, class Value, template <class> class NodeAllocator>
+ostream& operator<< (ostream& os, const LRUTwoWayList<Key, Value, NodeAllocator>& list)
 {
     os << "{";
 
@@ -186,322 +893,9643 @@ ostream& operator<< (ostream& os, const LRUTwoWayList& list)
     return os << "}";
 }
 
-// For throwing when the LRUCache's capacity is initialised with a negative size
-class InvalidCapacity : public std::exception
+// Calls visit with each Node in turn from the MRU front to the LRU back, the order
+// a snapshot is written in (see LRUCache::save_snapshot)
+template <class Key, class Value, template <class> class NodeAllocator, class Visit>
+void visit_mru_to_lru(const LRUTwoWayList<Key, Value, NodeAllocator>& list, Visit&& visit)
 {
-	virtual const char* what() const noexcept override
-	{
-		return "LRUCache's capacity has to be initialised with a positive value";
-	}
-} InvalidCapacityException;
+    for ( auto iter = list.front(); nullptr != iter; iter = iter->_next )
+    {
+        visit(*iter);
+    }
+}
 
-/* Attempt at trying to use pimpl idiom pattern
- * or rather pointer to an absract interface can be used to provide polymorphic behavior
- * with the varying concrete implementation of the underlying data structures
-class LRUCache
+// A Node for the IndexedTwoWayList, where the prev/next links are 32-bit slot
+// indices into the list's flat array instead of 64-bit pointers, which brings
+// the Node down to 16 bytes, so four of them share a cache line
+template <class Key, class Value>
+struct IndexedListNode
 {
-    class LRUCacheImpl;
-    std::unique_ptr<LRUCacheImpl> uptr_to_lru_impl;
+    Key _key;
+    Value _value;
+    uint32_t _prev{0};
+    uint32_t _next{0};
+
+    template <class K, class... Args>
+    IndexedListNode(std::in_place_t, K&& key, Args&&... args)
+     : _key(std::forward<K>(key)),
+       _value(std::forward<Args>(args)...)
+    { }
+};
 
+// Marks the absence of a prev/next slot, the nullptr of the IndexedTwoWayList
+constexpr uint32_t INDEXED_LIST_NIL = UINT32_MAX;
+
+// An alternative storage engine to the LRUTwoWayList with the same operations
+// The Nodes live in a std::vector reserved for the capacity no. of Nodes up
+// front, so the whole recency list is one dense array. A Node keeps its slot
+// index for as long as it's held, except that remove() moves the last Node into
+// the slot it frees, to keep the array dense, and tells whoever keeps its slot
+template <class Key, class Value>
+class IndexedTwoWayList
+{
   public:
-    ~LRUCache();
-    explicit LRUCache(int capacity) throw();
+    using node_type = IndexedListNode<Key, Value>;
+    using handle_type = uint32_t; // the slot index of the Node in the array
+
+  private:
+    std::vector<node_type> _slots; // Nodes in the order they were added
+
+    uint32_t _front{INDEXED_LIST_NIL}; // slot of the head of the Two Way list
+    uint32_t _back{INDEXED_LIST_NIL}; // slot of the tail of the Two Way list
+
+    // links need to fit in 32-bits with INDEXED_LIST_NIL still left over
+    static size_t checked_slots(size_t capacity)
     {
-        if ( 0 >= capacity )
+        if ( capacity >= INDEXED_LIST_NIL )
         {
-            throw InvalidCapacityException;
+            throw std::length_error("IndexedTwoWayList can hold only up to 2^32 - 1 Nodes");
         }
-        
-        uptr_to_lru_impl.reset(new LRUCacheImpl(capacity));
+
+        return capacity;
     }
 
-    int get(int key) noexcept
+    // links the neighbours of the node in the given slot (or the ends) past it
+    void unlink(uint32_t given_slot) noexcept
     {
-        return uptr_to_lru_impl->get(key);
+        node_type const &given_node = _slots[given_slot];
+
+        if ( INDEXED_LIST_NIL == given_node._prev )
+        {
+            _front = given_node._next;
+        }
+        else
+        {
+            _slots[given_node._prev]._next = given_node._next;
+        }
+
+        if ( INDEXED_LIST_NIL == given_node._next )
+        {
+            _back = given_node._prev;
+        }
+        else
+        {
+            _slots[given_node._next]._prev = given_node._prev;
+        }
     }
-    
-    void put(int key, int value)
+
+  public:
+    explicit IndexedTwoWayList(size_t capacity)
     {
-        uptr_to_lru_impl->put(key, value);
+        _slots.reserve(checked_slots(capacity)); // single allocation for all the Nodes
     }
 
-    friend ostream& operator<< (ostream& os, const LRUCache& cache);
-};
+    // Adds a new node, with its value built in place from the args, in the next
+    // free slot to the front of the list and returns its slot
+    template <class K, class... Args>
+    uint32_t add_to_front(K&& key, Args&&... args)
+    {
+        uint32_t const new_slot = static_cast<uint32_t>(_slots.size());
+        assert( _slots.size() < _slots.capacity() ); // never reallocates, so the slots stay put
+        node_type &new_node = _slots.emplace_back(std::in_place, std::forward<K>(key), std::forward<Args>(args)...);
+        new_node._prev = INDEXED_LIST_NIL;
+        new_node._next = _front;
 
-ostream& operator<< (ostream& os, const LRUCache& cache)
-{
+        if ( INDEXED_LIST_NIL == _front ) // case of the first node being added
+        {
+            _back = new_slot;
+        }
+        else // for subsequent adds, push the current front behind the newly added Node
+        {
+            _slots[_front]._prev = new_slot;
+        }
+
+        _front = new_slot; // and the new node is now front
+
+        return new_slot; // return the slot so it can be added to the map
+    }
+
+    // Move the node in the given slot to the front by making necessary re-links
+    void move_to_front(uint32_t given_slot) noexcept
+    {
+        if ( _front == given_slot ) // already at the front, so no-op
+        {
+            return;
+        }
+
+        node_type &given_node = _slots[given_slot];
+
+        if ( _back == given_slot ) // if back node to be moved, curtail it to it's prev
+        {
+            _back = given_node._prev;
+            _slots[_back]._next = INDEXED_LIST_NIL;
+        }
+        else // unplug an internal node and link it's neighbours to be the adjacents
+        {
+            _slots[given_node._prev]._next = given_node._next;
+            _slots[given_node._next]._prev = given_node._prev;
+        }
+
+        // do the necessary for making the given node as front
+        given_node._next = _front;
+        given_node._prev = INDEXED_LIST_NIL;
+        _slots[_front]._prev = given_slot;
+        _front = given_slot;
+    }
+
+    // the victim Node reused for a new key is the MRU one, just like after a hit
+    void readmit(uint32_t reused_slot) noexcept
+    {
+        move_to_front(reused_slot);
+    }
+
+    // Unlinks the node in the given slot and drops it, moving the last Node into the
+    // freed slot to keep the array dense - relocated(moved_node, slot) is called with
+    // the Node that moved and its new slot, for whoever keeps its slot to update it
+    template <class Relocated>
+    void remove(uint32_t given_slot, Relocated&& relocated) noexcept
+    {
+        unlink(given_slot);
+
+        uint32_t const last_slot = static_cast<uint32_t>(_slots.size() - 1);
+        if ( given_slot != last_slot )
+        {
+            node_type &moved_node = _slots[given_slot];
+            moved_node = std::move(_slots[last_slot]);
+
+            // point the moved node's neighbours (or the ends) at its new slot
+            if ( INDEXED_LIST_NIL == moved_node._prev )
+            {
+                _front = given_slot;
+            }
+            else
+            {
+                _slots[moved_node._prev]._next = given_slot;
+            }
+
+            if ( INDEXED_LIST_NIL == moved_node._next )
+            {
+                _back = given_slot;
+            }
+            else
+            {
+                _slots[moved_node._next]._prev = given_slot;
+            }
+
+            relocated(static_cast<const node_type&>(moved_node), given_slot);
+        }
+
+        _slots.pop_back();
+    }
+
+    constexpr uint32_t front() const noexcept
+    {
+        return _front;
+    }
+
+    constexpr uint32_t back() const noexcept
+    {
+        return _back;
+    }
+
+    // the Node to evict when the list is at capacity, which is the LRU one at the back
+    constexpr uint32_t victim() const noexcept
+    {
+        return _back;
+    }
+
+    node_type& node(uint32_t slot) noexcept
+    {
+        return _slots[slot];
+    }
+
+    const node_type& node(uint32_t slot) const noexcept
+    {
+        return _slots[slot];
+    }
+
+    size_t size() const noexcept
+    {
+        return _slots.size();
+    }
+
+    // Faults in the reserved part of the array, ahead of the fill
+    void warm_reserve() noexcept
+    {
+        prefault_reserved(_slots.data() + _slots.size(), (_slots.capacity() - _slots.size()) * sizeof(node_type));
+    }
+
+    // Drops all the Nodes, but keeps the reserved array for the next fill
+    void clear() noexcept
+    {
+        _slots.clear();
+        _front = _back = INDEXED_LIST_NIL;
+    }
+};
+
+// Iterate over the slots from front to back and write to output stream
+template <class Key, class Value>
+ostream& operator<< (ostream& os, const IndexedTwoWayList<Key, Value>& list)
+{
+    os << "{";
+
+    for ( uint32_t slot = list.front(); slot != INDEXED_LIST_NIL; slot = list.node(slot)._next )
+    {
+        os << list.node(slot)._key << "=" << list.node(slot)._value;
+
+        if ( list.node(slot)._next != INDEXED_LIST_NIL )
+            os << ", ";
+    }
+
+    return os << "}";
+}
+
+template <class Key, class Value, class Visit>
+void visit_mru_to_lru(const IndexedTwoWayList<Key, Value>& list, Visit&& visit)
+{
+    for ( uint32_t slot = list.front(); slot != INDEXED_LIST_NIL; slot = list.node(slot)._next )
+    {
+        visit(list.node(slot));
+    }
+}
+
+// A Node for the ClockList, which needs no links at all - just the reference bit
+template <class Key, class Value>
+struct ClockNode
+{
+    Key _key;
+    Value _value;
+    bool _referenced{false}; // set on every hit, cleared by the sweeping hand
+
+    template <class K, class... Args>
+    ClockNode(std::in_place_t, K&& key, Args&&... args)
+     : _key(std::forward<K>(key)),
+       _value(std::forward<Args>(args)...)
+    { }
+};
+
+// An approximate LRU storage engine with the same operations as the lists above,
+// implementing CLOCK: the Nodes sit in a ring (a flat std::vector reserved for
+// the capacity) and a hit only sets the Node's reference bit instead of relinking
+// it. To find a victim, the hand sweeps the ring, clearing the set bits on its way
+// and stops at the first Node that hasn't been referenced since the last sweep.
+// A new Node starts referenced, so it gets a full sweep before it can go, like a
+// page on its way in. Eviction order is close to LRU, and a hit is a single store.
+template <class Key, class Value>
+class ClockList
+{
+  public:
+    using node_type = ClockNode<Key, Value>;
+    using handle_type = uint32_t; // the slot index of the Node in the ring
+
+  private:
+    std::vector<node_type> _slots; // the ring, in the order the Nodes were added
+    uint32_t _hand{0}; // the next slot to be looked at for a victim
+
+  public:
+    explicit ClockList(size_t capacity)
+    {
+        if ( capacity >= UINT32_MAX )
+        {
+            throw std::length_error("ClockList can hold only up to 2^32 - 1 Nodes");
+        }
+
+        _slots.reserve(capacity); // single allocation for all the Nodes
+    }
+
+    // Adds a new node, with its value built in place from the args, in the next
+    // free slot of the ring and returns its slot
+    template <class K, class... Args>
+    uint32_t add_to_front(K&& key, Args&&... args)
+    {
+        assert( _slots.size() < _slots.capacity() ); // never reallocates, so the slots stay put
+        _slots.emplace_back(std::in_place, std::forward<K>(key), std::forward<Args>(args)...)._referenced = true;
+        return static_cast<uint32_t>(_slots.size() - 1);
+    }
+
+    // A hit only marks the node as referenced, the ring is left as is
+    void move_to_front(uint32_t given_slot) noexcept
+    {
+        _slots[given_slot]._referenced = true;
+    }
+
+    // the victim Node reused for a new key starts referenced, like an added one
+    void readmit(uint32_t reused_slot) noexcept
+    {
+        move_to_front(reused_slot);
+    }
+
+    // Sweeps the hand round to the first node not referenced since the last sweep,
+    // giving the referenced ones a second chance, and returns that node's slot
+    // The hand moves on past it, so the node reused in its place is seen last
+    uint32_t victim() noexcept
+    {
+        uint32_t const slots = static_cast<uint32_t>(_slots.size());
+
+        while ( _slots[_hand]._referenced )
+        {
+            _slots[_hand]._referenced = false;
+            _hand = ( _hand + 1 == slots ) ? 0 : _hand + 1;
+        }
+
+        uint32_t const victim_slot = _hand;
+        _hand = ( _hand + 1 == slots ) ? 0 : _hand + 1;
+
+        return victim_slot;
+    }
+
+    // Drops the node in the given slot, moving the last Node of the ring into the
+    // freed slot to keep it dense - relocated(moved_node, slot) is called with the
+    // Node that moved and its new slot, for whoever keeps its slot to update it
+    template <class Relocated>
+    void remove(uint32_t given_slot, Relocated&& relocated) noexcept
+    {
+        uint32_t const last_slot = static_cast<uint32_t>(_slots.size() - 1);
+        if ( given_slot != last_slot )
+        {
+            _slots[given_slot] = std::move(_slots[last_slot]);
+            relocated(static_cast<const node_type&>(_slots[given_slot]), given_slot);
+        }
+        _slots.pop_back();
+
+        if ( _hand == last_slot ) // the hand stays on the Node that moved
+        {
+            _hand = given_slot;
+        }
+        if ( _hand >= _slots.size() )
+        {
+            _hand = 0;
+        }
+    }
+
+    constexpr uint32_t hand() const noexcept
+    {
+        return _hand;
+    }
+
+    node_type& node(uint32_t slot) noexcept
+    {
+        return _slots[slot];
+    }
+
+    const node_type& node(uint32_t slot) const noexcept
+    {
+        return _slots[slot];
+    }
+
+    size_t size() const noexcept
+    {
+        return _slots.size();
+    }
+
+    // Faults in the reserved part of the ring, ahead of the fill
+    void warm_reserve() noexcept
+    {
+        prefault_reserved(_slots.data() + _slots.size(), (_slots.capacity() - _slots.size()) * sizeof(node_type));
+    }
+
+    // Drops all the Nodes, but keeps the reserved ring for the next fill
+    void clear() noexcept
+    {
+        _slots.clear();
+        _hand = 0;
+    }
+};
+
+// Write the ring from the slot just behind the hand backwards, i.e. roughly from
+// the most recently placed one round to the next in line for the sweep
+template <class Key, class Value>
+ostream& operator<< (ostream& os, const ClockList<Key, Value>& list)
+{
+    os << "{";
+
+    uint32_t const slots = static_cast<uint32_t>(list.size());
+    for ( uint32_t i = 1; i <= slots; ++i )
+    {
+        uint32_t const slot = ( list.hand() + slots - i ) % slots;
+        os << list.node(slot)._key << "=" << list.node(slot)._value;
+
+        if ( i != slots )
+            os << ", ";
+    }
+
+    return os << "}";
+}
+
+// in the same rough order as above, with the next in line for the sweep last
+template <class Key, class Value, class Visit>
+void visit_mru_to_lru(const ClockList<Key, Value>& list, Visit&& visit)
+{
+    uint32_t const slots = static_cast<uint32_t>(list.size());
+    for ( uint32_t i = 1; i <= slots; ++i )
+    {
+        visit(list.node(( list.hand() + slots - i ) % slots));
+    }
+}
+
+// The segment a SegmentedListNode is linked into
+enum class ListSegment : uint8_t
+{
+    Probation, // added, and not hit since
+    Protected, // hit at least once since it was added
+    Window     // just added, ahead of the admission to probation (WindowTinyLFUList)
+};
+
+// A Node for the SegmentedLRUList, a TwoWayListNode that also knows its segment
+template <class Key, class Value>
+struct SegmentedListNode
+{
+    Key _key;
+    Value _value;
+    SegmentedListNode *_prev{nullptr};
+    SegmentedListNode *_next{nullptr};
+    ListSegment _segment{ListSegment::Probation};
+
+    template <class K, class... Args>
+    SegmentedListNode(std::in_place_t, K&& key, Args&&... args)
+     : _key(std::forward<K>(key)),
+       _value(std::forward<Args>(args)...)
+    { }
+};
+
+// One LRU segment of the Nodes of a segmented list, front is MRU and back is LRU
+// It only links the Nodes, which are owned (allocated and released) by the list
+template <class Node>
+struct LinkedSegment
+{
+    Node *_front{nullptr};
+    Node *_back{nullptr};
+    size_t _size{0};
+
+    void push_front(Node *given_node) noexcept
+    {
+        given_node->_prev = nullptr;
+        given_node->_next = _front;
+
+        if ( nullptr == _front )
+        {
+            _back = given_node;
+        }
+        else
+        {
+            _front->_prev = given_node;
+        }
+
+        _front = given_node;
+        ++_size;
+    }
+
+    void unlink(Node *given_node) noexcept
+    {
+        if ( _front == given_node )
+        {
+            _front = given_node->_next;
+        }
+        else
+        {
+            given_node->_prev->_next = given_node->_next;
+        }
+
+        if ( _back == given_node )
+        {
+            _back = given_node->_prev;
+        }
+        else
+        {
+            given_node->_next->_prev = given_node->_prev;
+        }
+
+        --_size;
+    }
+
+    void move_to_front(Node *given_node) noexcept
+    {
+        if ( _front != given_node )
+        {
+            unlink(given_node);
+            push_front(given_node);
+        }
+    }
+};
+
+// The probation and protected segments of segmented LRU (SLRU), for the lists below
+//   1. probation, where a new key is added and has to be hit once more to leave
+//   2. protected, the keys hit since they were added, up to PROTECTED_PERCENT of
+//      the capacity - its LRU Node is moved back to the probation front when a
+//      promotion overfills it, so it gets one more chance there
+// The victim is the probation segment's LRU Node, so a scan of keys that are
+// never hit again only ever evicts its own keys and leaves the protected ones be
+template <class Node, unsigned PROTECTED_PERCENT>
+class SegmentedLRU
+{
+    static_assert(PROTECTED_PERCENT < 100, "the probation segment needs a share of the capacity");
+
+    LinkedSegment<Node> _probation;
+    LinkedSegment<Node> _protected;
+    size_t _protected_capacity; // the most Nodes the protected segment holds
+
+    LinkedSegment<Node>& segment_of(const Node *given_node) noexcept
+    {
+        return ( ListSegment::Protected == given_node->_segment ) ? _protected : _probation;
+    }
+
+  public:
+    explicit SegmentedLRU(size_t capacity) noexcept
+     : _protected_capacity(std::max<size_t>(1, capacity * PROTECTED_PERCENT / 100))
+    { }
+
+    // a new key, or one demoted, goes to the probation front
+    void add(Node *given_node) noexcept
+    {
+        _probation.push_front(given_node);
+        given_node->_segment = ListSegment::Probation;
+    }
+
+    // A hit: a probation Node is promoted to the protected front, which demotes the
+    // protected LRU Node to the probation front when it's over its share, and a
+    // protected Node is just moved to the protected front
+    void touch(Node *given_node) noexcept
+    {
+        if ( ListSegment::Protected == given_node->_segment )
+        {
+            _protected.move_to_front(given_node);
+            return;
+        }
+
+        _probation.unlink(given_node);
+        _protected.push_front(given_node);
+        given_node->_segment = ListSegment::Protected;
+
+        if ( _protected._size > _protected_capacity )
+        {
+            Node *const demoted = _protected._back;
+            _protected.unlink(demoted);
+            add(demoted);
+        }
+    }
+
+    void unlink(Node *given_node) noexcept
+    {
+        segment_of(given_node).unlink(given_node);
+    }
+
+    // the probation LRU Node, or the protected one when all have been hit, say,
+    // when the capacity is too small for the probation segment to hold any
+    constexpr Node* victim() const noexcept
+    {
+        return ( nullptr != _probation._back ) ? _probation._back : _protected._back;
+    }
+
+    constexpr size_t size() const noexcept
+    {
+        return _probation._size + _protected._size;
+    }
+
+    constexpr Node* protected_front() const noexcept
+    {
+        return _protected._front;
+    }
+
+    constexpr Node* probation_front() const noexcept
+    {
+        return _probation._front;
+    }
+
+    // Releases the Nodes of both segments back to the given allocator
+    template <class Allocator>
+    void release_all(Allocator& allocator) noexcept
+    {
+        allocator.release_all(_protected._front);
+        allocator.release_all(_probation._front);
+        _probation = LinkedSegment<Node>();
+        _protected = LinkedSegment<Node>();
+    }
+};
+
+// Writes the Nodes of a segment from front to back, after the given separator
+// when there are any, and returns the separator for what's written after them
+template <class Node>
+const char* write_segment(ostream& os, const Node *front, const char *separator)
+{
+    for ( ; nullptr != front; front = front->_next )
+    {
+        os << separator << front->_key << "=" << front->_value;
+        separator = ", ";
+    }
+
+    return separator;
+}
+
+// Calls visit with each Node of a segment from front to back
+template <class Node, class Visit>
+void visit_segment(const Node *front, Visit&& visit)
+{
+    for ( ; nullptr != front; front = front->_next )
+    {
+        visit(*front);
+    }
+}
+
+// A scan resistant storage engine with the same operations as the lists above,
+// implementing segmented LRU (see SegmentedLRU) over the Nodes of one NodeAllocator,
+// just as for LRUTwoWayList
+template <class Key, class Value, template <class> class NodeAllocator = SlabNodeAllocator,
+          unsigned PROTECTED_PERCENT = 80>
+class SegmentedLRUList
+{
+  public:
+    using node_type = SegmentedListNode<Key, Value>;
+    using handle_type = node_type*;
+
+  private:
+    SegmentedLRU<node_type, PROTECTED_PERCENT> _segments;
+    NodeAllocator<node_type> _allocator;
+
+  public:
+    explicit SegmentedLRUList(size_t capacity)
+     : _segments(capacity),
+       _allocator(capacity)
+    { }
+
+    SegmentedLRUList(const SegmentedLRUList&) = delete;
+    SegmentedLRUList& operator= (const SegmentedLRUList&) = delete;
+
+    ~SegmentedLRUList()
+    {
+        this->clear();
+    }
+
+    // Allocates a new node, with its value built in place from the args, and adds
+    // it to the front of the probation segment
+    template <class K, class... Args>
+    node_type* add_to_front(K&& key, Args&&... args)
+    {
+        node_type *new_node = _allocator.allocate(std::in_place, std::forward<K>(key), std::forward<Args>(args)...);
+        _segments.add(new_node);
+        return new_node;
+    }
+
+    // a hit, which promotes a probation Node to the protected segment
+    void move_to_front(node_type *given_node) noexcept
+    {
+        _segments.touch(given_node);
+    }
+
+    // the victim Node reused for a new key goes back to the probation front, like
+    // an added one, as the new key hasn't been hit yet
+    void readmit(node_type *reused_node) noexcept
+    {
+        _segments.unlink(reused_node);
+        _segments.add(reused_node);
+    }
+
+    // Unlinks the given node from its segment and hands it back to the allocator
+    template <class Relocated>
+    void remove(node_type *given_node, Relocated&& /*relocated*/) noexcept
+    {
+        _segments.unlink(given_node);
+        _allocator.release(given_node);
+    }
+
+    constexpr node_type& node(node_type *handle) const noexcept
+    {
+        return *handle;
+    }
+
+    constexpr node_type* victim() const noexcept
+    {
+        return _segments.victim();
+    }
+
+    constexpr size_t size() const noexcept
+    {
+        return _segments.size();
+    }
+
+    constexpr const SegmentedLRU<node_type, PROTECTED_PERCENT>& segments() const noexcept
+    {
+        return _segments;
+    }
+
+    void warm_reserve() noexcept
+    {
+        _allocator.warm_reserve();
+    }
+
+    // Releases the Nodes of both segments back to the allocator
+    void clear() noexcept
+    {
+        _segments.release_all(_allocator);
+    }
+};
+
+// Write the protected segment and then the probation one, each from front to back
+template <class Key, class Value, template <class> class NodeAllocator, unsigned PROTECTED_PERCENT>
+ostream& operator<< (ostream& os, const SegmentedLRUList<Key, Value, NodeAllocator, PROTECTED_PERCENT>& list)
+{
+    os << "{";
+
+    const char *separator = write_segment(os, list.segments().protected_front(), "");
+    write_segment(os, list.segments().probation_front(), ( 0 == *separator ) ? "" : " | ");
+
+    return os << "}";
+}
+
+// the protected segment, then the probation one, so the victims come last
+template <class Key, class Value, template <class> class NodeAllocator, unsigned PROTECTED_PERCENT, class Visit>
+void visit_mru_to_lru(const SegmentedLRUList<Key, Value, NodeAllocator, PROTECTED_PERCENT>& list, Visit&& visit)
+{
+    visit_segment(list.segments().protected_front(), visit);
+    visit_segment(list.segments().probation_front(), visit);
+}
+
+// A count-min sketch of the frequencies of the keys seen, with 4-bit counters,
+// for the TinyLFU admission of the WindowTinyLFUList
+// The counters are packed 16 to a 64-bit word, and the table is split in 64-byte
+// blocks of 8 words, one cache line each. A key hashes to one block, and its 4
+// counters (one per hash function) are in 4 different words of that block, so an
+// increment or an estimate of a key touches one cache line
+// Every sample_size increments, all the counters are halved, so the frequencies
+// are of the recent past, and a key once popular can't hold on to its count forever
+class FrequencySketch
+{
+    struct alignas(64) Block
+    {
+        uint64_t _words[8];
+    };
+
+    std::vector<Block> _blocks;
+    size_t _block_mask;
+    size_t _additions{0}; // no. of increments since the counters were last halved
+    size_t _sample_size;
+
+    static constexpr uint64_t COUNTER_MAX = 15;
+
+    // the murmur3 64-bit finalizer, so that a weak hash (like std::hash<int>) still
+    // picks the block and the counters by well mixed bits
+    static uint64_t spread(uint64_t hash) noexcept
+    {
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    // Calls visit(word, shift) for each of the key's 4 counters, the counter being
+    // the 4 bits of the word from the shift up - for a const sketch or not, by Self
+    template <class Self, class Visit>
+    static void for_each_counter(Self &self, size_t hash, Visit&& visit) noexcept
+    {
+        uint64_t const spread_hash = spread(hash);
+        auto &block = self._blocks[static_cast<size_t>(spread_hash >> 32) & self._block_mask];
+        for ( unsigned i = 0; i < 4; ++i )
+        {
+            unsigned const bits = static_cast<unsigned>(spread_hash >> (i * 8));
+            // the i-th counter goes into word 2i or 2i + 1, at one of its 16 counters
+            visit(block._words[(i << 1) + (bits & 1)], ((bits >> 1) & 15) << 2);
+        }
+    }
+
+    // a power of 2 no. of blocks, for a word per key of the capacity
+    static size_t block_count(size_t capacity) noexcept
+    {
+        size_t blocks = 1;
+        while ( blocks * 8 < capacity )
+        {
+            blocks *= 2;
+        }
+        return blocks;
+    }
+
+    // halves all the counters, and with them the no. of additions
+    void age() noexcept
+    {
+        for ( Block &block : _blocks )
+        {
+            for ( uint64_t &word : block._words )
+            {
+                word = (word >> 1) & 0x7777777777777777ull;
+            }
+        }
+        _additions /= 2;
+    }
+
+  public:
+    // one word (16 counters) per key the cache holds, and the counters halved
+    // every 10 times as many increments
+    explicit FrequencySketch(size_t capacity)
+     : _blocks(block_count(capacity)),
+       _block_mask(_blocks.size() - 1),
+       _sample_size(10 * std::max<size_t>(1, capacity))
+    {
+        clear();
+    }
+
+    // counts one more sighting of the key of the hash
+    void increment(size_t hash) noexcept
+    {
+        bool added = false;
+        for_each_counter(*this, hash, [&added](uint64_t &word, unsigned shift)
+        {
+            if ( COUNTER_MAX != ((word >> shift) & COUNTER_MAX) ) // saturated at 15
+            {
+                word += uint64_t(1) << shift;
+                added = true;
+            }
+        });
+
+        if ( added && (++_additions == _sample_size) )
+        {
+            age();
+        }
+    }
+
+    // the estimated frequency of the key of the hash, the least of its 4 counters,
+    // which may overcount for the collisions, but never undercounts
+    unsigned frequency(size_t hash) const noexcept
+    {
+        unsigned least = COUNTER_MAX;
+        for_each_counter(*this, hash, [&least](uint64_t word, unsigned shift)
+        {
+            least = std::min(least, static_cast<unsigned>((word >> shift) & COUNTER_MAX));
+        });
+        return least;
+    }
+
+    void clear() noexcept
+    {
+        std::fill(_blocks.begin(), _blocks.end(), Block{});
+        _additions = 0;
+    }
+};
+
+// A frequency aware storage engine with the same operations as the lists above,
+// implementing W-TinyLFU: a new key is added to a small window LRU segment, of
+// WINDOW_PERCENT of the capacity, in front of a segmented LRU main region (see
+// SegmentedLRU). When a Node is needed for a new key, the window's LRU Node (the
+// candidate) and the main region's victim contend for their place by the estimated
+// frequencies of their keys, as counted by a FrequencySketch of the adds and hits
+// The candidate is only admitted to the main region's probation segment when its
+// key is seen more often than the victim's, which is then the one evicted, else
+// the candidate is. So a burst of new keys goes through the window, and a key has
+// to be seen often to push a popular one out of the main region
+// The keys are hashed for the sketch by a default constructed Hash
+template <class Key, class Value, template <class> class NodeAllocator = SlabNodeAllocator,
+          class Hash = std::hash<Key>, unsigned WINDOW_PERCENT = 1>
+class WindowTinyLFUList
+{
+  public:
+    using node_type = SegmentedListNode<Key, Value>;
+    using handle_type = node_type*;
+
+  private:
+    LinkedSegment<node_type> _window;
+    size_t _window_capacity; // the most Nodes the window holds
+    SegmentedLRU<node_type, 80> _main;
+    FrequencySketch _sketch;
+    Hash _hash;
+
+    NodeAllocator<node_type> _allocator;
+
+    void increment(const node_type *given_node) noexcept
+    {
+        _sketch.increment(_hash(given_node->_key));
+    }
+
+    // adds the Node to the window front, and when the window is over its share, its
+    // LRU Node moves on to the main region, which has room for it then
+    void add_to_window(node_type *given_node) noexcept
+    {
+        _window.push_front(given_node);
+        given_node->_segment = ListSegment::Window;
+
+        if ( _window._size > _window_capacity )
+        {
+            node_type *const admitted = _window._back;
+            _window.unlink(admitted);
+            _main.add(admitted);
+        }
+    }
+
+    void unlink(node_type *given_node) noexcept
+    {
+        if ( ListSegment::Window == given_node->_segment )
+        {
+            _window.unlink(given_node);
+        }
+        else
+        {
+            _main.unlink(given_node);
+        }
+    }
+
+  public:
+    explicit WindowTinyLFUList(size_t capacity)
+     : _window_capacity(std::max<size_t>(1, capacity * WINDOW_PERCENT / 100)),
+       _main(capacity - std::min(capacity, _window_capacity)),
+       _sketch(capacity),
+       _allocator(capacity)
+    { }
+
+    WindowTinyLFUList(const WindowTinyLFUList&) = delete;
+    WindowTinyLFUList& operator= (const WindowTinyLFUList&) = delete;
+
+    ~WindowTinyLFUList()
+    {
+        this->clear();
+    }
+
+    // Allocates a new node, with its value built in place from the args, and adds
+    // it to the window front
+    template <class K, class... Args>
+    node_type* add_to_front(K&& key, Args&&... args)
+    {
+        node_type *new_node = _allocator.allocate(std::in_place, std::forward<K>(key), std::forward<Args>(args)...);
+        increment(new_node);
+        add_to_window(new_node);
+        return new_node;
+    }
+
+    // a hit, counted by the sketch, which moves the Node to the front of its
+    // segment, or promotes it if on probation
+    void move_to_front(node_type *given_node) noexcept
+    {
+        increment(given_node);
+
+        if ( ListSegment::Window == given_node->_segment )
+        {
+            _window.move_to_front(given_node);
+        }
+        else
+        {
+            _main.touch(given_node);
+        }
+    }
+
+    // the victim Node reused for a new key goes to the window front, like an added one
+    void readmit(node_type *reused_node) noexcept
+    {
+        increment(reused_node);
+        unlink(reused_node);
+        add_to_window(reused_node);
+    }
+
+    // Unlinks the given node from its segment and hands it back to the allocator
+    template <class Relocated>
+    void remove(node_type *given_node, Relocated&& /*relocated*/) noexcept
+    {
+        unlink(given_node);
+        _allocator.release(given_node);
+    }
+
+    constexpr node_type& node(node_type *handle) const noexcept
+    {
+        return *handle;
+    }
+
+    // The loser of the window's candidate against the main region's victim, which
+    // is the Node to evict - when the candidate wins, it's admitted to probation
+    // here, so the window has room for the new key the victim's Node is reused for
+    node_type* victim() noexcept
+    {
+        node_type *const candidate = _window._back;
+        node_type *const main_victim = _main.victim();
+
+        if ( (nullptr == candidate) || (nullptr == main_victim) )
+        {
+            return ( nullptr == candidate ) ? main_victim : candidate;
+        }
+
+        if ( _sketch.frequency(_hash(candidate->_key)) > _sketch.frequency(_hash(main_victim->_key)) )
+        {
+            _window.unlink(candidate);
+            _main.add(candidate);
+            return main_victim;
+        }
+
+        return candidate;
+    }
+
+    constexpr size_t size() const noexcept
+    {
+        return _window._size + _main.size();
+    }
+
+    constexpr node_type* window_front() const noexcept
+    {
+        return _window._front;
+    }
+
+    constexpr const SegmentedLRU<node_type, 80>& segments() const noexcept
+    {
+        return _main;
+    }
+
+    const FrequencySketch& sketch() const noexcept
+    {
+        return _sketch;
+    }
+
+    void warm_reserve() noexcept
+    {
+        _allocator.warm_reserve();
+    }
+
+    // Releases the Nodes of all the segments back to the allocator, and forgets
+    // the frequencies counted so far
+    void clear() noexcept
+    {
+        _allocator.release_all(_window._front);
+        _window = LinkedSegment<node_type>();
+        _main.release_all(_allocator);
+        _sketch.clear();
+    }
+};
+
+// Write the window, and then the protected and probation segments of the main region
+template <class Key, class Value, template <class> class NodeAllocator, class Hash, unsigned WINDOW_PERCENT>
+ostream& operator<< (ostream& os, const WindowTinyLFUList<Key, Value, NodeAllocator, Hash, WINDOW_PERCENT>& list)
+{
+    os << "{";
+
+    const char *separator = write_segment(os, list.window_front(), "");
+    separator = write_segment(os, list.segments().protected_front(), ( 0 == *separator ) ? "" : " | ");
+    write_segment(os, list.segments().probation_front(), ( 0 == *separator ) ? "" : " | ");
+
+    return os << "}";
+}
+
+// the window, then the main region's protected and probation segments
+template <class Key, class Value, template <class> class NodeAllocator, class Hash, unsigned WINDOW_PERCENT,
+          class Visit>
+void visit_mru_to_lru(const WindowTinyLFUList<Key, Value, NodeAllocator, Hash, WINDOW_PERCENT>& list, Visit&& visit)
+{
+    visit_segment(list.window_front(), visit);
+    visit_segment(list.segments().protected_front(), visit);
+    visit_segment(list.segments().probation_front(), visit);
+}
+
+// For throwing when the LRUCache's capacity is initialised with a negative size
+class InvalidCapacity : public std::exception
+{
+	virtual const char* what() const noexcept override
+	{
+		return "LRUCache's capacity has to be initialised with a positive value";
+	}
+} InvalidCapacityException;
+
+// A flat open-addressing hash index from the key to the Node's handle, used as
+// the LRUCache's dictionary in place of the node based std::unordered_map
+// Robin Hood hashing with backward shift deletion is used, so:
+//   1. key and handle are stored inline in one array of slots, there is no
+//      per-entry allocation and a probe walks adjacent slots in a cache line
+//   2. no tombstones are left behind on erase, so probe lengths stay short
+//      however long the cache keeps evicting
+// The table is sized once from the capacity for a load factor of at most 3/4
+// and is never rehashed, since the LRUCache never holds more than capacity keys
+// (plus the one new key a full LRUCache::put adds before it evicts the LRU key)
+// The Key needs to be default constructible (for the empty slots), equality
+// comparable and nothrow movable (for the shifts), and hashable by the Hash
+// The slots are carved out of a Region, like a slab's Nodes (see HeapRegion)
+template <class Key, class Handle, class Hash = std::hash<Key>, class Region = HeapRegion>
+class FlatHashIndex
+{
+    static_assert(std::is_nothrow_move_assignable<Key>::value,
+                  "FlatHashIndex moves the keys around on insert and erase, which must not throw");
+
+    struct Slot
+    {
+        Key _key;
+        uint32_t _distance; // 1 + distance from the home slot, 0 if the slot is empty
+        Handle _handle;
+    };
+
+    static_assert(alignof(Slot) <= alignof(std::max_align_t), "the Region only aligns the slots as new does");
+
+    Region _region; // of the slots
+    size_t _mask{0}; // no. of slots - 1, the no. of slots being a power of 2
+    int _shift{0}; // 64 - log2(no. of slots), to pick the top bits of the mixed hash
+    size_t _size{0};
+    Hash _hash;
+
+    // lets go of whatever an emptied slot's key holds on to, a no-op for the plain keys
+    static void release_key(Slot &slot) noexcept
+    {
+        if constexpr ( !std::is_trivially_destructible<Key>::value )
+        {
+            slot._key = Key();
+        }
+    }
+
+    Slot* slots() const noexcept
+    {
+        return static_cast<Slot*>(_region.data());
+    }
+
+    void destroy_slots(size_t built) noexcept
+    {
+        if constexpr ( !std::is_trivially_destructible<Slot>::value )
+        {
+            for ( size_t slot = 0; slot < built; ++slot )
+            {
+                slots()[slot].~Slot();
+            }
+        }
+    }
+
+    // smallest power of 2 that keeps the load factor at or below 3/4 for capacity + 1 keys
+    static size_t slots_for(size_t capacity) noexcept
+    {
+        size_t slots = 2;
+        while ( slots * 3 < (capacity + 1) * 4 )
+        {
+            slots <<= 1;
+        }
+        return slots;
+    }
+
+  public:
+    explicit FlatHashIndex(size_t capacity, const Hash& hash = Hash())
+     : _region(slots_for(capacity) * sizeof(Slot)),
+       _hash(hash)
+    {
+        size_t const count = slots_for(capacity);
+        size_t built = 0;
+        try
+        {
+            for ( ; built < count; ++built )
+            {
+                ::new (static_cast<void*>(slots() + built)) Slot(); // value-initialised - so all empty
+            }
+        }
+        catch ( ... )
+        {
+            destroy_slots(built);
+            throw;
+        }
+        _mask = count - 1;
+
+        int log2_slots = 0;
+        while ( (size_t{1} << log2_slots) < count )
+        {
+            ++log2_slots;
+        }
+        _shift = 64 - log2_slots;
+    }
+
+    FlatHashIndex(const FlatHashIndex&) = delete;
+    FlatHashIndex& operator=(const FlatHashIndex&) = delete;
+
+    ~FlatHashIndex()
+    {
+        destroy_slots(_mask + 1);
+    }
+
+    // Fibonacci hashing: the multiply spreads the bits of the hash over the high bits,
+    // so sequential or strided int keys (which std::hash leaves as they are) don't
+    // pile up in neighbouring home slots
+    // The home slot only depends on the key, as the table never grows, so it can be
+    // worked out ahead for a batch of keys and passed to find and try_emplace below
+    size_t home_slot(const Key& key) const noexcept
+    {
+        return static_cast<size_t>((static_cast<uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull) >> _shift);
+    }
+
+    // starts loading the home slot in, for the probe of its key to come
+    void prefetch(size_t home) const noexcept
+    {
+        prefetch_line(&slots()[home]);
+    }
+
+    // Returns the pointer to the handle stored for the key, or nullptr if it isn't found
+    Handle* find(const Key& key) noexcept
+    {
+        return find(key, home_slot(key));
+    }
+
+    const Handle* find(const Key& key) const noexcept
+    {
+        return find(key, home_slot(key));
+    }
+
+    Handle* find(const Key& key, size_t home) noexcept
+    {
+        return const_cast<Handle*>(static_cast<const FlatHashIndex*>(this)->find(key, home));
+    }
+
+    const Handle* find(const Key& key, size_t home) const noexcept
+    {
+        size_t slot = home;
+
+        // walk until the key is found, or until the keys seen are nearer to their
+        // home than we would be, which Robin Hood guarantees means the key is absent
+        for ( uint32_t distance = 1; distance <= slots()[slot]._distance; ++distance )
+        {
+            if ( slots()[slot]._key == key )
+            {
+                return &slots()[slot]._handle;
+            }
+            slot = (slot + 1) & _mask;
+        }
+
+        return nullptr;
+    }
+
+    // never due, as its erases shift the keys back, leaving no tombstones to rehash
+    // away (see TagHashIndex::rehash_due)
+    static constexpr bool rehash_due() noexcept
+    {
+        return false;
+    }
+
+    void rehash() noexcept
+    {
+    }
+
+    // Finds the key, or adds it with the given handle when it isn't found, in one
+    // walk of the probe sequence - the slot where the probe for the key stops is
+    // exactly where Robin Hood would insert it
+    // Returns the pointer to the key's handle and whether the key was newly added
+    // Never allocates, as the table was sized for the capacity no. of keys upfront,
+    // and leaves the index as it was if copying the key in throws
+    std::pair<Handle*, bool> try_emplace(const Key& key, Handle handle)
+        noexcept(std::is_nothrow_copy_constructible<Key>::value)
+    {
+        return try_emplace(key, handle, home_slot(key));
+    }
+
+    std::pair<Handle*, bool> try_emplace(const Key& key, Handle handle, size_t home)
+        noexcept(std::is_nothrow_copy_constructible<Key>::value)
+    {
+        size_t slot = home;
+        uint32_t distance = 1;
+
+        for ( ; distance <= slots()[slot]._distance; ++distance )
+        {
+            if ( slots()[slot]._key == key )
+            {
+                return {&slots()[slot]._handle, false};
+            }
+            slot = (slot + 1) & _mask;
+        }
+
+        Handle *const emplaced = &slots()[slot]._handle;
+        Slot incoming{key, distance, handle};
+
+        while ( 0 != slots()[slot]._distance )
+        {
+            // take the slot from the richer key, which is nearer to its home,
+            // and carry on finding a place for the displaced one
+            if ( slots()[slot]._distance < incoming._distance )
+            {
+                std::swap(slots()[slot], incoming);
+            }
+            ++incoming._distance;
+            slot = (slot + 1) & _mask;
+        }
+
+        slots()[slot] = std::move(incoming);
+        ++_size;
+
+        return {emplaced, true};
+    }
+
+    // Removes the key if present, shifting the following displaced keys back by one
+    void erase(const Key& key) noexcept
+    {
+        size_t slot = home_slot(key);
+        uint32_t distance = 1;
+
+        for ( ; distance <= slots()[slot]._distance; ++distance )
+        {
+            if ( slots()[slot]._key == key )
+            {
+                break;
+            }
+            slot = (slot + 1) & _mask;
+        }
+
+        if ( distance > slots()[slot]._distance ) // the key isn't in the index
+        {
+            return;
+        }
+
+        size_t next = (slot + 1) & _mask;
+        while ( slots()[next]._distance > 1 ) // until an empty slot or a key at its home
+        {
+            slots()[slot] = std::move(slots()[next]);
+            --slots()[slot]._distance;
+            slot = next;
+            next = (next + 1) & _mask;
+        }
+
+        slots()[slot]._distance = 0;
+        release_key(slots()[slot]);
+        --_size;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    // the no. of slots of the table, and the handle in the slot, or nullptr if it's
+    // empty, to walk all the keys held
+    size_t slot_count() const noexcept
+    {
+        return _mask + 1;
+    }
+
+    const Handle* handle_at(size_t slot) const noexcept
+    {
+        return ( 0 == slots()[slot]._distance ) ? nullptr : &slots()[slot]._handle;
+    }
+
+    // Empties all the slots, the table itself is kept for the next fill
+    void clear() noexcept
+    {
+        for ( size_t slot = 0; slot <= _mask; ++slot )
+        {
+            slots()[slot]._distance = 0;
+            release_key(slots()[slot]);
+        }
+        _size = 0;
+    }
+};
+
+// A hash mixed by a multiply (Fibonacci hashing), so that its top bits depend on all
+// of it, for the int keys std::hash leaves as they are, strided or not
+inline uint64_t mix_hash(uint64_t hash) noexcept
+{
+    return (hash ^ (hash >> 32)) * 0x9E3779B97F4A7C15ull;
+}
+
+// The control byte of a slot of a TagHashIndex: a full slot's is the 7-bit tag of its
+// key's hash (0 to 127), and an empty one's is one of these, negative, values
+constexpr int8_t TAG_EMPTY = -128;   // never filled since it was last emptied
+constexpr int8_t TAG_DELETED = -2;   // erased, but a probe may have to go past it
+
+// the index of the lowest and of the highest bit set in the mask, which isn't 0
+inline unsigned lowest_bit(uint64_t mask) noexcept
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+inline unsigned highest_bit(uint64_t mask) noexcept
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return 63 - static_cast<unsigned>(__builtin_clzll(mask));
+#endif
+}
+
+// The WIDTH control bytes of a TagHashIndex that a probe looks at in one go, from any
+// slot on (the first WIDTH - 1 bytes are cloned past the end of the table), all of
+// their tags compared at once: 32 an instruction with AVX2, 16 with SSE2 or NEON, and
+// 8 a 64-bit word without any (SWAR), picked when it's compiled, as the group is
+// inlined into every probe. Each match returns a mask with a bit set for each byte
+// that matches, the i-th byte's being the bit i << LANE_SHIFT or above it
+#if defined(LRUCACHE_HAS_AVX2)
+class TagGroup
+{
+    __m256i _ctrl;
+
+  public:
+    static constexpr size_t WIDTH = 32;
+    static constexpr unsigned LANE_SHIFT = 0;
+
+    explicit TagGroup(const int8_t* ctrl) noexcept
+     : _ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ctrl)))
+    { }
+
+    uint64_t match(int8_t tag) const noexcept
+    {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_ctrl, _mm256_set1_epi8(tag))));
+    }
+
+    uint64_t match_empty() const noexcept
+    {
+        return match(TAG_EMPTY);
+    }
+
+    // the EMPTY and the DELETED bytes, the only ones below -1
+    uint64_t match_free() const noexcept
+    {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-1), _ctrl)));
+    }
+};
+#elif defined(LRUCACHE_HAS_SSE2)
+class TagGroup
+{
+    __m128i _ctrl;
+
+  public:
+    static constexpr size_t WIDTH = 16;
+    static constexpr unsigned LANE_SHIFT = 0;
+
+    explicit TagGroup(const int8_t* ctrl) noexcept
+     : _ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+    { }
+
+    uint64_t match(int8_t tag) const noexcept
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_ctrl, _mm_set1_epi8(tag))));
+    }
+
+    uint64_t match_empty() const noexcept
+    {
+        return match(TAG_EMPTY);
+    }
+
+    // the EMPTY and the DELETED bytes, the only ones below -1
+    uint64_t match_free() const noexcept
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), _ctrl)));
+    }
+};
+#elif defined(LRUCACHE_HAS_NEON)
+class TagGroup
+{
+    int8x16_t _ctrl;
+
+    // NEON has no movemask, so the compare's bytes are narrowed to a nibble each,
+    // and one bit of each nibble is kept
+    static uint64_t mask_of(uint8x16_t matched) noexcept
+    {
+        uint8x8_t const nibbles = vshrn_n_u16(vreinterpretq_u16_u8(matched), 4);
+        return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ull;
+    }
+
+  public:
+    static constexpr size_t WIDTH = 16;
+    static constexpr unsigned LANE_SHIFT = 2;
+
+    explicit TagGroup(const int8_t* ctrl) noexcept
+     : _ctrl(vld1q_s8(ctrl))
+    { }
+
+    uint64_t match(int8_t tag) const noexcept
+    {
+        return mask_of(vceqq_s8(_ctrl, vdupq_n_s8(tag)));
+    }
+
+    uint64_t match_empty() const noexcept
+    {
+        return match(TAG_EMPTY);
+    }
+
+    // the EMPTY and the DELETED bytes, the only ones below -1
+    uint64_t match_free() const noexcept
+    {
+        return mask_of(vcltq_s8(_ctrl, vdupq_n_s8(-1)));
+    }
+};
+#else
+class TagGroup
+{
+    static constexpr uint64_t LSBS = 0x0101010101010101ull;
+    static constexpr uint64_t MSBS = 0x8080808080808080ull;
+
+    uint64_t _ctrl; // the bytes in order from the lowest one up
+
+  public:
+    static constexpr size_t WIDTH = 8;
+    static constexpr unsigned LANE_SHIFT = 3;
+
+    explicit TagGroup(const int8_t* ctrl) noexcept
+    {
+        std::memcpy(&_ctrl, ctrl, sizeof(_ctrl));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        _ctrl = __builtin_bswap64(_ctrl);
+#endif
+    }
+
+    // the zero bytes of the xor with the tag, which may also have the byte just above
+    // a match matching, which the compare of its key then rules out
+    uint64_t match(int8_t tag) const noexcept
+    {
+        uint64_t const x = _ctrl ^ (LSBS * static_cast<uint8_t>(tag));
+        return (x - LSBS) & ~x & MSBS;
+    }
+
+    // EMPTY is the one byte with its top bit set and its bit 1 clear
+    uint64_t match_empty() const noexcept
+    {
+        return _ctrl & ~(_ctrl << 6) & MSBS;
+    }
+
+    // EMPTY and DELETED are the ones with their top bit set and their bit 0 clear
+    uint64_t match_free() const noexcept
+    {
+        return _ctrl & ~(_ctrl << 7) & MSBS;
+    }
+};
+#endif
+
+// A flat open-addressing hash index from the key to the Node's handle, a drop in for
+// the FlatHashIndex, but probed SwissTable style: each slot has a control byte in an
+// array of its own, holding 7 bits of its key's hash (the tag) while it's full, so a
+// probe compares the tags of a whole TagGroup of slots at once, and only compares the
+// keys of the slots whose tags match:
+//   1. the hash is mixed first, by a multiply, so that int keys (which std::hash
+//      leaves as they are) spread over the table and over the tags, strided or not
+//   2. a key is looked for a group at a time from its home slot on, the groups
+//      probed triangularly (which visits all of them), until a group with an EMPTY
+//      slot in it, so a miss mostly takes the one group
+//   3. no key ever moves on an erase, which leaves a DELETED slot (a tombstone)
+//      behind only if a probe may have gone past the slot, so that the tombstones are
+//      few, and they're cleared by rehashing the table in place, in the same slots,
+//      once the full and the DELETED slots take up 7/8 of them
+// The table is sized once from the capacity for a load factor of at most 3/4, of 16
+// slots at least (a group's width), like the FlatHashIndex's, and never grows, and
+// it's only the rehash in place, done by a try_emplace before it probes (or ahead of
+// it, by rehash), that moves the keys (and the handles a find points to)
+// The Key needs to be default constructible, equality comparable and nothrow movable,
+// and hashable by the Hash. The control bytes and the slots are carved out of a Region
+template <class Key, class Handle, class Hash = std::hash<Key>, class Region = HeapRegion>
+class TagHashIndex
+{
+    static_assert(std::is_nothrow_move_assignable<Key>::value,
+                  "TagHashIndex moves the keys around on its rehash, which must not throw");
+
+    struct Slot
+    {
+        Key _key;
+        Handle _handle;
+    };
+
+    static_assert(alignof(Slot) <= alignof(std::max_align_t), "the Region only aligns the slots as new does");
+
+    static constexpr size_t WIDTH = TagGroup::WIDTH;
+    static constexpr size_t CLONED = WIDTH - 1; // the control bytes cloned past the end
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    Region _region; // of the control bytes, then the slots
+    int8_t *_ctrl{nullptr};
+    Slot *_slots{nullptr};
+    size_t _mask{0}; // no. of slots - 1, the no. of slots being a power of 2
+    int _shift{0}; // 64 - log2(no. of slots), to pick the top bits of the mixed hash
+    size_t _size{0};
+    size_t _growth_left{0}; // no. of EMPTY slots to fill before the rehash in place
+    Hash _hash;
+
+    // lets go of whatever an emptied slot's key holds on to, a no-op for the plain keys
+    static void release_key(Slot &slot) noexcept
+    {
+        if constexpr ( !std::is_trivially_destructible<Key>::value )
+        {
+            slot._key = Key();
+        }
+    }
+
+    void destroy_slots(size_t built) noexcept
+    {
+        if constexpr ( !std::is_trivially_destructible<Slot>::value )
+        {
+            for ( size_t slot = 0; slot < built; ++slot )
+            {
+                _slots[slot].~Slot();
+            }
+        }
+    }
+
+    // smallest power of 2, and a group's width at least, that keeps the load factor at
+    // or below 3/4 for capacity + 1 keys
+    static constexpr size_t slots_for(size_t capacity) noexcept
+    {
+        size_t slots = std::max<size_t>(16, WIDTH);
+        while ( slots * 3 < (capacity + 1) * 4 )
+        {
+            slots <<= 1;
+        }
+        return slots;
+    }
+
+    // the control bytes, clones and all, padded out to where the slots start
+    static constexpr size_t ctrl_bytes(size_t slots) noexcept
+    {
+        return (slots + CLONED + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+    }
+
+    // the most slots that can be full or DELETED, so that an eighth of them are EMPTY
+    // for every probe to end on
+    size_t max_used() const noexcept
+    {
+        return (_mask + 1) - (_mask + 1) / 8;
+    }
+
+    // the key's hash mixed: its top bits pick the home slot, and the 7 below them the tag
+    uint64_t mix(const Key& key) const noexcept
+    {
+        return mix_hash(static_cast<uint64_t>(_hash(key)));
+    }
+
+    // sets the slot's control byte, and its clone if it's one of the first WIDTH - 1
+    void set_ctrl(size_t slot, int8_t ctrl) noexcept
+    {
+        _ctrl[slot] = ctrl;
+        _ctrl[((slot - CLONED) & _mask) + CLONED] = ctrl;
+    }
+
+    size_t find_slot(const Key& key, size_t home) const noexcept
+    {
+        int8_t const tag = static_cast<int8_t>(home & 0x7F);
+        size_t slot = home >> 7;
+
+        for ( size_t step = WIDTH; ; step += WIDTH )
+        {
+            TagGroup const group(_ctrl + slot);
+            for ( uint64_t matched = group.match(tag); 0 != matched; matched &= matched - 1 )
+            {
+                size_t const at = (slot + (lowest_bit(matched) >> TagGroup::LANE_SHIFT)) & _mask;
+                if ( _slots[at]._key == key )
+                {
+                    return at;
+                }
+            }
+            if ( 0 != group.match_empty() ) // the key would've been put before it
+            {
+                return NOT_FOUND;
+            }
+            slot = (slot + step) & _mask;
+        }
+    }
+
+    // the first EMPTY or DELETED slot of the probe from the slot on
+    size_t find_free(size_t slot) const noexcept
+    {
+        for ( size_t step = WIDTH; ; step += WIDTH )
+        {
+            uint64_t const free = TagGroup(_ctrl + slot).match_free();
+            if ( 0 != free )
+            {
+                return (slot + (lowest_bit(free) >> TagGroup::LANE_SHIFT)) & _mask;
+            }
+            slot = (slot + step) & _mask;
+        }
+    }
+
+    // Clears the DELETED slots out, the keys being put back in the same slots: each
+    // full slot is marked DELETED, as one still to be put back, and the DELETED ones
+    // EMPTY, and then each key is left where it is if that's in the group its probe
+    // would put it in anyway, else moved to the free slot of its probe, or swapped
+    // with the key still to be put back there, which is put back next
+    void rehash_in_place() noexcept
+    {
+        for ( size_t slot = 0; slot <= _mask; ++slot )
+        {
+            _ctrl[slot] = ( 0 <= _ctrl[slot] ) ? TAG_DELETED : TAG_EMPTY;
+        }
+        std::memcpy(_ctrl + _mask + 1, _ctrl, CLONED);
+
+        for ( size_t slot = 0; slot <= _mask; ++slot )
+        {
+            if ( TAG_DELETED != _ctrl[slot] )
+            {
+                continue;
+            }
+
+            uint64_t const hash = mix(_slots[slot]._key);
+            size_t const home = static_cast<size_t>(hash >> _shift);
+            int8_t const tag = static_cast<int8_t>((hash >> (_shift - 7)) & 0x7F);
+            size_t const target = find_free(home);
+
+            // the probe's groups are WIDTH slots apart, so this is the group of it
+            auto const group_of = [home, this](size_t at) { return ((at - home) & _mask) / WIDTH; };
+            if ( group_of(target) == group_of(slot) )
+            {
+                set_ctrl(slot, tag);
+            }
+            else if ( TAG_EMPTY == _ctrl[target] )
+            {
+                _slots[target] = std::move(_slots[slot]);
+                release_key(_slots[slot]);
+                set_ctrl(target, tag);
+                set_ctrl(slot, TAG_EMPTY);
+            }
+            else
+            {
+                set_ctrl(target, tag);
+                std::swap(_slots[slot], _slots[target]);
+                --slot; // for the key swapped in to be put back
+            }
+        }
+
+        _growth_left = max_used() - _size;
+    }
+
+  public:
+    // the bytes of the Region the index of the capacity takes, known at compile time
+    static constexpr size_t region_bytes(size_t capacity) noexcept
+    {
+        return ctrl_bytes(slots_for(capacity)) + slots_for(capacity) * sizeof(Slot);
+    }
+
+    explicit TagHashIndex(size_t capacity, const Hash& hash = Hash())
+     : _region(region_bytes(capacity)),
+       _hash(hash)
+    {
+        size_t const count = slots_for(capacity);
+        _ctrl = static_cast<int8_t*>(_region.data());
+        _slots = reinterpret_cast<Slot*>(static_cast<unsigned char*>(_region.data()) + ctrl_bytes(count));
+
+        size_t built = 0;
+        try
+        {
+            for ( ; built < count; ++built )
+            {
+                ::new (static_cast<void*>(_slots + built)) Slot();
+            }
+        }
+        catch ( ... )
+        {
+            destroy_slots(built);
+            throw;
+        }
+        std::memset(_ctrl, TAG_EMPTY, count + CLONED);
+        _mask = count - 1;
+
+        int log2_slots = 0;
+        while ( (size_t{1} << log2_slots) < count )
+        {
+            ++log2_slots;
+        }
+        _shift = 64 - log2_slots;
+        _growth_left = max_used();
+    }
+
+    TagHashIndex(const TagHashIndex&) = delete;
+    TagHashIndex& operator=(const TagHashIndex&) = delete;
+
+    ~TagHashIndex()
+    {
+        destroy_slots(_mask + 1);
+    }
+
+    // The home slot of the key, with the tag of its mixed hash in the low 7 bits
+    // It only depends on the key, as the table never grows, so it can be worked out
+    // ahead for a batch of keys and passed to find and try_emplace below
+    size_t home_slot(const Key& key) const noexcept
+    {
+        uint64_t const hash = mix(key);
+        return (static_cast<size_t>(hash >> _shift) << 7) | static_cast<size_t>((hash >> (_shift - 7)) & 0x7F);
+    }
+
+    // starts loading the control bytes and the slot of the home in, for the probe to come
+    void prefetch(size_t home) const noexcept
+    {
+        prefetch_line(_ctrl + (home >> 7));
+        prefetch_line(&_slots[home >> 7]);
+    }
+
+    // Returns the pointer to the handle stored for the key, or nullptr if it isn't found
+    Handle* find(const Key& key) noexcept
+    {
+        return find(key, home_slot(key));
+    }
+
+    const Handle* find(const Key& key) const noexcept
+    {
+        return find(key, home_slot(key));
+    }
+
+    Handle* find(const Key& key, size_t home) noexcept
+    {
+        return const_cast<Handle*>(static_cast<const TagHashIndex*>(this)->find(key, home));
+    }
+
+    const Handle* find(const Key& key, size_t home) const noexcept
+    {
+        size_t const found = find_slot(key, home);
+        return ( NOT_FOUND == found ) ? nullptr : &_slots[found]._handle;
+    }
+
+    // Whether the EMPTY slots have run out, so that the next add of a key, unless it
+    // reuses a DELETED slot, clears the DELETED ones out in place first: an O(slots)
+    // pass, once in every eighth of the slots filled at most, as the erases leave them
+    bool rehash_due() const noexcept
+    {
+        return 0 == _growth_left;
+    }
+
+    // Clears the DELETED slots out in place, which try_emplace does itself when due,
+    // unless it's been done ahead of it (as an LRUCache does, to time it)
+    void rehash() noexcept
+    {
+        rehash_in_place();
+    }
+
+    // Finds the key, or adds it with the given handle when it isn't found, in the
+    // first free slot of its probe - an EMPTY one, or a DELETED one, reused
+    // Returns the pointer to the key's handle and whether the key was newly added
+    // Never allocates, as the table was sized for the capacity no. of keys upfront,
+    // and leaves the index as it was if copying the key in throws. It may rehash in
+    // place, when due (see rehash_due)
+    std::pair<Handle*, bool> try_emplace(const Key& key, Handle handle)
+        noexcept(std::is_nothrow_copy_constructible<Key>::value)
+    {
+        return try_emplace(key, handle, home_slot(key));
+    }
+
+    std::pair<Handle*, bool> try_emplace(const Key& key, Handle handle, size_t home)
+        noexcept(std::is_nothrow_copy_constructible<Key>::value)
+    {
+        size_t const found = find_slot(key, home);
+        if ( NOT_FOUND != found )
+        {
+            return {&_slots[found]._handle, false};
+        }
+
+        Key added(key);
+        size_t target = find_free(home >> 7);
+        if ( (0 == _growth_left) && (TAG_DELETED != _ctrl[target]) ) // a DELETED one is reused for free
+        {
+            rehash_in_place();
+            target = find_free(home >> 7);
+        }
+
+        _growth_left -= ( TAG_EMPTY == _ctrl[target] );
+        set_ctrl(target, static_cast<int8_t>(home & 0x7F));
+        _slots[target]._key = std::move(added);
+        _slots[target]._handle = handle;
+        ++_size;
+
+        return {&_slots[target]._handle, true};
+    }
+
+    // Removes the key if present. Its slot is left DELETED only if it's in a run of
+    // WIDTH slots with no EMPTY one, which a probe could've gone past it through, else
+    // it's EMPTY again
+    void erase(const Key& key) noexcept
+    {
+        size_t const slot = find_slot(key, home_slot(key));
+        if ( NOT_FOUND == slot ) // the key isn't in the index
+        {
+            return;
+        }
+
+        uint64_t const empty_after = TagGroup(_ctrl + slot).match_empty();
+        uint64_t const empty_before = TagGroup(_ctrl + ((slot - WIDTH) & _mask)).match_empty();
+        bool const never_full = ( 0 != empty_after ) && ( 0 != empty_before ) &&
+            ( (lowest_bit(empty_after) >> TagGroup::LANE_SHIFT) +
+              (WIDTH - 1 - (highest_bit(empty_before) >> TagGroup::LANE_SHIFT)) < WIDTH );
+
+        set_ctrl(slot, never_full ? TAG_EMPTY : TAG_DELETED);
+        _growth_left += never_full;
+        release_key(_slots[slot]);
+        --_size;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    // the no. of slots of the table, and the handle in the slot, or nullptr if it's
+    // empty, to walk all the keys held
+    size_t slot_count() const noexcept
+    {
+        return _mask + 1;
+    }
+
+    const Handle* handle_at(size_t slot) const noexcept
+    {
+        return ( 0 <= _ctrl[slot] ) ? &_slots[slot]._handle : nullptr;
+    }
+
+    // Empties all the slots, the table itself is kept for the next fill
+    void clear() noexcept
+    {
+        for ( size_t slot = 0; slot <= _mask; ++slot )
+        {
+            if ( 0 <= _ctrl[slot] )
+            {
+                release_key(_slots[slot]);
+            }
+        }
+        std::memset(_ctrl, TAG_EMPTY, _mask + 1 + CLONED);
+        _size = 0;
+        _growth_left = max_used();
+    }
+};
+
+/* Attempt at trying to use pimpl idiom pattern
+ * or rather pointer to an absract interface can be used to provide polymorphic behavior
+ * with the varying concrete implementation of the underlying data structures
+class LRUCache
+{
+    class LRUCacheImpl;
+    std::unique_ptr<LRUCacheImpl> uptr_to_lru_impl;
+
+  public:
+    ~LRUCache();
+    explicit LRUCache(int capacity) throw();
+    {
+        if ( 0 >= capacity )
+        {
+            throw InvalidCapacityException;
+        }
+        
+        uptr_to_lru_impl.reset(new LRUCacheImpl(capacity));
+    }
+
+    int get(int key) noexcept
+    {
+        return uptr_to_lru_impl->get(key);
+    }
+    
+    void put(int key, int value)
+    {
+        uptr_to_lru_impl->put(key, value);
+    }
+
+    friend ostream& operator<< (ostream& os, const LRUCache& cache);
+};
+
+ostream& operator<< (ostream& os, const LRUCache& cache)
+{
     os << *(cache.uptr_to_lru_impl) << endl;
 } */
 
-// LRUCache implementation using the LRUTwoWayList defined above and unordered_map 
-// hash container from STL as dictionary for storing the <key,Node(key,value)> pair
-// The LRUTwoWayList and the TwoWayListNode could as well be nested within this 
-// class in order to make it more encapsulated - however, left it this way for now 
-class LRUCache
+// A snapshot of a cache's counters, as returned by stats()
+// puts counts both the inserts of new keys and the updates of existing ones, and
+// bytes is the footprint of the keys and values held, as per entry_bytes below
+struct CacheStats
+{
+    uint64_t _hits{0};
+    uint64_t _misses{0};
+    uint64_t _puts{0};
+    uint64_t _updates{0};
+    uint64_t _evictions{0};
+    uint64_t _bytes{0};
+
+    double hit_ratio() const noexcept
+    {
+        uint64_t const lookups = _hits + _misses;
+        return ( 0 < lookups ) ? static_cast<double>(_hits) / lookups : 0;
+    }
+
+    uint64_t inserts() const noexcept
+    {
+        return _puts - _updates;
+    }
+
+    CacheStats& operator+= (const CacheStats& other) noexcept
+    {
+        _hits += other._hits;
+        _misses += other._misses;
+        _puts += other._puts;
+        _updates += other._updates;
+        _evictions += other._evictions;
+        _bytes += other._bytes;
+        return *this;
+    }
+};
+
+inline ostream& operator<< (ostream& os, const CacheStats& stats)
+{
+    os << "{hits=" << stats._hits << ", misses=" << stats._misses << ", puts=" << stats._puts;
+    os << ", updates=" << stats._updates << ", evictions=" << stats._evictions << ", bytes=" << stats._bytes << "}";
+    return os;
+}
+
+// The footprint of a key or a value in the cache: its own size, plus the elements
+// a string or a vector holds. Not their capacity, which moving a Node between the
+// slots of an array engine can change, and the weight given back on an eviction
+// has to be the one added on the put
+template <class T>
+size_t entry_bytes(const T& t) noexcept
+{
+    return sizeof(t);
+}
+
+template <class Char, class Traits, class Allocator>
+size_t entry_bytes(const std::basic_string<Char, Traits, Allocator>& t) noexcept
+{
+    return sizeof(t) + t.size() * sizeof(Char);
+}
+
+template <class T, class Allocator>
+size_t entry_bytes(const std::vector<T, Allocator>& t) noexcept
+{
+    return sizeof(t) + t.size() * sizeof(T);
+}
+
+// The counters of a cache (of a shard, in a ConcurrentLRUCache), picked by the
+// Policy's stats_type. They are relaxed atomics, so stats() can read them while
+// the cache is in use without taking its locks, and so the concurrent gets of a
+// deferred shard, which share its lock, can count their hits all the same
+// The snapshot isn't a consistent cut across the counters, just each one as of then
+class CacheCounters
+{
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _puts{0};
+    std::atomic<uint64_t> _updates{0};
+    std::atomic<uint64_t> _evictions{0};
+    std::atomic<uint64_t> _bytes{0};
+
+    static void count(std::atomic<uint64_t> &counter, uint64_t by = 1) noexcept
+    {
+        counter.fetch_add(by, std::memory_order_relaxed);
+    }
+
+  public:
+    static constexpr bool ENABLED = true;
+
+    void hit() noexcept { count(_hits); }
+    void miss() noexcept { count(_misses); }
+    void put() noexcept { count(_puts); }
+    void update() noexcept { count(_puts); count(_updates); }
+    void eviction() noexcept { count(_evictions); }
+    void add_bytes(size_t bytes) noexcept { count(_bytes, bytes); }
+    void remove_bytes(size_t bytes) noexcept { _bytes.fetch_sub(bytes, std::memory_order_relaxed); }
+    void clear_bytes() noexcept { _bytes.store(0, std::memory_order_relaxed); }
+
+    CacheStats snapshot() const noexcept
+    {
+        CacheStats stats;
+        stats._hits = _hits.load(std::memory_order_relaxed);
+        stats._misses = _misses.load(std::memory_order_relaxed);
+        stats._puts = _puts.load(std::memory_order_relaxed);
+        stats._updates = _updates.load(std::memory_order_relaxed);
+        stats._evictions = _evictions.load(std::memory_order_relaxed);
+        stats._bytes = _bytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+// The default stats_type, counting nothing: all of it inlines away, and it takes
+// no room in the LRUCache either (see LRUCACHE_NO_UNIQUE_ADDRESS)
+struct NoCacheCounters
+{
+    static constexpr bool ENABLED = false;
+
+    void hit() noexcept { }
+    void miss() noexcept { }
+    void put() noexcept { }
+    void update() noexcept { }
+    void eviction() noexcept { }
+    void add_bytes(size_t) noexcept { }
+    void remove_bytes(size_t) noexcept { }
+    void clear_bytes() noexcept { }
+
+    CacheStats snapshot() const noexcept
+    {
+        return CacheStats{};
+    }
+};
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(no_unique_address)
+#define LRUCACHE_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+#endif
+#ifndef LRUCACHE_NO_UNIQUE_ADDRESS
+#define LRUCACHE_NO_UNIQUE_ADDRESS
+#endif
+
+// The ops the CacheInstruments time: a get (or peek), a put (or emplace), and,
+// within a put, the eviction of the victim, the allocation of a new Node, and the
+// rehash of the map. The FlatHashIndex never rehashes, being sized for the capacity
+// upfront, but a TagHashIndex (of a TagProbedPolicy) clears its DELETED slots out
+// in place now and then, an O(slots) stall of the put it falls to
+enum class CacheOp : uint8_t
+{
+    Get = 0,
+    Put,
+    Evict,
+    Allocate,
+    Rehash
+};
+
+constexpr size_t CACHE_OP_COUNT = 5;
+
+// Reads the CPU's timestamp counter, the cheapest clock there is: rdtsc on x86,
+// the virtual counter on ARM64, and the steady_clock's nanoseconds elsewhere
+inline uint64_t read_ticks() noexcept
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// ticks per nanosecond, calibrated once against the steady_clock over ~10 ms
+inline double ticks_per_ns()
+{
+    static double const calibrated = []()
+    {
+        auto const start_time = std::chrono::steady_clock::now();
+        uint64_t const start_ticks = read_ticks();
+        while ( std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(10) )
+        { }
+        uint64_t const ticks = read_ticks() - start_ticks;
+        auto const time_taken = std::chrono::steady_clock::now() - start_time;
+        return ticks / static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(time_taken).count());
+    }();
+    return calibrated;
+}
+
+// The log-linear (HDR style) buckets of the latency histograms: the values below
+// 2^LATENCY_SUB_BITS each get one of their own, and the values of each power of 2
+// above are split into 2^LATENCY_SUB_BITS alike, so every bucket is within
+// 1/2^LATENCY_SUB_BITS (~6%) of the values in it, up to ~2^40 ticks
+constexpr int LATENCY_SUB_BITS = 4;
+constexpr size_t LATENCY_SUB_BUCKETS = size_t{1} << LATENCY_SUB_BITS;
+constexpr size_t LATENCY_BUCKETS = (40 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+inline size_t latency_bucket(uint64_t ticks) noexcept
+{
+    if ( ticks < LATENCY_SUB_BUCKETS )
+    {
+        return static_cast<size_t>(ticks);
+    }
+
+    int msb = 63;
+    while ( 0 == (ticks >> msb) )
+    {
+        --msb;
+    }
+    int const shift = msb - LATENCY_SUB_BITS;
+    size_t const bucket = (shift + 1) * LATENCY_SUB_BUCKETS + ((ticks >> shift) - LATENCY_SUB_BUCKETS);
+    return std::min(bucket, LATENCY_BUCKETS - 1);
+}
+
+// the middle of the values that fall in the bucket
+inline uint64_t latency_bucket_value(size_t bucket) noexcept
+{
+    if ( bucket < LATENCY_SUB_BUCKETS )
+    {
+        return bucket;
+    }
+
+    int const shift = static_cast<int>(bucket / LATENCY_SUB_BUCKETS) - 1;
+    uint64_t const lowest = (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t{1} << shift) >> 1);
+}
+
+// A copy of a latency histogram's counts, to read the percentiles off, or add up
+// the histograms of the shards
+struct LatencySnapshot
+{
+    std::vector<uint64_t> _counts = std::vector<uint64_t>(LATENCY_BUCKETS, 0);
+
+    uint64_t count() const noexcept
+    {
+        uint64_t total = 0;
+        for ( uint64_t const count : _counts )
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    // the latency at the fraction (0.99 for p99) of the samples, in ticks
+    uint64_t percentile(double fraction) const noexcept
+    {
+        uint64_t const total = count();
+        if ( 0 == total )
+        {
+            return 0;
+        }
+
+        uint64_t const rank = static_cast<uint64_t>(fraction * (total - 1));
+        uint64_t seen = 0;
+        for ( size_t bucket = 0; bucket < _counts.size(); ++bucket )
+        {
+            seen += _counts[bucket];
+            if ( seen > rank )
+            {
+                return latency_bucket_value(bucket);
+            }
+        }
+        return latency_bucket_value(_counts.size() - 1);
+    }
+
+    double percentile_ns(double fraction) const
+    {
+        return percentile(fraction) / ticks_per_ns();
+    }
+
+    LatencySnapshot& operator+= (const LatencySnapshot& other) noexcept
+    {
+        for ( size_t bucket = 0; bucket < _counts.size(); ++bucket )
+        {
+            _counts[bucket] += other._counts[bucket];
+        }
+        return *this;
+    }
+};
+
+// A latency histogram of relaxed atomic counts, recorded into by the sampled ops
+class LatencyHistogram
+{
+    std::atomic<uint64_t> _counts[LATENCY_BUCKETS] = {};
+
+  public:
+    void record(uint64_t ticks) noexcept
+    {
+        _counts[latency_bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    LatencySnapshot snapshot() const
+    {
+        LatencySnapshot copy;
+        for ( size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket )
+        {
+            copy._counts[bucket] = _counts[bucket].load(std::memory_order_relaxed);
+        }
+        return copy;
+    }
+};
+
+// What the trace hook is told of an op: whether a get hit, and the ticks it took
+// if it was sampled for the histograms, else 0
+struct CacheTraceEvent
+{
+    CacheOp _op;
+    bool _hit;
+    uint64_t _ticks;
+};
+
+// A user supplied tracing callback, called with the context it was set with, after
+// every op of an instrumented cache - from under the cache's (shard's) lock, so it
+// should be quick, and mustn't call back into the cache. The gets of a deferred
+// shard share its lock, so it may be called from several threads at once
+using CacheTraceHook = void (*)(void *context, const CacheTraceEvent& event) noexcept;
+
+// The latency instruments of a cache (of a shard, in a ConcurrentLRUCache), picked
+// by the Policy's instrument_type: one in SAMPLE_EVERY ops of each kind, counted
+// per thread, is timed into the op's histogram, and the trace hook, when set, is
+// told of every op
+template <unsigned SAMPLE_EVERY = 64>
+class CacheInstruments
+{
+    static_assert(0 < SAMPLE_EVERY, "CacheInstruments samples one in SAMPLE_EVERY ops");
+
+    LatencyHistogram _latencies[CACHE_OP_COUNT];
+    CacheTraceHook _hook{nullptr};
+    void *_context{nullptr};
+
+    // a countdown per thread, so the threads sharing a deferred shard's lock don't
+    // contend on it, nor on anything else until an op is sampled
+    static bool sampled(CacheOp op) noexcept
+    {
+        static thread_local unsigned countdown[CACHE_OP_COUNT] = {};
+        unsigned &left = countdown[static_cast<size_t>(op)];
+        if ( 0 == left )
+        {
+            left = SAMPLE_EVERY - 1;
+            return true;
+        }
+        --left;
+        return false;
+    }
+
+  public:
+    static constexpr bool ENABLED = true;
+
+    // returns the ticks the op starts at, or 0 if it isn't sampled
+    uint64_t begin(CacheOp op) noexcept
+    {
+        return sampled(op) ? read_ticks() : 0;
+    }
+
+    void end(CacheOp op, uint64_t start_ticks, bool hit) noexcept
+    {
+        uint64_t const ticks = ( 0 == start_ticks ) ? 0 : read_ticks() - start_ticks;
+        if ( 0 != start_ticks )
+        {
+            _latencies[static_cast<size_t>(op)].record(ticks);
+        }
+        if ( nullptr != _hook )
+        {
+            _hook(_context, CacheTraceEvent{op, hit, ticks});
+        }
+    }
+
+    // to be set before the cache is shared between threads, as it isn't synchronized
+    void set_trace_hook(CacheTraceHook hook, void *context) noexcept
+    {
+        _hook = hook;
+        _context = context;
+    }
+
+    LatencySnapshot latencies(CacheOp op) const
+    {
+        return _latencies[static_cast<size_t>(op)].snapshot();
+    }
+};
+
+// The default instrument_type, timing nothing and with no hooks, all inlined away
+struct NoCacheInstruments
+{
+    static constexpr bool ENABLED = false;
+
+    uint64_t begin(CacheOp) noexcept { return 0; }
+    void end(CacheOp, uint64_t, bool) noexcept { }
+    void set_trace_hook(CacheTraceHook, void*) noexcept { }
+
+    LatencySnapshot latencies(CacheOp) const
+    {
+        return LatencySnapshot{};
+    }
+};
+
+// Times an op of a cache from its start to the end of the scope, however it ends
+template <class Instruments>
+class InstrumentedScope
+{
+    Instruments &_instruments;
+    CacheOp const _op;
+    uint64_t const _start_ticks;
+    bool _hit{false};
+
+  public:
+    InstrumentedScope(Instruments &instruments, CacheOp op) noexcept
+     : _instruments(instruments), _op(op), _start_ticks(instruments.begin(op))
+    { }
+
+    InstrumentedScope(const InstrumentedScope&) = delete;
+    InstrumentedScope& operator=(const InstrumentedScope&) = delete;
+
+    ~InstrumentedScope()
+    {
+        _instruments.end(_op, _start_ticks, _hit);
+    }
+
+    void hit() noexcept
+    {
+        _hit = true;
+    }
+};
+
+// the Policy's instrument_type, if it has one, else NoCacheInstruments
+template <class Policy, class = void>
+struct policy_instruments
+{
+    using type = NoCacheInstruments;
+};
+
+template <class Policy>
+struct policy_instruments<Policy, std::void_t<typename Policy::instrument_type>>
+{
+    using type = typename Policy::instrument_type;
+};
+
+// The weight of an entry by the bytes of its key and value, as per entry_bytes
+struct EntryBytesWeigher
+{
+    template <class Key, class Value>
+    size_t operator() (const Key& key, const Value& value) const noexcept
+    {
+        return entry_bytes(key) + entry_bytes(value);
+    }
+};
+
+// The budget the total weight of the entries of a weighted LRUCache is kept under,
+// e.g. the bytes of RSS it may take with the EntryBytesWeigher
+struct WeightBudget
+{
+    size_t _weight;
+};
+
+// the Policy's weigher_type, if it has one, else void for no weighing at all
+template <class Policy, class = void>
+struct policy_weigher
+{
+    using type = void;
+};
+
+template <class Policy>
+struct policy_weigher<Policy, std::void_t<typename Policy::weigher_type>>
+{
+    using type = typename Policy::weigher_type;
+};
+
+// The ms clock the entries of an expiring LRUCache are timed by: CLOCK_MONOTONIC_COARSE,
+// read through the vDSO on Linux, so with no syscall and in a few ns, and as fine
+// as the kernel's tick (1 to 4 ms) - a steady_clock elsewhere
+struct CoarseClock
+{
+    uint64_t now_ms() const noexcept
+    {
+#if defined(CLOCK_MONOTONIC_COARSE)
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+};
+
+// the deadline of an entry put without a ttl
+constexpr uint64_t NEVER_EXPIRES = UINT64_MAX;
+
+// The value held in the Node of an expiring LRUCache, with its deadline alongside,
+// built in place from the args for the Value just like the Value itself
+template <class Value>
+struct ExpiringValue
+{
+    Value _value;
+    uint64_t _deadline{NEVER_EXPIRES}; // in the ms of the cache's clock_type
+
+    template <class... Args, class = typename std::enable_if<
+        !std::is_same<std::tuple<typename std::decay<Args>::type...>, std::tuple<ExpiringValue>>::value>::type>
+    ExpiringValue(Args&&... args) noexcept(std::is_nothrow_constructible<Value, Args&&...>::value)
+     : _value(std::forward<Args>(args)...)
+    { }
+};
+
+template <class Value>
+ostream& operator<< (ostream& os, const ExpiringValue<Value>& value)
+{
+    return os << value._value;
+}
+
+// The value held in the Node of a write-back LRUCache, with whether it's dirty (put
+// since it was last written back) alongside, as its place in the cache's array of
+// the dirty ones, or CLEAN. It's mutable, as it's the cache's own bookkeeping,
+// cleared as the entry is written back from a const Node
+template <class Value>
+struct DirtyValue
+{
+    static constexpr uint32_t CLEAN = UINT32_MAX;
+
+    Value _value;
+    mutable uint32_t _dirty_at{CLEAN};
+
+    bool dirty() const noexcept
+    {
+        return CLEAN != _dirty_at;
+    }
+
+    template <class... Args, class = typename std::enable_if<
+        !std::is_same<std::tuple<typename std::decay<Args>::type...>, std::tuple<DirtyValue>>::value>::type>
+    DirtyValue(Args&&... args) noexcept(std::is_nothrow_constructible<Value, Args&&...>::value)
+     : _value(std::forward<Args>(args)...)
+    { }
+};
+
+template <class Value>
+ostream& operator<< (ostream& os, const DirtyValue<Value>& value)
+{
+    return os << value._value;
+}
+
+// the Policy's clock_type, if it has one, else void for no expiry at all
+template <class Policy, class = void>
+struct policy_clock
+{
+    using type = void;
+};
+
+template <class Policy>
+struct policy_clock<Policy, std::void_t<typename Policy::clock_type>>
+{
+    using type = typename Policy::clock_type;
+};
+
+// the Region the Policy's region_type has the map's slots carved out of, if it has
+// one, else the HeapRegion
+template <class Policy, class = void>
+struct policy_region
+{
+    using type = HeapRegion;
+};
+
+template <class Policy>
+struct policy_region<Policy, std::void_t<typename Policy::region_type>>
+{
+    using type = typename Policy::region_type;
+};
+
+// the hash index the Policy's index_type has the map built on, if it has one, else
+// the FlatHashIndex
+template <class Policy, class Key, class Handle, class Hash, class Region, class = void>
+struct policy_index
+{
+    using type = FlatHashIndex<Key, Handle, Hash, Region>;
+};
+
+template <class Policy, class Key, class Handle, class Hash, class Region>
+struct policy_index<Policy, Key, Handle, Hash, Region,
+                    std::void_t<typename Policy::template index_type<Key, Handle, Hash, Region>>>
+{
+    using type = typename Policy::template index_type<Key, Handle, Hash, Region>;
+};
+
+// the Policy's stats_type, if it has one, else NoCacheCounters
+template <class Policy, class = void>
+struct policy_stats
+{
+    using type = NoCacheCounters;
+};
+
+template <class Policy>
+struct policy_stats<Policy, std::void_t<typename Policy::stats_type>>
+{
+    using type = typename Policy::stats_type;
+};
+
+// Eviction policies for the LRUCache, each picking the storage engine for the recency
+// list of the cache's Key and Value (see the Storage Engines at the top of the file)
+struct LinkedLRUPolicy // the LRUTwoWayList, with its Nodes carved out of one slab
+{
+    template <class Key, class Value>
+    using list_type = LRUTwoWayList<Key, Value, SlabNodeAllocator>;
+};
+
+struct HeapLinkedLRUPolicy // the LRUTwoWayList, with one new per Node
+{
+    template <class Key, class Value>
+    using list_type = LRUTwoWayList<Key, Value, HeapNodeAllocator>;
+};
+
+struct HugePageLRUPolicy // the LRUTwoWayList, with its slab and the map off the heap in huge pages
+{
+    template <class Key, class Value>
+    using list_type = LRUTwoWayList<Key, Value, HugePageNodeAllocator>;
+    using region_type = HugePageRegion;
+};
+
+struct IndexedLRUPolicy // the IndexedTwoWayList, linked by 32-bit slots
+{
+    template <class Key, class Value>
+    using list_type = IndexedTwoWayList<Key, Value>;
+};
+
+struct ClockPolicy // the ClockList, approximate LRU
+{
+    template <class Key, class Value>
+    using list_type = ClockList<Key, Value>;
+};
+
+struct SegmentedLRUPolicy // the SegmentedLRUList, scan resistant, 80% of it protected
+{
+    template <class Key, class Value>
+    using list_type = SegmentedLRUList<Key, Value, SlabNodeAllocator>;
+};
+
+struct WindowTinyLFUPolicy // the WindowTinyLFUList, frequency aware admission
+{
+    template <class Key, class Value>
+    using list_type = WindowTinyLFUList<Key, Value, SlabNodeAllocator>;
+};
+
+// Any of the policies above, with the cache's stats() counted, as in
+// LRUCache<int, int, std::hash<int>, CountedPolicy<LinkedLRUPolicy>>
+template <class Policy>
+struct CountedPolicy : Policy
+{
+    using stats_type = CacheCounters;
+};
+
+// Any of the policies above, with the latencies of one in SAMPLE_EVERY ops timed,
+// and a trace hook to be set, as in InstrumentedPolicy<CountedPolicy<ClockPolicy>>
+template <class Policy, unsigned SAMPLE_EVERY = 64>
+struct InstrumentedPolicy : Policy
+{
+    using instrument_type = CacheInstruments<SAMPLE_EVERY>;
+};
+
+// Any of the policies above, with each entry weighed by the Weigher and the cache
+// kept under a WeightBudget as well as the capacity no. of entries, as in
+// LRUCache<int, std::string, std::hash<int>, WeightedPolicy<LinkedLRUPolicy>>(100000, WeightBudget{1 << 26})
+template <class Policy, class Weigher = EntryBytesWeigher>
+struct WeightedPolicy : Policy
+{
+    using weigher_type = Weigher;
+};
+
+// Any of the policies above, with the entries that are put with a ttl expiring by
+// the Clock (see LRUCache::put(key, value, ttl)), as in ExpiringPolicy<ClockPolicy>
+template <class Policy, class Clock = CoarseClock>
+struct ExpiringPolicy : Policy
+{
+    using clock_type = Clock;
+};
+
+// Any of the policies above, with the map a TagHashIndex, probed a TagGroup of tags at
+// a time, in place of the FlatHashIndex, as in TagProbedPolicy<LinkedLRUPolicy>
+template <class Policy>
+struct TagProbedPolicy : Policy
+{
+    template <class Key, class Handle, class Hash, class Region>
+    using index_type = TagHashIndex<Key, Handle, Hash, Region>;
+};
+
+// How a MappedFile is going to be read, for the kernel's read ahead
+enum class FileAccess
+{
+    Sequential, // front to back, once
+    Whole       // all of it, in any order, so it's all read ahead
+};
+
+// A file's contents read only, memory mapped where there's mmap, so a big file is
+// paged in as it's read instead of being copied in upfront, else read into memory
+class MappedFile
+{
+    const unsigned char *_begin{nullptr};
+    const unsigned char *_end{nullptr};
+#ifdef LRUCACHE_HAS_MMAP
+    void *_mapped{nullptr};
+    size_t _mapped_size{0};
+#else
+    std::vector<unsigned char> _contents;
+#endif
+
+  public:
+    MappedFile(const std::string& path, FileAccess access, const char *user)
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        int const fd = ::open(path.c_str(), O_RDONLY);
+        if ( 0 > fd )
+        {
+            throw std::runtime_error(std::string(user) + ": can't open " + path);
+        }
+
+        struct stat status;
+        if ( 0 != ::fstat(fd, &status) )
+        {
+            ::close(fd);
+            throw std::runtime_error(std::string(user) + ": can't stat " + path);
+        }
+
+        _mapped_size = static_cast<size_t>(status.st_size);
+        if ( 0 < _mapped_size )
+        {
+            _mapped = ::mmap(nullptr, _mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd); // the mapping stays valid without the descriptor
+
+        if ( MAP_FAILED == _mapped )
+        {
+            _mapped = nullptr;
+            throw std::runtime_error(std::string(user) + ": can't map " + path);
+        }
+        if ( nullptr != _mapped )
+        {
+            ::madvise(_mapped, _mapped_size, ( FileAccess::Sequential == access ) ? MADV_SEQUENTIAL : MADV_WILLNEED);
+        }
+        _begin = static_cast<const unsigned char*>(_mapped);
+        _end = _begin + _mapped_size;
+#else
+        (void)access;
+        std::ifstream file(path, std::ios::binary);
+        if ( !file )
+        {
+            throw std::runtime_error(std::string(user) + ": can't open " + path);
+        }
+        _contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        _begin = _contents.data();
+        _end = _begin + _contents.size();
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        if ( nullptr != _mapped )
+        {
+            ::munmap(_mapped, _mapped_size);
+        }
+#endif
+    }
+
+    const unsigned char* begin() const noexcept
+    {
+        return _begin;
+    }
+
+    const unsigned char* end() const noexcept
+    {
+        return _end;
+    }
+
+    size_t size() const noexcept
+    {
+        return static_cast<size_t>(_end - _begin);
+    }
+};
+
+// The varints of the snapshot files, 7 bits a byte, low bits first
+inline void write_varint(std::vector<char>& out, uint64_t value)
+{
+    for ( ; value >= 0x80; value >>= 7 )
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Reads a varint at, and moves at past it, returns false if it runs past the end
+inline bool read_varint(const unsigned char *&at, const unsigned char *end, uint64_t &value) noexcept
+{
+    value = 0;
+    for ( int shift = 0; at != end && shift < 64; shift += 7 )
+    {
+        uint8_t const byte = *at++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ( 0 == (byte & 0x80) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The encoding of a key or a value in a snapshot, as with entry_bytes: a trivially
+// copyable one as its bytes, a string or a vector (of trivially copyable elements)
+// as the varint no. of its elements, then their bytes. The key and value types of
+// other caches to be snapshot can overload both, restore_snapshot_field returning
+// false for a field running past the end
+template <class T>
+void save_snapshot_field(std::vector<char>& out, const T& t)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "overload save_snapshot_field for the type");
+    char const *const bytes = reinterpret_cast<const char*>(&t);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <class T>
+bool restore_snapshot_field(const unsigned char *&at, const unsigned char *end, T &t) noexcept
+{
+    static_assert(std::is_trivially_copyable<T>::value, "overload restore_snapshot_field for the type");
+    if ( static_cast<size_t>(end - at) < sizeof(T) )
+    {
+        return false;
+    }
+    std::memcpy(static_cast<void*>(&t), at, sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+template <class Char, class Traits, class Allocator>
+void save_snapshot_field(std::vector<char>& out, const std::basic_string<Char, Traits, Allocator>& t)
+{
+    write_varint(out, t.size());
+    char const *const bytes = reinterpret_cast<const char*>(t.data());
+    out.insert(out.end(), bytes, bytes + t.size() * sizeof(Char));
+}
+
+template <class Char, class Traits, class Allocator>
+bool restore_snapshot_field(const unsigned char *&at, const unsigned char *end,
+                            std::basic_string<Char, Traits, Allocator> &t)
+{
+    uint64_t size = 0;
+    if ( !read_varint(at, end, size) || (static_cast<size_t>(end - at) / sizeof(Char) < size) )
+    {
+        return false;
+    }
+    t.resize(static_cast<size_t>(size));
+    std::memcpy(&t[0], at, t.size() * sizeof(Char));
+    at += t.size() * sizeof(Char);
+    return true;
+}
+
+template <class T, class Allocator>
+void save_snapshot_field(std::vector<char>& out, const std::vector<T, Allocator>& t)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "overload save_snapshot_field for the element type");
+    write_varint(out, t.size());
+    char const *const bytes = reinterpret_cast<const char*>(t.data());
+    out.insert(out.end(), bytes, bytes + t.size() * sizeof(T));
+}
+
+template <class T, class Allocator>
+bool restore_snapshot_field(const unsigned char *&at, const unsigned char *end, std::vector<T, Allocator> &t)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "overload restore_snapshot_field for the element type");
+    uint64_t size = 0;
+    if ( !read_varint(at, end, size) || (static_cast<size_t>(end - at) / sizeof(T) < size) )
+    {
+        return false;
+    }
+    t.resize(static_cast<size_t>(size));
+    std::memcpy(static_cast<void*>(t.data()), at, t.size() * sizeof(T));
+    at += t.size() * sizeof(T);
+    return true;
+}
+
+// The snapshot file format: SNAPSHOT_MAGIC, then an entry after the other from the
+// MRU to the LRU one, each as the varint of its length in bytes, so a reader can
+// hop from one entry to the next without decoding them, then its key and its value
+// (see save_snapshot_field), and the varint of the ms it had left to live, plus 1,
+// or 0 for the ones that never expire
+constexpr char SNAPSHOT_MAGIC[] = { 'L', 'R', 'U', 'S', 1 };
+
+// A run of the entries of a snapshot encoded in memory, in the file's format, for
+// a SnapshotWriter to write out later, so they can be taken from a cache under its
+// lock and be written once that's been let go (see ConcurrentLRUCache::checkpoint)
+class SnapshotBlock
+{
+    std::vector<char> _bytes;
+    std::vector<char> _entry;
+    size_t _entries{0};
+
+  public:
+    // Adds the next entry, ttl_ms being the ms it has left, or NEVER_EXPIRES
+    template <class Key, class Value>
+    void add(const Key& key, const Value& value, uint64_t ttl_ms)
+    {
+        _entry.clear();
+        save_snapshot_field(_entry, key);
+        save_snapshot_field(_entry, value);
+        write_varint(_entry, ( NEVER_EXPIRES == ttl_ms ) ? 0 : ttl_ms + 1);
+
+        write_varint(_bytes, _entry.size());
+        _bytes.insert(_bytes.end(), _entry.begin(), _entry.end());
+        ++_entries;
+    }
+
+    // Adds the entries of another block, after the ones added so far
+    void add(const SnapshotBlock& block)
+    {
+        _bytes.insert(_bytes.end(), block._bytes.begin(), block._bytes.end());
+        _entries += block._entries;
+    }
+
+    const char* data() const noexcept
+    {
+        return _bytes.data();
+    }
+
+    size_t size() const noexcept
+    {
+        return _bytes.size();
+    }
+
+    size_t entries() const noexcept
+    {
+        return _entries;
+    }
+
+    // empties the block, but keeps its memory for the next run
+    void clear() noexcept
+    {
+        _bytes.clear();
+        _entries = 0;
+    }
+};
+
+// Flushes the file (or directory) at the path through to the disk, where there's
+// fsync, and returns whether it could. Elsewhere, it's up to the OS when it's written
+inline bool sync_to_disk(const std::string& path) noexcept
+{
+#ifdef LRUCACHE_HAS_MMAP
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if ( 0 > fd )
+    {
+        return false;
+    }
+    bool const synced = ( 0 == ::fsync(fd) );
+    ::close(fd);
+    return synced;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+// Writes the entries of a snapshot, buffered in memory and written out in blocks, to
+// a temporary file next to the path that commit() then syncs to the disk and renames
+// over the path, so a snapshot taken over the last one (or one cut short by a crash)
+// never leaves it torn - a crash leaves the last snapshot or the new one, whole
+// The writes can be paced to a rate of bytes per second, so that a snapshot taken
+// in the background doesn't starve the IO of the rest of the process
+class SnapshotWriter
+{
+    std::string _path;
+    std::string _temporary_path;
+    std::ofstream _file;
+    SnapshotBlock _buffer;
+    size_t _entries{0};
+    size_t _bytes_per_second;
+    size_t _written{0};
+    std::chrono::steady_clock::time_point _started;
+
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+  public:
+    explicit SnapshotWriter(const std::string& path, size_t bytes_per_second = SIZE_MAX)
+     : _path(path), _temporary_path(path + ".tmp"),
+       _file(_temporary_path, std::ios::binary | std::ios::trunc),
+       _bytes_per_second(std::max<size_t>(1, bytes_per_second)),
+       _started(std::chrono::steady_clock::now())
+    {
+        if ( !_file )
+        {
+            throw std::runtime_error("SnapshotWriter: can't open " + _temporary_path);
+        }
+        write_out(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // a writer not committed leaves the last snapshot as it was
+    ~SnapshotWriter()
+    {
+        if ( _file.is_open() )
+        {
+            _file.close();
+            std::error_code ignored;
+            std::filesystem::remove(_temporary_path, ignored);
+        }
+    }
+
+    // Adds the next entry, ttl_ms being the ms it has left, or NEVER_EXPIRES
+    template <class Key, class Value>
+    void add(const Key& key, const Value& value, uint64_t ttl_ms)
+    {
+        _buffer.add(key, value, ttl_ms);
+        if ( _buffer.size() >= BLOCK_SIZE )
+        {
+            flush();
+        }
+    }
+
+    // Adds the entries of a block, after the ones added so far
+    void add(const SnapshotBlock& block)
+    {
+        flush();
+        write_out(block.data(), block.size());
+        _entries += block.entries();
+    }
+
+    size_t entries() const noexcept
+    {
+        return _entries + _buffer.entries();
+    }
+
+    // Writes out the rest, and puts the snapshot in place of the last one at the path
+    void commit()
+    {
+        flush();
+        _file.close();
+        if ( !_file || !sync_to_disk(_temporary_path) ) // the contents are on disk before the rename
+        {
+            throw std::runtime_error("SnapshotWriter: can't write " + _temporary_path);
+        }
+        std::filesystem::rename(_temporary_path, _path);
+
+        // and the rename too, as far as the directory can be synced at all
+        std::filesystem::path const directory = std::filesystem::absolute(_path).parent_path();
+        sync_to_disk(directory.string());
+    }
+
+  private:
+    void flush()
+    {
+        write_out(_buffer.data(), _buffer.size());
+        _entries += _buffer.entries();
+        _buffer.clear();
+    }
+
+    // writes BLOCK_SIZE bytes at a time, each one no sooner than the pace allows
+    void write_out(const char *bytes, size_t size)
+    {
+        for ( size_t offset = 0; offset < size; offset += BLOCK_SIZE )
+        {
+            size_t const length = std::min(BLOCK_SIZE, size - offset);
+            if ( SIZE_MAX != _bytes_per_second )
+            {
+                std::this_thread::sleep_until(_started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(static_cast<double>(_written) / _bytes_per_second)));
+            }
+
+            _file.write(bytes + offset, static_cast<std::streamsize>(length));
+            _written += length;
+            if ( !_file )
+            {
+                throw std::runtime_error("SnapshotWriter: can't write " + _temporary_path);
+            }
+        }
+    }
+};
+
+// Reads a snapshot file back memory mapped: one pass over the file upfront, hopping
+// over the entries by their lengths, finds where each one starts, so they can be
+// decoded in any order - the caches load them LRU first, adding each at the front
+class SnapshotReader
+{
+    MappedFile _file;
+    std::vector<const unsigned char*> _entries; // where each one starts, at its length
+
+  public:
+    explicit SnapshotReader(const std::string& path)
+     : _file(path, FileAccess::Whole, "SnapshotReader")
+    {
+        const unsigned char *at = _file.begin();
+        if ( (_file.size() < sizeof(SNAPSHOT_MAGIC)) || (0 != std::memcmp(at, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))) )
+        {
+            throw std::runtime_error("SnapshotReader: not a snapshot file " + path);
+        }
+        at += sizeof(SNAPSHOT_MAGIC);
+
+        while ( at != _file.end() )
+        {
+            _entries.push_back(at);
+            uint64_t length = 0;
+            if ( !read_varint(at, _file.end(), length) || (static_cast<size_t>(_file.end() - at) < length) )
+            {
+                throw std::runtime_error("SnapshotReader: snapshot cut short " + path);
+            }
+            at += length;
+        }
+    }
+
+    // the no. of entries, from the MRU one at 0
+    size_t size() const noexcept
+    {
+        return _entries.size();
+    }
+
+    // Decodes the i-th entry, with ttl_ms being the ms it had left, or NEVER_EXPIRES
+    template <class Key, class Value>
+    void read(size_t i, Key &key, Value &value, uint64_t &ttl_ms) const
+    {
+        const unsigned char *at = _entries[i];
+        uint64_t length = 0;
+        read_varint(at, _file.end(), length); // checked by the constructor
+        const unsigned char *const end = at + length;
+        uint64_t ttl = 0;
+        if ( !restore_snapshot_field(at, end, key) || !restore_snapshot_field(at, end, value) ||
+             !read_varint(at, end, ttl) || (at != end) )
+        {
+            throw std::runtime_error("SnapshotReader: malformed entry in the snapshot");
+        }
+        ttl_ms = ( 0 == ttl ) ? NEVER_EXPIRES : ttl - 1;
+    }
+};
+
+// The counts of a FlashTier: the entries demoted to it and the ones dropped instead,
+// and the lookups that found their key there (hits) or didn't (misses)
+struct FlashTierStats
+{
+    uint64_t _demoted{0};
+    uint64_t _dropped{0}; // with the writer too far behind, or too big for a segment
+    uint64_t _hits{0};
+    uint64_t _misses{0};
+    uint64_t _written_bytes{0};
+    size_t _entries{0}; // held, as of the index
+};
+
+inline ostream& operator<< (ostream& os, const FlashTierStats& stats)
+{
+    os << "{demoted=" << stats._demoted << ", dropped=" << stats._dropped << ", hits=" << stats._hits;
+    os << ", misses=" << stats._misses << ", written_bytes=" << stats._written_bytes;
+    return os << ", entries=" << stats._entries << "}";
+}
+
+// A log structured tier on flash, behind a cache of a TieredPolicy: the entries the
+// cache evicts are demoted to it instead of being dropped, and a get that misses in
+// memory takes the key's entry back from it, if it still has it
+// It's one file, a ring of segments of segment_bytes each. A demoted entry is added
+// to the active segment in memory (in the snapshot file's encoding, its deadline in
+// place of the ttl), which once full is sealed, and written out in one pwrite by the
+// tier's writer thread, so a put never waits on the IO. With the ring full, the
+// segment written the longest ago is reclaimed first, dropping its entries (FIFO),
+// so the flash only ever takes large sequential writes
+// The index is in memory, from each key to its entry's segment and offset, so that
+// a lookup costs one pread of the entry's bytes at most (none while its segment is
+// still in memory), done without the tier's own lock held - but with whatever lock
+// its caller holds, which for a ConcurrentLRUCache is the lock of the key's shard
+// It's thread safe, so the shards of a ConcurrentLRUCache share the one tier
+template <class Key, class Value, class Hash = std::hash<Key>>
+class FlashTier
+{
+    // where an entry is, in the segment of the sequence no. (which counts on from 0),
+    // and the cache it was demoted by, for that cache's clear to drop
+    struct Location
+    {
+        uint64_t _segment;
+        uint32_t _offset;
+        uint32_t _length;
+        const void *_owner;
+    };
+
+    struct Segment
+    {
+        uint64_t _sequence;
+        SnapshotBlock _entries; // until written out
+        std::vector<Key> _keys; // of its entries, to drop from the index when it's reclaimed
+        bool _written{false};
+    };
+
+    std::string _path;
+    size_t _segment_bytes;
+    size_t _segment_count;
+#ifdef LRUCACHE_HAS_MMAP
+    int _fd{-1};
+#else
+    std::fstream _file;
+    std::mutex _file_lock; // for its seek and read or write
+#endif
+    mutable std::mutex _lock;
+    std::condition_variable _sealed; // wakes the writer to a sealed segment, or to stop
+    std::condition_variable _written_out; // wakes the flush to a segment written
+    // the live segments, the oldest first and the active one at the back
+    std::deque<Segment> _segments;
+    std::unordered_map<Key, Location, Hash> _index;
+    uint64_t _next_to_write{0}; // the sequence no. of the next segment to write out
+    SnapshotBlock _entry; // a demoted entry, encoded ahead of its add to the active segment
+    SnapshotBlock _spare; // the memory of the last segment written, for the next one
+    FlashTierStats _stats;
+    bool _stopping{false};
+    std::thread _writer;
+
+    // no. of sealed segments the writer can be behind by, after which the demoted
+    // entries are dropped, so that the memory they take stays bounded
+    static constexpr size_t MAX_UNWRITTEN = 4;
+
+    uint64_t file_offset(uint64_t sequence) const noexcept
+    {
+        return (sequence % _segment_count) * _segment_bytes;
+    }
+
+    Segment& segment(uint64_t sequence) noexcept
+    {
+        return _segments[static_cast<size_t>(sequence - _segments.front()._sequence)];
+    }
+
+    // drops the segment's entries from the index, unless a key's been demoted again since
+    void unindex(Segment &dropped) noexcept
+    {
+        for ( const Key &key : dropped._keys )
+        {
+            auto const found = _index.find(key);
+            if ( (found != _index.end()) && (found->second._segment == dropped._sequence) )
+            {
+                _index.erase(found);
+            }
+        }
+        dropped._keys.clear();
+    }
+
+    // Seals the active segment for the writer and starts the next one, reclaiming the
+    // oldest segment first when the ring is full, unless the writer is too far behind
+    bool seal()
+    {
+        if ( _segments.back()._sequence - _next_to_write >= MAX_UNWRITTEN )
+        {
+            return false;
+        }
+        if ( _segments.size() == _segment_count )
+        {
+            if ( !_segments.front()._written ) // the ring's lapped the writer
+            {
+                return false;
+            }
+            unindex(_segments.front());
+            _segments.pop_front();
+        }
+
+        _segments.push_back(Segment{_segments.back()._sequence + 1, std::move(_spare), {}});
+        _spare = SnapshotBlock();
+        _sealed.notify_one();
+        return true;
+    }
+
+    // The writer thread: writes each sealed segment out, at its place in the ring,
+    // with the lock let go. A segment being written can't be reclaimed (nor moved, as
+    // it's in a deque), and is never added to, so it's read as it's written
+    void write_sealed() noexcept
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        for ( ;; )
+        {
+            _sealed.wait(guard, [this]() { return _stopping || (_next_to_write < _segments.back()._sequence); });
+            if ( _stopping )
+            {
+                return;
+            }
+
+            Segment &written = segment(_next_to_write);
+            guard.unlock();
+            bool const ok = write_at(written._entries.data(), written._entries.size(), file_offset(written._sequence));
+            guard.lock();
+
+            if ( ok )
+            {
+                _stats._written_bytes += written._entries.size();
+            }
+            else // its entries are lost, as if reclaimed
+            {
+                unindex(written);
+            }
+            written._written = true;
+            _spare = std::move(written._entries);
+            _spare.clear();
+            written._entries = SnapshotBlock();
+            ++_next_to_write;
+            _written_out.notify_all();
+        }
+    }
+
+    bool write_at(const char *bytes, size_t size, uint64_t offset) noexcept
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        while ( 0 < size )
+        {
+            ssize_t const written = ::pwrite(_fd, bytes, size, static_cast<off_t>(offset));
+            if ( 0 > written )
+            {
+                if ( EINTR == errno )
+                {
+                    continue;
+                }
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+        return true;
+#else
+        std::lock_guard<std::mutex> guard(_file_lock);
+        _file.clear();
+        _file.seekp(static_cast<std::streamoff>(offset));
+        _file.write(bytes, static_cast<std::streamsize>(size));
+        return static_cast<bool>(_file);
+#endif
+    }
+
+    bool read_at(char *bytes, size_t size, uint64_t offset) noexcept
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        while ( 0 < size )
+        {
+            ssize_t const read = ::pread(_fd, bytes, size, static_cast<off_t>(offset));
+            if ( 0 >= read )
+            {
+                if ( (0 > read) && (EINTR == errno) )
+                {
+                    continue;
+                }
+                return false;
+            }
+            bytes += read;
+            size -= static_cast<size_t>(read);
+            offset += static_cast<uint64_t>(read);
+        }
+        return true;
+#else
+        std::lock_guard<std::mutex> guard(_file_lock);
+        _file.clear();
+        _file.seekg(static_cast<std::streamoff>(offset));
+        _file.read(bytes, static_cast<std::streamsize>(size));
+        return static_cast<bool>(_file);
+#endif
+    }
+
+    // decodes an entry, the one of the key only
+    static bool decode(const char *bytes, size_t size, const Key& key, Value &value, uint64_t &deadline)
+    {
+        const unsigned char *at = reinterpret_cast<const unsigned char*>(bytes);
+        const unsigned char *const end = at + size;
+        uint64_t length = 0;
+        uint64_t stored = 0;
+        Key stored_key;
+        if ( !read_varint(at, end, length) || (static_cast<size_t>(end - at) != length) ||
+             !restore_snapshot_field(at, end, stored_key) || !(stored_key == key) ||
+             !restore_snapshot_field(at, end, value) || !read_varint(at, end, stored) || (at != end) )
+        {
+            return false;
+        }
+        deadline = ( 0 == stored ) ? NEVER_EXPIRES : stored - 1;
+        return true;
+    }
+
+  public:
+    // A tier of up to bytes of flash (two segments at least) in the file at the path,
+    // which is made anew, and removed again with the tier, as the index of what's in it
+    // is only ever in memory. A segment can be up to 4GB, and is best a few MB
+    FlashTier(const std::string& path, size_t bytes, size_t segment_bytes = size_t{4} << 20, const Hash& hash = Hash())
+     : _path(path),
+       _segment_bytes(std::min<size_t>(std::max<size_t>(segment_bytes, 4096), UINT32_MAX)),
+       _segment_count(std::max<size_t>(2, bytes / _segment_bytes)),
+       _index(0, hash)
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if ( 0 > _fd )
+        {
+            throw std::runtime_error("FlashTier: can't open " + path);
+        }
+#else
+        _file.open(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        if ( !_file )
+        {
+            throw std::runtime_error("FlashTier: can't open " + path);
+        }
+#endif
+        try
+        {
+            _segments.push_back(Segment{0, SnapshotBlock(), {}});
+            _writer = std::thread(&FlashTier::write_sealed, this);
+        }
+        catch ( ... )
+        {
+            remove_file();
+            throw;
+        }
+    }
+
+    FlashTier(const FlashTier&) = delete;
+    FlashTier& operator=(const FlashTier&) = delete;
+
+    // the sealed segments not written out yet are let go, as is the file
+    ~FlashTier()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _sealed.notify_one();
+        _writer.join();
+        remove_file();
+    }
+
+    // Adds the entry to the active segment, to be written out with it, and points the
+    // key at it in the index, over any older entry of the key. An entry is dropped
+    // instead when the writer is too far behind, or it's bigger than a segment, or
+    // there's no memory for it - a demotion never throws
+    // The deadline is in the ms of the cache's clock_type, or NEVER_EXPIRES, and the
+    // owner is the cache demoting it, if any (see clear)
+    void demote(const Key& key, const Value& value, uint64_t deadline, const void *owner = nullptr) noexcept
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        try
+        {
+            _entry.clear();
+            _entry.add(key, value, deadline);
+            if ( (_entry.size() > _segment_bytes) ||
+                 ((_segments.back()._entries.size() + _entry.size() > _segment_bytes) && !seal()) )
+            {
+                ++_stats._dropped;
+                return;
+            }
+
+            Segment &active = _segments.back();
+            Location const location{active._sequence, static_cast<uint32_t>(active._entries.size()),
+                                    static_cast<uint32_t>(_entry.size()), owner};
+            active._entries.add(_entry);
+            active._keys.push_back(key);
+            _index.insert_or_assign(key, location);
+            ++_stats._demoted;
+        }
+        catch ( ... )
+        {
+            ++_stats._dropped;
+        }
+    }
+
+    // Takes the key's entry out of the tier into value and deadline, if it has it,
+    // dropping it from the index, as the cache it's promoted to holds it from then on
+    // An entry on flash is read with the lock let go, by its Location, which is still
+    // the key's if the key's not been demoted again nor its segment reclaimed (and
+    // so written over) by the time it's been read
+    bool take(const Key& key, Value &value, uint64_t &deadline)
+    {
+        Location location;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            auto const found = _index.find(key);
+            if ( found == _index.end() )
+            {
+                ++_stats._misses;
+                return false;
+            }
+
+            location = found->second;
+            Segment &held = segment(location._segment);
+            if ( !held._written )
+            {
+                _index.erase(found);
+                bool const decoded = decode(held._entries.data() + location._offset, location._length, key, value, deadline);
+                ++( decoded ? _stats._hits : _stats._misses );
+                return decoded;
+            }
+        }
+
+        std::vector<char> bytes(location._length);
+        bool decoded = read_at(bytes.data(), bytes.size(), file_offset(location._segment) + location._offset) &&
+                       decode(bytes.data(), bytes.size(), key, value, deadline);
+
+        std::lock_guard<std::mutex> guard(_lock);
+        auto const found = _index.find(key);
+        bool const current = ( found != _index.end() ) && ( found->second._segment == location._segment ) &&
+                             ( found->second._offset == location._offset );
+        if ( current )
+        {
+            _index.erase(found);
+        }
+        decoded = decoded && current;
+        ++( decoded ? _stats._hits : _stats._misses );
+        return decoded;
+    }
+
+    // Drops all of the entries, of all the caches sharing the tier, what's written of
+    // them staying on flash, unindexed, until written over
+    void clear() noexcept
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _index.clear();
+        for ( Segment &live : _segments )
+        {
+            live._keys.clear();
+        }
+    }
+
+    // Drops the entries the owner demoted only, leaving those of the other caches that
+    // share the tier, as a cache's clear does with its own (see LRUCache::clear)
+    void clear(const void *owner) noexcept
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for ( auto entry = _index.begin(); entry != _index.end(); )
+        {
+            entry = ( owner == entry->second._owner ) ? _index.erase(entry) : std::next(entry);
+        }
+    }
+
+    // Waits for the writer to write out all of the sealed segments
+    void flush()
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        _written_out.wait(guard, [this]() { return _next_to_write == _segments.back()._sequence; });
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _index.size();
+    }
+
+    size_t segment_count() const noexcept
+    {
+        return _segment_count;
+    }
+
+    FlashTierStats stats() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        FlashTierStats stats = _stats;
+        stats._entries = _index.size();
+        return stats;
+    }
+
+  private:
+    void remove_file() noexcept
+    {
+#ifdef LRUCACHE_HAS_MMAP
+        ::close(_fd);
+#else
+        _file.close();
+#endif
+        std::error_code ignored;
+        std::filesystem::remove(_path, ignored);
+    }
+};
+
+// the stand in for the tier of a cache that has none
+struct NoFlashTier { };
+
+// the tier the Policy's tier_type has the cache's evicted entries demoted to, if it
+// has one, else NoFlashTier
+template <class Policy, class Key, class Value, class Hash, class = void>
+struct policy_tier
+{
+    using type = NoFlashTier;
+};
+
+template <class Policy, class Key, class Value, class Hash>
+struct policy_tier<Policy, Key, Value, Hash, std::void_t<typename Policy::template tier_type<Key, Value, Hash>>>
+{
+    using type = typename Policy::template tier_type<Key, Value, Hash>;
+};
+
+// Any of the policies above, with the entries the cache evicts demoted to a FlashTier
+// given to its constructor, and the gets that miss in memory looking there next, as in
+// LRUCache<int, std::string, std::hash<int>, TieredPolicy<LinkedLRUPolicy>>(100000, tier)
+template <class Policy>
+struct TieredPolicy : Policy
+{
+    template <class Key, class Value, class Hash>
+    using tier_type = FlashTier<Key, Value, Hash>;
+};
+
+// Why an entry left a cache, as its eviction listener is told
+enum class EvictionCause
+{
+    Evicted, // to make room, for the capacity or the weight budget
+    Expired  // past its deadline
+};
+
+// An entry a cache's let go of, handed on to the listener of its EvictionQueue
+template <class Key, class Value>
+struct EvictedEntry
+{
+    Key _key;
+    Value _value;
+    EvictionCause _cause;
+};
+
+// The queue the caches of a NotifyingPolicy put the entries they evict (or expire)
+// on, for its listener to be called with on a thread of the queue's own, in batches
+// of up to max_batch - so that whatever's done with them, like releasing what they
+// hold or writing them back, is done off the puts and out of the cache's lock
+// It's a bounded lock free queue (Vyukov's ring, with the one consumer), so the
+// shards of a ConcurrentLRUCache put on it at once, with no lock of its own. A put
+// costs a copy of the entry and a CAS, and an entry that finds it full is dropped,
+// and counted, rather than the put waiting on the listener. The listener may move
+// from the entries of the batch it's called with
+template <class Key, class Value>
+class EvictionQueue
+{
+  public:
+    using entry_type = EvictedEntry<Key, Value>;
+    using listener_type = std::function<void(std::vector<entry_type>& batch)>;
+
+  private:
+    static_assert(std::is_nothrow_move_constructible<entry_type>::value,
+                  "EvictionQueue moves the entries into its cells and out, which must not throw");
+
+    // a cell a cache line at least, so that the producers don't share them
+    struct alignas(CACHE_LINE_SIZE) Cell
+    {
+        // the position it's up for next, +1 once the entry of its position is in
+        std::atomic<size_t> _sequence;
+        alignas(entry_type) unsigned char _entry[sizeof(entry_type)];
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail{0}; // the position of the next put
+    alignas(CACHE_LINE_SIZE) size_t _head{0}; // the position of the next take, the consumer's only
+    std::atomic<uint64_t> _delivered{0};
+    std::atomic<uint64_t> _dropped{0};
+    listener_type _listener;
+    size_t _max_batch;
+    std::chrono::microseconds _idle; // the consumer's nap when it finds the queue empty
+    std::atomic<bool> _stopping{false};
+    std::thread _consumer;
+
+    // moves the entry at the head into the batch, if it's been put yet
+    bool take(std::vector<entry_type> &batch) noexcept
+    {
+        Cell &cell = _cells[_head & _mask];
+        if ( cell._sequence.load(std::memory_order_acquire) != _head + 1 )
+        {
+            return false;
+        }
+
+        entry_type *const entry = std::launder(reinterpret_cast<entry_type*>(cell._entry));
+        batch.push_back(std::move(*entry)); // reserved for the batch already
+        entry->~entry_type();
+        cell._sequence.store(_head + _mask + 1, std::memory_order_release);
+        ++_head;
+        return true;
+    }
+
+    // The consumer thread: takes a batch at a time and calls the listener with it,
+    // or naps while there's none. Once stopping, it delivers what's left, then returns
+    void deliver() noexcept
+    {
+        std::vector<entry_type> batch;
+        for ( ;; )
+        {
+            bool const stopping = _stopping.load(std::memory_order_acquire);
+            try
+            {
+                batch.clear();
+                batch.reserve(_max_batch);
+            }
+            catch ( ... )
+            {
+                std::this_thread::sleep_for(_idle);
+                continue;
+            }
+            while ( (batch.size() < _max_batch) && take(batch) )
+            {
+            }
+
+            if ( batch.empty() )
+            {
+                if ( stopping )
+                {
+                    return;
+                }
+                std::this_thread::sleep_for(_idle);
+                continue;
+            }
+
+            size_t const count = batch.size();
+            try
+            {
+                _listener(batch);
+            }
+            catch ( ... ) // a throwing listener loses just the batch
+            {
+            }
+            _delivered.fetch_add(count, std::memory_order_release);
+        }
+    }
+
+  public:
+    // A queue of capacity entries (rounded up to a power of 2) for the listener
+    explicit EvictionQueue(listener_type listener, size_t capacity = 1 << 14, size_t max_batch = 256,
+                           std::chrono::microseconds idle = std::chrono::microseconds(500))
+     : _listener(std::move(listener)), _max_batch(std::max<size_t>(1, max_batch)), _idle(idle)
+    {
+        size_t cells = 2;
+        while ( cells < capacity )
+        {
+            cells <<= 1;
+        }
+        _cells.reset(new Cell[cells]);
+        _mask = cells - 1;
+        for ( size_t i = 0; i < cells; ++i )
+        {
+            _cells[i]._sequence.store(i, std::memory_order_relaxed);
+        }
+        _consumer = std::thread(&EvictionQueue::deliver, this);
+    }
+
+    EvictionQueue(const EvictionQueue&) = delete;
+    EvictionQueue& operator=(const EvictionQueue&) = delete;
+
+    // delivers the entries put so far, so it needs to outlive the caches putting on it
+    ~EvictionQueue()
+    {
+        _stopping.store(true, std::memory_order_release);
+        _consumer.join();
+        for ( ; _head != _tail.load(std::memory_order_relaxed); ++_head ) // not delivered with no listener
+        {
+            std::launder(reinterpret_cast<entry_type*>(_cells[_head & _mask]._entry))->~entry_type();
+        }
+    }
+
+    // Puts a copy of the entry on the queue, or returns false when it's full (or the
+    // copy throws), the entry then being dropped - it never throws, nor waits
+    bool put(const Key& key, const Value& value, EvictionCause cause) noexcept
+    {
+        try
+        {
+            entry_type entry{key, value, cause};
+            size_t position = _tail.load(std::memory_order_relaxed);
+            for ( ;; )
+            {
+                Cell &cell = _cells[position & _mask];
+                size_t const sequence = cell._sequence.load(std::memory_order_acquire);
+                if ( sequence == position ) // the cell's free, so claim the position
+                {
+                    if ( _tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+                    {
+                        ::new (static_cast<void*>(cell._entry)) entry_type(std::move(entry));
+                        cell._sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if ( sequence < position ) // the cell's still to be taken, a lap behind
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else // another put's claimed the position
+                {
+                    position = _tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        catch ( ... )
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    // Waits for the listener to be done with the entries put so far
+    void flush() const
+    {
+        uint64_t const put_so_far = _tail.load(std::memory_order_acquire);
+        while ( _delivered.load(std::memory_order_acquire) < put_so_far )
+        {
+            std::this_thread::sleep_for(_idle);
+        }
+    }
+
+    // no. of the entries the listener's been called with
+    uint64_t delivered() const noexcept
+    {
+        return _delivered.load(std::memory_order_acquire);
+    }
+
+    // no. of the entries dropped, with the queue full
+    uint64_t dropped() const noexcept
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const noexcept
+    {
+        return _mask + 1;
+    }
+};
+
+// the stand in for the eviction queue of a cache that has none
+struct NoEvictionQueue { };
+
+// the queue the Policy's eviction_queue_type has the cache's evicted entries put on,
+// if it has one, else NoEvictionQueue
+template <class Policy, class Key, class Value, class = void>
+struct policy_eviction_queue
+{
+    using type = NoEvictionQueue;
+};
+
+template <class Policy, class Key, class Value>
+struct policy_eviction_queue<Policy, Key, Value, std::void_t<typename Policy::template eviction_queue_type<Key, Value>>>
+{
+    using type = typename Policy::template eviction_queue_type<Key, Value>;
+};
+
+// Any of the policies above, with the entries the cache evicts or expires put on the
+// EvictionQueue set by set_eviction_queue, for its listener, as in
+// LRUCache<int, std::string, std::hash<int>, NotifyingPolicy<ExpiringPolicy<LinkedLRUPolicy>>>
+template <class Policy>
+struct NotifyingPolicy : Policy
+{
+    template <class Key, class Value>
+    using eviction_queue_type = EvictionQueue<Key, Value>;
+};
+
+// The queue a write-back cache (of a WriteBackPolicy) writes its dirty entries back
+// through, to the store it's in front of: the writer is called with them in batches
+// of up to max_batch, on a thread of the queue's own, so no put waits on the store
+// A key queued again before it's been written is written just the once, with its
+// last value, so that the updates of a key that keep missing the writer collapse
+// into one write too. A writer that throws has its batch queued again (bar the keys
+// queued anew meanwhile) and retried after the retry delay, its error kept for
+// last_error(). The queue writes out whatever's left when it's destroyed
+template <class Key, class Value, class Hash = std::hash<Key>>
+class WriteBackQueue
+{
+  public:
+    using entry_type = std::pair<Key, Value>;
+    using writer_type = std::function<void(std::vector<entry_type>& batch)>;
+
+  private:
+    writer_type _writer;
+    size_t const _max_batch;
+    std::chrono::milliseconds const _retry;
+
+    mutable std::mutex _lock;
+    std::condition_variable _queued;  // wakes the writer to an entry queued, or to stop
+    std::condition_variable _drained; // wakes the flush, to none queued nor being written
+    std::vector<entry_type> _pending;
+    std::unordered_map<Key, size_t, Hash> _positions; // of the keys in _pending
+    bool _writing{false};
+    bool _stopping{false};
+    uint64_t _written{0};
+    uint64_t _coalesced{0};
+    uint64_t _lost{0};
+    uint64_t _failures{0};
+    std::string _last_error;
+    std::thread _thread; // started last, once the rest is in place
+
+    // Queues the entries of a batch the writer failed on again, after those queued
+    // meanwhile, unless their keys are among them. When stopping, they're lost
+    void requeue(std::vector<entry_type> &failed, size_t from) noexcept
+    {
+        for ( size_t i = from; i < failed.size(); ++i )
+        {
+            try
+            {
+                if ( _stopping )
+                {
+                    ++_lost;
+                }
+                else if ( _positions.end() == _positions.find(failed[i].first) )
+                {
+                    _pending.push_back(std::move(failed[i]));
+                    _positions.emplace(_pending.back().first, _pending.size() - 1);
+                }
+            }
+            catch ( ... )
+            {
+                ++_lost;
+            }
+        }
+    }
+
+    // The writer thread: takes all that's queued at once, and calls the writer with it
+    // a batch at a time, with the lock let go
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        std::vector<entry_type> taken;
+        std::vector<entry_type> batch;
+        for ( ;; )
+        {
+            _queued.wait(guard, [this]() { return _stopping || !_pending.empty(); });
+            if ( _pending.empty() ) // stopping, with all of it written
+            {
+                return;
+            }
+
+            taken.clear();
+            taken.swap(_pending);
+            _positions.clear();
+            _writing = true;
+            guard.unlock();
+
+            size_t done = 0;
+            std::string error;
+            while ( done < taken.size() )
+            {
+                size_t const end = std::min(taken.size(), done + _max_batch);
+                try
+                {
+                    batch.assign(std::make_move_iterator(taken.begin() + done), std::make_move_iterator(taken.begin() + end));
+                    _writer(batch);
+                }
+                catch ( std::exception& except )
+                {
+                    error = except.what();
+                }
+                catch ( ... )
+                {
+                    error = "unknown exception";
+                }
+                if ( !error.empty() )
+                {
+                    std::move(batch.begin(), batch.end(), taken.begin() + done); // back where they were
+                    break;
+                }
+                done = end;
+            }
+
+            guard.lock();
+            _written += done;
+            _writing = false;
+            if ( !error.empty() )
+            {
+                ++_failures;
+                _last_error = error;
+                requeue(taken, done);
+                _queued.wait_for(guard, _retry, [this]() { return _stopping; });
+            }
+            if ( _pending.empty() )
+            {
+                _drained.notify_all();
+            }
+        }
+    }
+
+  public:
+    explicit WriteBackQueue(writer_type writer, size_t max_batch = 256,
+                            std::chrono::milliseconds retry = std::chrono::milliseconds(100), const Hash& hash = Hash())
+     : _writer(std::move(writer)), _max_batch(std::max<size_t>(1, max_batch)), _retry(retry), _positions(0, hash),
+       _thread([this]() { run(); })
+    { }
+
+    WriteBackQueue(const WriteBackQueue&) = delete;
+    WriteBackQueue& operator=(const WriteBackQueue&) = delete;
+
+    // writes out what's queued, so it needs to outlive the caches writing back through it
+    ~WriteBackQueue()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _queued.notify_one();
+        _thread.join();
+    }
+
+    // Queues the entry to be written back, over the one of the key queued already, if
+    // any. It never throws: an entry there's no memory to queue is lost, and counted
+    void write(const Key& key, const Value& value) noexcept
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            try
+            {
+                auto const found = _positions.find(key);
+                if ( _positions.end() != found )
+                {
+                    _pending[found->second].second = value;
+                    ++_coalesced;
+                    return;
+                }
+
+                _pending.emplace_back(key, value);
+                try
+                {
+                    _positions.emplace(key, _pending.size() - 1);
+                }
+                catch ( ... )
+                {
+                    _pending.pop_back();
+                    throw;
+                }
+            }
+            catch ( ... )
+            {
+                ++_lost;
+                return;
+            }
+        }
+        _queued.notify_one();
+    }
+
+    // Waits for all that's queued to be written, retried for as long as the writer fails
+    void flush()
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        _drained.wait(guard, [this]() { return _pending.empty() && !_writing; });
+    }
+
+    // no. of the entries written, and of the writes that collapsed into a queued one
+    uint64_t written() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _written;
+    }
+
+    uint64_t coalesced() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _coalesced;
+    }
+
+    // no. of the entries lost, with no memory to queue them (or the writer failing on
+    // them as the queue's destroyed)
+    uint64_t lost() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _lost;
+    }
+
+    // no. of the batches the writer failed on, and the error of the last one
+    uint64_t failures() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _failures;
+    }
+
+    std::string last_error() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _last_error;
+    }
+};
+
+// the stand in for the write-back queue of a cache that has none
+struct NoWriteBackQueue { };
+
+// the queue the Policy's write_back_type has the cache's dirty entries written back
+// through, if it has one, else NoWriteBackQueue
+template <class Policy, class Key, class Value, class Hash, class = void>
+struct policy_write_back
+{
+    using type = NoWriteBackQueue;
+};
+
+template <class Policy, class Key, class Value, class Hash>
+struct policy_write_back<Policy, Key, Value, Hash, std::void_t<typename Policy::template write_back_type<Key, Value, Hash>>>
+{
+    using type = typename Policy::template write_back_type<Key, Value, Hash>;
+};
+
+// Any of the policies above, with the puts marking their entries dirty, to be written
+// back through the WriteBackQueue set by set_write_back_queue when they're evicted
+// (or expired), or flushed by flush_dirty, rather than written through, as in
+// LRUCache<int, std::string, std::hash<int>, WriteBackPolicy<LinkedLRUPolicy>>
+template <class Policy>
+struct WriteBackPolicy : Policy
+{
+    template <class Key, class Value, class Hash>
+    using write_back_type = WriteBackQueue<Key, Value, Hash>;
+};
+
+// LRUCache implementation using the LRUTwoWayList defined above and FlatHashIndex
+// as dictionary for storing the <key,Node(key,value)> pair
+// The LRUTwoWayList and the TwoWayListNode could as well be nested within this 
+// class in order to make it more encapsulated - however, left it this way for now 
+// The storage engine for the recency list is picked by the Policy parameter,
+// either the pointer linked LRUTwoWayList, the slot linked IndexedTwoWayList,
+// or the approximate LRU of the ClockList
+// Everything is resolved at compile time, so LRUCache<int, int> compiles down
+// to the same hot path as the int only LRUCache it replaces
+template <class Key, class Value, class Hash = std::hash<Key>, class Policy = LinkedLRUPolicy>
+class LRUCache
+{
+    // the Node's value gets moved in place of the evicted one, which must not throw
+    static_assert(std::is_nothrow_move_assignable<Value>::value,
+                  "LRUCache moves the new value into the reused Node, which must not throw");
+
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using stats_type = typename policy_stats<Policy>::type;
+    using instrument_type = typename policy_instruments<Policy>::type;
+    using weigher_type = typename policy_weigher<Policy>::type;
+    using clock_type = typename policy_clock<Policy>::type;
+    using tier_type = typename policy_tier<Policy, Key, Value, Hash>::type;
+    using eviction_queue_type = typename policy_eviction_queue<Policy, Key, Value>::type;
+    using write_back_type = typename policy_write_back<Policy, Key, Value, Hash>::type;
+
+  private:
+    // whether the entries are weighed and kept under a WeightBudget too
+    static constexpr bool WEIGHTED = !std::is_void<weigher_type>::value;
+    // whether the entries can be put with a ttl, their Nodes holding an ExpiringValue
+    static constexpr bool EXPIRING = !std::is_void<clock_type>::value;
+    // whether the evicted entries are demoted to a tier, and the misses looked up there
+    static constexpr bool TIERED = !std::is_same<tier_type, NoFlashTier>::value;
+    // whether the evicted (and expired) entries are put on an eviction queue
+    static constexpr bool NOTIFYING = !std::is_same<eviction_queue_type, NoEvictionQueue>::value;
+    // whether the puts mark their entries dirty, to be written back later
+    static constexpr bool WRITE_BACK = !std::is_same<write_back_type, NoWriteBackQueue>::value;
+
+  public:
+    // the Value, within a DirtyValue when writing back, within an ExpiringValue when expiring
+    using held_type = typename std::conditional<WRITE_BACK, DirtyValue<Value>, Value>::type;
+    using list_type = typename Policy::template list_type<Key, typename std::conditional<EXPIRING, ExpiringValue<held_type>, held_type>::type>;
+
+  private:
+    using handle_type = typename list_type::handle_type;
+
+    int _capacity{-1};
+    // our custom two way list that contains MRU to LRU
+    list_type _lru_list;
+    // flat hash index to hold the key and the corresponding Node in the list
+    // Again shared_ptr could have been used here, skipped for now
+    typename policy_index<Policy, Key, handle_type, Hash, typename policy_region<Policy>::type>::type _lru_cache_map;
+    // the counters of stats(), nothing at all unless the Policy asks for them
+    LRUCACHE_NO_UNIQUE_ADDRESS mutable stats_type _stats;
+    // the latencies and the trace hook, nothing at all unless the Policy asks for them
+    LRUCACHE_NO_UNIQUE_ADDRESS mutable instrument_type _instruments;
+    // the weigher of the entries, an unused stand in when they aren't weighed
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<WEIGHTED, weigher_type, EntryBytesWeigher>::type _weigher;
+    // the budget and the total weight of the entries held, when they're weighed
+    struct EntryWeights
+    {
+        size_t _budget{SIZE_MAX};
+        size_t _total{0};
+    };
+    struct NoEntryWeights { };
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<WEIGHTED, EntryWeights, NoEntryWeights>::type _weights;
+    // the clock the deadlines are in, and where the sweep of the map is at, when expiring
+    struct EntryExpiry
+    {
+        typename std::conditional<EXPIRING, clock_type, CoarseClock>::type _clock;
+        size_t _swept{0}; // the slot of the map the sweep carries on from
+    };
+    struct NoEntryExpiry { };
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<EXPIRING, EntryExpiry, NoEntryExpiry>::type _expiry;
+    // the tier the evicted entries go to, when tiered (and given one)
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<TIERED, tier_type*, NoFlashTier>::type _tier{};
+    // the queue the evicted entries are put on, when notifying (and one's been set)
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<NOTIFYING, eviction_queue_type*, NoEvictionQueue>::type _eviction_queue{};
+    // the queue the dirty entries are written back through, and the handles of the dirty
+    // ones (each Node holding its place in them), when writing back (and one's been set)
+    // so a flush costs the dirty ones alone, and marking or cleaning one costs O(1)
+    struct NoDirtyHandles { };
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<WRITE_BACK, write_back_type*, NoWriteBackQueue>::type _write_back{};
+    LRUCACHE_NO_UNIQUE_ADDRESS typename std::conditional<WRITE_BACK, std::vector<handle_type>, NoDirtyHandles>::type _dirty_handles;
+
+    // no. of slots of the map each put sweeps for the expired entries
+    static constexpr size_t EXPIRY_SWEEP_SLOTS = 2;
+
+    // the held_type in the Node, within its ExpiringValue when expiring
+    template <class Node>
+    static auto& held_of(Node &node) noexcept
+    {
+        if constexpr ( EXPIRING )
+        {
+            return node._value._value;
+        }
+        else
+        {
+            return node._value;
+        }
+    }
+
+    // the value held in the Node, within its DirtyValue and ExpiringValue, if any
+    template <class Node>
+    static auto& value_of(Node &node) noexcept
+    {
+        if constexpr ( WRITE_BACK )
+        {
+            return held_of(node)._value;
+        }
+        else
+        {
+            return held_of(node);
+        }
+    }
+
+    // Sets the deadline of the handle's entry, and marks it dirty if it's put (rather
+    // than filled, restored or promoted), and returns its value. It's the last step of
+    // each put, once nothing can throw any more, so a put that throws marks nothing
+    // (nor allocates, as the dirty handles have room for the capacity reserved)
+    Value& stamp(handle_type handle, uint64_t deadline, bool put) noexcept
+    {
+        auto &node = _lru_list.node(handle);
+        if constexpr ( EXPIRING )
+        {
+            node._value._deadline = deadline;
+        }
+        if constexpr ( WRITE_BACK )
+        {
+            if ( put && (nullptr != _write_back) && !held_of(node).dirty() )
+            {
+                held_of(node)._dirty_at = static_cast<uint32_t>(_dirty_handles.size());
+                _dirty_handles.push_back(handle);
+            }
+        }
+        return value_of(node);
+    }
+
+    // Rehashes the map ahead of an add of a key that would do it itself, when it's due
+    // (only ever for a TagHashIndex, see rehash_due), so it's timed on its own
+    void rehash_map_if_due() noexcept
+    {
+        if ( _lru_cache_map.rehash_due() )
+        {
+            InstrumentedScope<instrument_type> rehashing(_instruments, CacheOp::Rehash);
+            _lru_cache_map.rehash();
+        }
+    }
+
+    // the deadline of an entry put now with the ttl, saturated
+    uint64_t deadline_after(std::chrono::milliseconds ttl) const noexcept
+    {
+        static_assert(EXPIRING, "a put with a ttl needs a Policy with a clock_type, see ExpiringPolicy");
+        uint64_t const now = _expiry._clock.now_ms();
+        uint64_t const after = static_cast<uint64_t>(std::max<std::chrono::milliseconds::rep>(0, ttl.count()));
+        return ( NEVER_EXPIRES - now > after ) ? now + after : NEVER_EXPIRES;
+    }
+
+    // whether the Node's entry is past its deadline, never when not expiring
+    template <class Node>
+    bool expired(const Node &node) const noexcept
+    {
+        if constexpr ( EXPIRING )
+        {
+            return ( NEVER_EXPIRES != node._value._deadline ) && ( node._value._deadline <= _expiry._clock.now_ms() );
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Looks the next max_slots slots of the map over (a lap of it at most) for the
+    // expired entries, and erases them. An erase may shift the keys after it back by a
+    // slot (a FlatHashIndex's does), so the sweep looks at the same slot again after one
+    size_t sweep_expired(size_t max_slots) noexcept
+    {
+        size_t freed = 0;
+        size_t const slots = _lru_cache_map.slot_count();
+        uint64_t const now = _expiry._clock.now_ms();
+
+        for ( size_t swept = 0; (swept < max_slots) && (swept < slots) && (0 != _lru_cache_map.size()); )
+        {
+            const handle_type *const handle = _lru_cache_map.handle_at(_expiry._swept);
+            if ( nullptr != handle )
+            {
+                uint64_t const deadline = _lru_list.node(*handle)._value._deadline;
+                if ( (NEVER_EXPIRES != deadline) && (deadline <= now) )
+                {
+                    erase_entry(*handle);
+                    ++freed;
+                    continue;
+                }
+            }
+            _expiry._swept = ( _expiry._swept + 1 == slots ) ? 0 : _expiry._swept + 1;
+            ++swept;
+        }
+
+        return freed;
+    }
+
+    // the bytes an entry adds to the stats, not worked out when they aren't counted
+    static size_t counted_bytes(const Key& key, const Value& value) noexcept
+    {
+        if constexpr ( stats_type::ENABLED )
+        {
+            return entry_bytes(key) + entry_bytes(value);
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    // validates the capacity before the underlying list gets sized with it
+    static int checked_capacity(int capacity)
+    {
+        if ( 0 >= capacity )
+        {
+            throw InvalidCapacityException; // capacity cannot be negative
+        }
+
+        return capacity;
+    }
+
+    // whether the args to build a value from are just a Value to be copied or moved
+    template <class... Args>
+    static constexpr bool IS_VALUE = ( 1 == sizeof...(Args) ) &&
+                                     ( std::is_same<typename std::decay<Args>::type, Value>::value && ... );
+
+    // whether a value built from the args can replace a held one without throwing
+    template <class... Args>
+    static constexpr bool is_nothrow_value() noexcept
+    {
+        if constexpr ( IS_VALUE<Args...> )
+        {
+            return ( std::is_nothrow_assignable<Value&, Args&&>::value && ... );
+        }
+        else
+        {
+            return std::is_nothrow_constructible<Value, Args&&...>::value;
+        }
+    }
+
+    // Replaces the value held in a Node with the one built from the args: a Value given
+    // as is gets assigned over it, otherwise the new one is built right in its place
+    // when that can't throw (the old one destroyed first), or else built aside and
+    // moved in, so that a throwing constructor leaves the old value as it was
+    // Either way the old value is destroyed exactly once
+    template <class... Args>
+    static void assign_value(Value &held, Args&&... args)
+    {
+        if constexpr ( IS_VALUE<Args...> )
+        {
+            (held = ... = std::forward<Args>(args));
+        }
+        else if constexpr ( std::is_nothrow_constructible<Value, Args&&...>::value )
+        {
+            held.~Value();
+            ::new (static_cast<void*>(std::addressof(held))) Value(std::forward<Args>(args)...);
+        }
+        else
+        {
+            held = Value(std::forward<Args>(args)...);
+        }
+    }
+
+    // Updates the value of the key, if it already exists in the map.
+    // If the key doesn't exist in the map, it adds the key and makes it the MRU
+    // when the set capacity hasn't been reached yet
+    // If the set capacity has been reached, evicts the LRU key from map, and then
+    // adds the new key and value (i.e. Node) to map and makes the Node as front
+    // The lookup and the insert of the key share one probe of the map: on a miss the
+    // key is added right away and then given the Node it is going to get, which at
+    // capacity is the victim Node being reused, so a miss at capacity costs that
+    // probe plus the unlink of the evicted key and allocates nothing
+    // The value is built from the args straight into the Node, and the key is moved
+    // into it when given as an rvalue (the map keeps a copy of its own)
+    // home is the key's home slot in the map, which a batch works out ahead
+    // deadline is when the entry expires, in the ms of the Policy's clock_type, if it has one
+    // put is whether it's put, so a write-back cache marks it dirty, or else filled
+    template <class K, class... Args>
+    Value& emplace_value(size_t home, uint64_t deadline, bool put, K&& key, Args&&... args)
+    {
+        if constexpr ( EXPIRING )
+        {
+            sweep_expired(EXPIRY_SWEEP_SLOTS); // the amortized sweep, a few slots a put
+        }
+
+        if constexpr ( WEIGHTED )
+        {
+            return emplace_weighted(home, deadline, put, std::forward<K>(key), std::forward<Args>(args)...);
+        }
+
+        InstrumentedScope<instrument_type> timed(_instruments, CacheOp::Put);
+
+        // find the key in the map, or add it, to be given its Node below
+        rehash_map_if_due();
+        auto const emplaced = _lru_cache_map.try_emplace(key, handle_type{}, home);
+
+        if ( !emplaced.second ) // when the key is found in the map
+        {
+            auto &found_node = _lru_list.node(*emplaced.first);
+            size_t const updated_bytes = counted_bytes(found_node._key, value_of(found_node));
+            assign_value(value_of(found_node), std::forward<Args>(args)...); // just update the value
+            _lru_list.move_to_front(*emplaced.first); // make the corresponding node MRU in the list
+            _stats.update();
+            _stats.remove_bytes(updated_bytes);
+            _stats.add_bytes(counted_bytes(found_node._key, value_of(found_node)));
+            return stamp(*emplaced.first, deadline, put);
+        }
+
+        try
+        {
+            if ( _lru_list.size() == static_cast<size_t>(_capacity) ) // when the size has reached the capacity limits
+            {
+                return reuse_victim(*emplaced.first, deadline, put, std::forward<K>(key), std::forward<Args>(args)...);
+            }
+
+            // when the key not found and the size has not reached the capacity limits
+            // the map isn't touched in between, so the emplaced handle is still in place
+            InstrumentedScope<instrument_type> allocating(_instruments, CacheOp::Allocate);
+            if constexpr ( is_nothrow_value<Args...>() )
+            {
+                *emplaced.first = _lru_list.add_to_front(std::forward<K>(key), std::forward<Args>(args)...);
+            }
+            else if constexpr ( std::is_nothrow_move_constructible<Value>::value )
+            {
+                // a throwing value is built aside first, so that the key isn't moved
+                // into the Node until nothing but the allocation can throw, and is
+                // still there to roll back from the map below
+                Value new_value(std::forward<Args>(args)...);
+                *emplaced.first = _lru_list.add_to_front(std::forward<K>(key), std::move(new_value));
+            }
+            else
+            {
+                *emplaced.first = _lru_list.add_to_front(static_cast<const Key&>(key), std::forward<Args>(args)...);
+            }
+            auto &added_node = _lru_list.node(*emplaced.first);
+            _stats.put();
+            _stats.add_bytes(counted_bytes(added_node._key, value_of(added_node)));
+            return stamp(*emplaced.first, deadline, put);
+        }
+        catch(std::exception &except) // bad_alloc may be thrown, catch and propagate
+        {
+            _lru_cache_map.erase(key); // roll back the key added to the map
+            cout << "LRUCache::put - adding the key threw: " << except.what() << endl;
+            throw;
+        }
+        catch(...)
+        {
+            _lru_cache_map.erase(key); // roll back the key added to the map
+            cout << "LRUCache::put - Unknown exception" << endl;
+            throw;
+        }
+    }
+
+    // The emplace_value of a weighted cache, which evicts from the victim end (the LRU
+    // back, for a list) for as long as the total weight is over the budget, or the
+    // size at the capacity, so a heavy entry may evict several light ones
+    // The value is built and weighed before anything is evicted for it, so that what
+    // may throw afterwards is just the allocation of the Node (or the copy of the
+    // key). An entry weighing more than the whole budget is refused upfront
+    // Here, the lookup and the insert of a new key take a probe of the map each, as
+    // the evictions in between may move the slots of the map and the Nodes around
+    template <class K, class... Args>
+    Value& emplace_weighted(size_t home, uint64_t deadline, bool put, K&& key, Args&&... args)
+    {
+        InstrumentedScope<instrument_type> timed(_instruments, CacheOp::Put);
+
+        Value new_value(std::forward<Args>(args)...);
+        size_t const new_weight = _weigher(static_cast<const Key&>(key), static_cast<const Value&>(new_value));
+        if ( new_weight > _weights._budget )
+        {
+            throw std::length_error("LRUCache::put - the entry weighs more than the whole weight budget");
+        }
+
+        handle_type *const found = _lru_cache_map.find(key, home);
+        if ( nullptr != found ) // when the key is found in the map, update its value
+        {
+            handle_type const updated = *found;
+            auto &updated_node = _lru_list.node(updated);
+            size_t const updated_bytes = counted_bytes(updated_node._key, value_of(updated_node));
+            size_t const updated_weight = _weigher(updated_node._key, value_of(updated_node));
+            value_of(updated_node) = std::move(new_value);
+            stamp(updated, deadline, put);
+            // weighed again as held, as a string moved over another may keep the old buffer
+            _weights._total = _weights._total - updated_weight + _weigher(updated_node._key, value_of(updated_node));
+            _lru_list.move_to_front(updated);
+            _stats.update();
+            _stats.remove_bytes(updated_bytes);
+            _stats.add_bytes(counted_bytes(updated_node._key, value_of(updated_node)));
+
+            if ( _weights._total <= _weights._budget )
+            {
+                return value_of(updated_node);
+            }
+
+            // the entry itself fits the budget, so the evictions stop before it
+            while ( (_weights._total > _weights._budget) && (1 < _lru_list.size()) )
+            {
+                evict_one(&key);
+            }
+            return value_of(_lru_list.node(*_lru_cache_map.find(key))); // it may have moved
+        }
+
+        while ( (_lru_list.size() == static_cast<size_t>(_capacity)) || (_weights._budget - _weights._total < new_weight) )
+        {
+            evict_one(nullptr);
+        }
+
+        rehash_map_if_due();
+        auto const emplaced = _lru_cache_map.try_emplace(key, handle_type{}, home);
+        try
+        {
+            InstrumentedScope<instrument_type> allocating(_instruments, CacheOp::Allocate);
+            if constexpr ( std::is_nothrow_move_constructible<Value>::value )
+            {
+                *emplaced.first = _lru_list.add_to_front(std::forward<K>(key), std::move(new_value));
+            }
+            else
+            {
+                *emplaced.first = _lru_list.add_to_front(static_cast<const Key&>(key), std::move(new_value));
+            }
+        }
+        catch(...)
+        {
+            _lru_cache_map.erase(key); // roll back the key added to the map, the evictions stay done
+            throw;
+        }
+
+        auto &added_node = _lru_list.node(*emplaced.first);
+        _weights._total += _weigher(added_node._key, value_of(added_node));
+        _stats.put();
+        _stats.add_bytes(counted_bytes(added_node._key, value_of(added_node)));
+        return stamp(*emplaced.first, deadline, put);
+    }
+
+    // Hands the entry of the Node being evicted (or expired) on, as per the Policy: it's
+    // demoted to the tier, unless it's expired, and put on the eviction queue, and
+    // written back, if it's dirty
+    template <class Node>
+    void hand_off(const Node &node) noexcept
+    {
+        write_back(node);
+        if constexpr ( TIERED || NOTIFYING )
+        {
+            bool const is_expired = expired(node);
+            if constexpr ( TIERED )
+            {
+                if ( (nullptr != _tier) && !is_expired )
+                {
+                    uint64_t deadline = NEVER_EXPIRES;
+                    if constexpr ( EXPIRING )
+                    {
+                        deadline = node._value._deadline;
+                    }
+                    _tier->demote(node._key, value_of(node), deadline, this);
+                }
+            }
+            if constexpr ( NOTIFYING )
+            {
+                if ( nullptr != _eviction_queue )
+                {
+                    _eviction_queue->put(node._key, value_of(node), is_expired ? EvictionCause::Expired : EvictionCause::Evicted);
+                }
+            }
+        }
+    }
+
+    // writes the entry of the Node back, when writing back and it's dirty, and holds it
+    // clean from then on, the last of the dirty handles moved into its place in them
+    template <class Node>
+    void write_back(const Node &node) noexcept
+    {
+        if constexpr ( WRITE_BACK )
+        {
+            if ( (nullptr != _write_back) && held_of(node).dirty() )
+            {
+                uint32_t const at = held_of(node)._dirty_at;
+                handle_type const last = _dirty_handles.back();
+                _dirty_handles[at] = last;
+                held_of(_lru_list.node(last))._dirty_at = at;
+                _dirty_handles.pop_back();
+                held_of(node)._dirty_at = DirtyValue<Value>::CLEAN;
+                _write_back->write(node._key, value_of(node));
+            }
+        }
+    }
+
+    // On a miss, takes the key's entry from the tier, when tiered and it's there (and
+    // not expired), and puts it back as the MRU - nullptr if there's none
+    Value* promote(const Key& key)
+    {
+        if constexpr ( TIERED )
+        {
+            Value value;
+            uint64_t deadline = NEVER_EXPIRES;
+            if ( (nullptr == _tier) || !_tier->take(key, value, deadline) )
+            {
+                return nullptr;
+            }
+            if constexpr ( EXPIRING )
+            {
+                if ( (NEVER_EXPIRES != deadline) && (deadline <= _expiry._clock.now_ms()) )
+                {
+                    return nullptr;
+                }
+            }
+            return &emplace_value(_lru_cache_map.home_slot(key), deadline, false, key, std::move(value));
+        }
+        return nullptr;
+    }
+
+    // get_ptr's lookup, the miss counted and looked up in the tier when FROM_TIER
+    template <bool FROM_TIER>
+    Value* lookup_ptr(const Key& key) noexcept(!(FROM_TIER && TIERED))
+    {
+        InstrumentedScope<instrument_type> timed(_instruments, CacheOp::Get);
+        auto const found = _lru_cache_map.find(key); // find the key in the map
+
+        if ( nullptr == found ) // when the key is not found in the map
+        {
+            if constexpr ( FROM_TIER )
+            {
+                _stats.miss();
+                return promote(key);
+            }
+            return nullptr;
+        }
+
+        if ( expired(_lru_list.node(*found)) ) // a miss too, and its entry is dropped right away
+        {
+            erase_entry(*found);
+            if constexpr ( FROM_TIER )
+            {
+                _stats.miss();
+            }
+            return nullptr;
+        }
+
+        // When the key is found, pass the associated Node to the list to make it front
+        _lru_list.move_to_front(*found);
+        _stats.hit();
+        timed.hit();
+
+        return &value_of(_lru_list.node(*found)); // point to the value in the node
+    }
+
+    // the misses of a batch promoted from the tier, after its lookups, when tiered
+    template <class Pick>
+    size_t promote_misses(const Key* keys, Pick pick, size_t count, std::optional<Value>* values)
+    {
+        size_t promoted = 0;
+        if constexpr ( TIERED )
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                size_t const at = pick(i);
+                if ( values[at] )
+                {
+                    continue;
+                }
+                if ( Value const *const value = promote(keys[at]) )
+                {
+                    values[at] = *value;
+                    ++promoted;
+                }
+            }
+        }
+        return promoted;
+    }
+
+    // Evicts the victim's key and Node, unless it's the key to keep (the one being
+    // updated), which is then given another chance. The engines that keep their
+    // Nodes dense move another Node into the freed slot, whose handle then gets
+    // updated in the map
+    void evict_one(const Key *keep)
+    {
+        InstrumentedScope<instrument_type> evicting(_instruments, CacheOp::Evict);
+        handle_type const evicted = _lru_list.victim();
+        auto &evicted_node = _lru_list.node(evicted);
+
+        if ( (nullptr != keep) && (evicted_node._key == *keep) )
+        {
+            _lru_list.move_to_front(evicted);
+            return;
+        }
+
+        erase_entry(evicted);
+    }
+
+    // Drops the entry of the handle, its key from the map and its Node from the list,
+    // counted as an eviction (whether evicted or expired), and handed off
+    void erase_entry(handle_type erased) noexcept
+    {
+        hand_off(_lru_list.node(erased));
+        _stats.eviction();
+        drop_entry(erased);
+    }
+
+    // Drops the entry of the handle as erase_if does, only written back if dirty
+    void remove_entry(handle_type removed) noexcept
+    {
+        write_back(_lru_list.node(removed));
+        drop_entry(removed);
+    }
+
+    // drops the entry of the handle, its key from the map and its Node from the list
+    void drop_entry(handle_type dropped) noexcept
+    {
+        auto &dropped_node = _lru_list.node(dropped);
+        if constexpr ( WEIGHTED )
+        {
+            _weights._total -= _weigher(dropped_node._key, value_of(dropped_node));
+        }
+        _stats.remove_bytes(counted_bytes(dropped_node._key, value_of(dropped_node)));
+        _lru_cache_map.erase(dropped_node._key);
+        remove_node(dropped);
+    }
+
+    // drops the Node from the list, its key already erased from the map (and the Node
+    // clean), a Node moved into its slot keeping its place in the map and the dirty ones
+    void remove_node(handle_type removed) noexcept
+    {
+        _lru_list.remove(removed, [this](const typename list_type::node_type& moved_node, handle_type moved_to) noexcept
+        {
+            *_lru_cache_map.find(moved_node._key) = moved_to;
+            if constexpr ( WRITE_BACK )
+            {
+                if ( held_of(moved_node).dirty() )
+                {
+                    _dirty_handles[held_of(moved_node)._dirty_at] = moved_to;
+                }
+            }
+        });
+    }
+
+    // Evicts the victim Node's key from the map and hands the Node over to the new
+    // key and value, making it the MRU - new_key_handle is where the map keeps the
+    // new key's handle, which is set before the evicted key's erase can move it
+    template <class K, class... Args>
+    Value& reuse_victim(handle_type &new_key_handle, uint64_t deadline, bool put, K&& key, Args&&... args)
+    {
+        if constexpr ( std::is_nothrow_assignable<Key&, K&&>::value && is_nothrow_value<Args...>() )
+        {
+            InstrumentedScope<instrument_type> evicting(_instruments, CacheOp::Evict);
+            handle_type const reused = _lru_list.victim(); // the Node to evict, the LRU one for a list
+            new_key_handle = reused;
+            auto &reused_node = _lru_list.node(reused);
+            size_t const evicted_bytes = counted_bytes(reused_node._key, value_of(reused_node));
+            hand_off(reused_node);
+            _lru_cache_map.erase(reused_node._key); //remove the old key from the map, but retain the node
+            reused_node._key = std::forward<K>(key); // update the new key to the removed node 
+            // set the corresponding value for the new key in the Node (reused), the
+            // evicted value being destroyed or assigned over right here, once
+            assign_value(value_of(reused_node), std::forward<Args>(args)...);
+            _lru_list.readmit(reused); // make the new node the MRU in the list
+            count_eviction(evicted_bytes, reused_node);
+            return stamp(reused, deadline, put);
+        }
+        else
+        {
+            // built ahead of the eviction, so that a throwing key or value leaves the
+            // cache as it was, and then moved into the Node - the value first, as the
+            // key may be moved from, and is needed intact to roll back when it throws
+            Value new_value(std::forward<Args>(args)...);
+            Key new_key(std::forward<K>(key));
+
+            InstrumentedScope<instrument_type> evicting(_instruments, CacheOp::Evict);
+            handle_type const reused = _lru_list.victim();
+            new_key_handle = reused;
+            auto &reused_node = _lru_list.node(reused);
+            size_t const evicted_bytes = counted_bytes(reused_node._key, value_of(reused_node));
+            hand_off(reused_node);
+            _lru_cache_map.erase(reused_node._key);
+            reused_node._key = std::move(new_key);
+            value_of(reused_node) = std::move(new_value);
+            _lru_list.readmit(reused);
+            count_eviction(evicted_bytes, reused_node);
+            return stamp(reused, deadline, put);
+        }
+    }
+
+    // counts the put of a new key into the Node of an evicted one
+    template <class Node>
+    void count_eviction(size_t evicted_bytes, const Node& reused_node) noexcept
+    {
+        _stats.eviction();
+        _stats.put();
+        _stats.remove_bytes(evicted_bytes);
+        _stats.add_bytes(counted_bytes(reused_node._key, value_of(reused_node)));
+    }
+
+    // no. of keys of a batch that are hashed and prefetched together, enough to keep
+    // the loads in flight without the prefetched lines being evicted before their use
+    static constexpr size_t MULTI_OP_BLOCK = 16;
+
+    // the lookups of multi_get and multi_peek, on the cache or the const cache
+    // pick maps the i-th key of the batch to its position in keys and values
+    template <bool PROMOTE, class Self, class Pick>
+    static size_t multi_lookup(Self &self, const Key* keys, Pick pick, size_t count, std::optional<Value>* values)
+    {
+        size_t homes[MULTI_OP_BLOCK];
+        const handle_type *found[MULTI_OP_BLOCK];
+        size_t hits = 0;
+
+        for ( size_t begin = 0; begin < count; begin += MULTI_OP_BLOCK )
+        {
+            size_t const block = std::min(MULTI_OP_BLOCK, count - begin);
+
+            for ( size_t i = 0; i < block; ++i ) // hash the keys and start loading their slots
+            {
+                homes[i] = self._lru_cache_map.home_slot(keys[pick(begin + i)]);
+                self._lru_cache_map.prefetch(homes[i]);
+            }
+
+            for ( size_t i = 0; i < block; ++i ) // probe, and start loading the found Nodes
+            {
+                found[i] = self._lru_cache_map.find(keys[pick(begin + i)], homes[i]);
+                if ( nullptr != found[i] )
+                {
+                    prefetch_line(&self._lru_list.node(*found[i]));
+                }
+            }
+
+            for ( size_t i = 0; i < block; ++i ) // and only then read the values
+            {
+                std::optional<Value> &value = values[pick(begin + i)];
+                // an expired one is left for the sweep, as erasing it here would move
+                // the slots found for the rest of the block
+                if ( (nullptr == found[i]) || self.expired(self._lru_list.node(*found[i])) )
+                {
+                    self._stats.miss();
+                    value.reset();
+                    continue;
+                }
+
+                if constexpr ( PROMOTE )
+                {
+                    self._lru_list.move_to_front(*found[i]);
+                }
+                value = value_of(self._lru_list.node(*found[i]));
+                self._stats.hit();
+                ++hits;
+            }
+        }
+
+        return hits;
+    }
+
+    // the puts of multi_put, of the i-th key and value key_at(i) and value_at(i), the
+    // home slots staying valid across the puts as the map never grows
+    template <class KeyAt, class ValueAt>
+    void multi_store(KeyAt key_at, ValueAt value_at, size_t count)
+    {
+        size_t homes[MULTI_OP_BLOCK];
+
+        for ( size_t begin = 0; begin < count; begin += MULTI_OP_BLOCK )
+        {
+            size_t const block = std::min(MULTI_OP_BLOCK, count - begin);
+
+            for ( size_t i = 0; i < block; ++i )
+            {
+                homes[i] = _lru_cache_map.home_slot(key_at(begin + i));
+                _lru_cache_map.prefetch(homes[i]);
+            }
+
+            for ( size_t i = 0; i < block; ++i )
+            {
+                emplace_value(homes[i], NEVER_EXPIRES, true, key_at(begin + i), value_at(begin + i));
+            }
+        }
+    }
+
+    // The restore of an entry at its home slot in the map (see restore below). The
+    // evictions come before the insert of the key, as they may move the slots of
+    // the map (but not the key's home one), so a key held already may cost one
+    bool restore_entry(size_t home, Key&& key, Value&& value, uint64_t ttl_ms)
+    {
+        uint64_t deadline = NEVER_EXPIRES;
+        if constexpr ( EXPIRING )
+        {
+            if ( NEVER_EXPIRES != ttl_ms )
+            {
+                deadline = deadline_after(std::chrono::milliseconds(std::min<uint64_t>(ttl_ms, INT64_MAX)));
+            }
+        }
+
+        if constexpr ( WEIGHTED )
+        {
+            size_t const new_weight = _weigher(static_cast<const Key&>(key), static_cast<const Value&>(value));
+            if ( new_weight > _weights._budget )
+            {
+                return false;
+            }
+            while ( (_lru_list.size() == static_cast<size_t>(_capacity)) || (_weights._budget - _weights._total < new_weight) )
+            {
+                evict_one(nullptr);
+            }
+        }
+        else if ( _lru_list.size() == static_cast<size_t>(_capacity) )
+        {
+            evict_one(nullptr);
+        }
+
+        rehash_map_if_due();
+        auto const emplaced = _lru_cache_map.try_emplace(key, handle_type{}, home);
+        if ( !emplaced.second )
+        {
+            return false;
+        }
+
+        try
+        {
+            if constexpr ( std::is_nothrow_move_constructible<Value>::value )
+            {
+                *emplaced.first = _lru_list.add_to_front(std::move(key), std::move(value));
+            }
+            else
+            {
+                *emplaced.first = _lru_list.add_to_front(static_cast<const Key&>(key), std::move(value));
+            }
+        }
+        catch ( ... )
+        {
+            _lru_cache_map.erase(key); // roll back the key added to the map
+            throw;
+        }
+
+        auto &added_node = _lru_list.node(*emplaced.first);
+        stamp(*emplaced.first, deadline, false);
+        if constexpr ( WEIGHTED )
+        {
+            _weights._total += _weigher(added_node._key, value_of(added_node));
+        }
+        _stats.add_bytes(counted_bytes(added_node._key, value_of(added_node)));
+        return true;
+    }
+
+  public:
+    // Sizes all of the storage for the capacity upfront: the map's slots (which it
+    // never grows, a TagHashIndex rehashing in place at most), and the Nodes' slab or
+    // array (which never reallocate), so that no put ever allocates or moves the
+    // entries. Only the HeapLinkedLRUPolicy allocates while the cache fills up, a Node
+    // a put, and none once it's full
+    explicit LRUCache(int capacity, const Hash& hash = Hash())
+     : _capacity(checked_capacity(capacity)),
+       _lru_list(_capacity),
+       _lru_cache_map(_capacity, hash)
+    { }
+
+    // a write-back cache writes the entries still dirty back on its way out
+    ~LRUCache()
+    {
+        flush_dirty();
+    }
+
+    // A weighted cache of up to capacity entries, whose total weight is kept under
+    // the budget too - the capacity still sizes the storage, so it needs to be the
+    // most entries the budget is expected to hold. Needs a WeightedPolicy
+    LRUCache(int capacity, WeightBudget budget, const Hash& hash = Hash())
+     : LRUCache(capacity, hash)
+    {
+        static_assert(WEIGHTED, "a WeightBudget needs a Policy with a weigher_type, see WeightedPolicy");
+        _weights._budget = budget._weight;
+    }
+
+    // A tiered cache, whose evicted entries are demoted to the tier, and whose gets
+    // that miss take the key's entry back from it. The tier needs to outlive the cache
+    // (and can be shared with other caches, of other keys). Needs a TieredPolicy
+    LRUCache(int capacity, tier_type& tier, const Hash& hash = Hash())
+     : LRUCache(capacity, hash)
+    {
+        static_assert(TIERED, "a tier needs a Policy with a tier_type, see TieredPolicy");
+        _tier = &tier;
+    }
+
+    // Sets the queue the evicted (and expired) entries are put on, for its listener
+    // To be set before the cache is shared between threads. Needs a NotifyingPolicy
+    void set_eviction_queue(eviction_queue_type& queue) noexcept
+    {
+        static_assert(NOTIFYING, "an eviction queue needs a Policy with an eviction_queue_type, see NotifyingPolicy");
+        _eviction_queue = &queue;
+    }
+
+    // Sets the queue the dirty entries are written back through: from then on, a put
+    // (or emplace) marks its entry dirty, and it's written back once it's evicted or
+    // expired, or flushed by flush_dirty (or clear, or the cache's destruction)
+    // It reserves the room to track the dirty ones, a handle for each entry the cache
+    // can hold, so it may throw bad_alloc, and the puts never allocate for them
+    // To be set before the cache is shared between threads. Needs a WriteBackPolicy
+    void set_write_back_queue(write_back_type& queue)
+    {
+        static_assert(WRITE_BACK, "a write-back queue needs a Policy with a write_back_type, see WriteBackPolicy");
+        _dirty_handles.reserve(static_cast<size_t>(_capacity));
+        _write_back = &queue;
+    }
+
+    // Writes the dirty entries back, each one the once however many times it's been
+    // put since it was last written, and holds them clean from then on. It goes over
+    // the dirty ones alone, so a flush with none to write back costs next to nothing
+    // Returns the no. of entries written back, none unless writing back
+    size_t flush_dirty() noexcept
+    {
+        size_t flushed = 0;
+        if constexpr ( WRITE_BACK )
+        {
+            for ( handle_type const dirty : _dirty_handles )
+            {
+                auto const &node = _lru_list.node(dirty);
+                held_of(node)._dirty_at = DirtyValue<Value>::CLEAN;
+                _write_back->write(node._key, value_of(node));
+            }
+            flushed = _dirty_handles.size();
+            _dirty_handles.clear();
+        }
+        return flushed;
+    }
+
+    // the no. of the dirty entries, yet to be written back
+    size_t dirty_count() const noexcept
+    {
+        if constexpr ( WRITE_BACK )
+        {
+            return _dirty_handles.size();
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    // Faults in the pages of the storage reserved for the Nodes yet to be added,
+    // so that the first fill doesn't take the page faults either (the map's slots
+    // are written, so faulted in, as they're zeroed in the constructor)
+    void warm_reserve() noexcept
+    {
+        _lru_list.warm_reserve();
+    }
+
+    // Returns the pointer to the value for the key, if the key exists, otherwise
+    // nullptr, without copying the value out. While doing so, moves the Node of the
+    // found key to the front of the list thus making it the MRU
+    // The pointer stays valid only until the next put, emplace or clear, which may
+    // evict the key or write over its value
+    // A tiered cache looks a miss up in the tier next, and puts the entry it has back
+    // (counted as a miss, and a put), which may throw
+    Value* get_ptr(const Key& key) noexcept(!TIERED)
+    {
+        return lookup_ptr<true>(key);
+    }
+
+    // Returns the pointer to the value for the key like get_ptr, if the cache holds it
+    // in memory, but neither looks a miss up in the tier nor counts it, so that the
+    // caller can go on to a get that does (as the async gets do) without it counted twice
+    Value* get_held_ptr(const Key& key) noexcept
+    {
+        return lookup_ptr<false>(key);
+    }
+
+    // Returns the value for the key, if the key exists. otherwise, returns an empty
+    // optional - so any value, -1 included, can be told apart from a miss
+    // While doing so, moves the Node of the found key to the front of the list
+    // thus making it the MRU
+    std::optional<Value> get(const Key& key) noexcept(std::is_nothrow_copy_constructible<Value>::value && !TIERED)
+    {
+        Value const *const value = get_ptr(key);
+
+        if ( nullptr == value )
+        {
+            return std::nullopt;
+        }
+
+        return *value;
+    }
+
+    // Returns the pointer to the value for the key like get_ptr, but leaves the recency order as is
+    const Value* peek_ptr(const Key& key) const noexcept
+    {
+        InstrumentedScope<instrument_type> timed(_instruments, CacheOp::Get);
+        auto const found = _lru_cache_map.find(key);
+        if ( (nullptr == found) || expired(_lru_list.node(*found)) ) // an expired one is left for the sweep
+        {
+            _stats.miss();
+            return nullptr;
+        }
+
+        _stats.hit();
+        timed.hit();
+        return &value_of(_lru_list.node(*found));
+    }
+
+    // Returns the value for the key like get, but leaves the recency order as is
+    std::optional<Value> peek(const Key& key) const noexcept(std::is_nothrow_copy_constructible<Value>::value)
+    {
+        Value const *const value = peek_ptr(key);
+
+        if ( nullptr == value )
+        {
+            return std::nullopt;
+        }
+
+        return *value;
+    }
+
+    // Makes the key the MRU, if it's still in the cache, without reading its value
+    void touch(const Key& key) noexcept
+    {
+        auto const found = _lru_cache_map.find(key);
+        if ( (nullptr != found) && !expired(_lru_list.node(*found)) )
+        {
+            _lru_list.move_to_front(*found);
+        }
+    }
+
+    // Same as put, but with the value for the key built in place from the given args
+    // Returns the reference to the value now held, valid until the next put or emplace
+    template <class... Args>
+    Value& emplace(const Key& key, Args&&... args)
+    {
+        return emplace_value(_lru_cache_map.home_slot(key), NEVER_EXPIRES, true, key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    Value& emplace(Key&& key, Args&&... args)
+    {
+        return emplace_value(_lru_cache_map.home_slot(key), NEVER_EXPIRES, true, std::move(key), std::forward<Args>(args)...);
+    }
+
+    // Returns the value for the key like get_ptr, and on a miss, puts loader(key) for
+    // it first. If the loader throws, nothing is put and the exception goes through
+    // The ConcurrentLRUCache's one has the concurrent misses of a key share one load
+    template <class Loader>
+    Value& get_or_compute(const Key& key, Loader&& loader)
+    {
+        Value *const value = get_ptr(key);
+        if ( nullptr != value )
+        {
+            return *value;
+        }
+
+        return fill(key, loader(key));
+    }
+
+    // Same as put, for a value just loaded from the store the cache is in front of,
+    // which a write-back cache then holds clean. Returns the value now held
+    Value& fill(const Key& key, const Value& value)
+    {
+        return emplace_value(_lru_cache_map.home_slot(key), NEVER_EXPIRES, false, key, value);
+    }
+
+    // Updates the value of the key if it exists, else adds it, evicting the LRU key
+    // when at capacity (see emplace_value above for the details). A write-back cache
+    // marks the entry dirty, to be written back later, however many times it's put
+    void put(const Key& key, const Value& value)
+    {
+        emplace_value(_lru_cache_map.home_slot(key), NEVER_EXPIRES, true, key, value);
+    }
+
+    // Same as above, with the key and the value moved into the cache instead of copied
+    void put(Key&& key, Value&& value)
+    {
+        emplace_value(_lru_cache_map.home_slot(key), NEVER_EXPIRES, true, std::move(key), std::move(value));
+    }
+
+    // Same as put, with the entry expiring once the ttl is up: from then on, it's a
+    // miss for the gets, and its memory is freed by the first get of it or by the
+    // sweep (see expire), whichever comes first. Needs an ExpiringPolicy
+    void put(const Key& key, const Value& value, std::chrono::milliseconds ttl)
+    {
+        emplace_value(_lru_cache_map.home_slot(key), deadline_after(ttl), true, key, value);
+    }
+
+    void put(Key&& key, Value&& value, std::chrono::milliseconds ttl)
+    {
+        uint64_t const deadline = deadline_after(ttl);
+        emplace_value(_lru_cache_map.home_slot(key), deadline, true, std::move(key), std::move(value));
+    }
+
+    // Sweeps the next max_slots slots of the map (round and round over the calls)
+    // for the expired entries, and frees them. Each put sweeps a few slots as well,
+    // so the expired entries go even without this being called, in the time it
+    // takes the puts to sweep the whole map - a slower rate of puts can be topped
+    // up by calling this from time to time. Returns the no. of entries freed
+    size_t expire(size_t max_slots)
+    {
+        static_assert(EXPIRING, "expire needs a Policy with a clock_type, see ExpiringPolicy");
+        return sweep_expired(max_slots);
+    }
+
+    // Writes the entries, from the MRU to the LRU one, to a snapshot file at the path
+    // (see SnapshotWriter), for load_snapshot to warm a cache up with after a restart
+    // The expired entries are left out, and the others keep the ms they have left
+    void save_snapshot(const std::string& path) const
+    {
+        SnapshotWriter writer(path);
+        write_snapshot(writer);
+        writer.commit();
+    }
+
+    // Adds the entries to a snapshot being written (a SnapshotWriter), or to a
+    // SnapshotBlock to be written later, as save_snapshot does
+    template <class Snapshot>
+    void write_snapshot(Snapshot& writer) const
+    {
+        uint64_t now = 0;
+        if constexpr ( EXPIRING )
+        {
+            now = _expiry._clock.now_ms();
+        }
+
+        visit_mru_to_lru(_lru_list, [&writer, now](const auto& node)
+        {
+            uint64_t ttl_ms = NEVER_EXPIRES;
+            if constexpr ( EXPIRING )
+            {
+                if ( NEVER_EXPIRES != node._value._deadline )
+                {
+                    if ( node._value._deadline <= now )
+                    {
+                        return;
+                    }
+                    ttl_ms = node._value._deadline - now;
+                }
+            }
+            writer.add(node._key, value_of(node), ttl_ms);
+        });
+    }
+
+    // Replaces the entries with those of a snapshot file (see save_snapshot), the MRU
+    // ones of them that fit, all in their saved recency order. The file is memory
+    // mapped, and its entries are decoded and added LRU first (see restore) a block
+    // at a time, without going through put. Returns the no. of entries loaded
+    // A file that isn't a whole snapshot throws a runtime_error before the cache is
+    // touched, while an entry that doesn't decode throws one leaving it empty
+    // The Key and the Value need to be default constructible, to decode into
+    size_t load_snapshot(const std::string& path)
+    {
+        SnapshotReader const reader(path);
+        clear();
+
+        // a block of entries at a time is decoded, with the loads of their home slots
+        // started, before they're added, as in multi_put
+        Key keys[MULTI_OP_BLOCK];
+        Value values[MULTI_OP_BLOCK];
+        uint64_t ttls[MULTI_OP_BLOCK];
+        size_t homes[MULTI_OP_BLOCK];
+
+        try
+        {
+            for ( size_t end = std::min(reader.size(), static_cast<size_t>(_capacity)); 0 < end; )
+            {
+                size_t const block = std::min(MULTI_OP_BLOCK, end);
+                for ( size_t i = 0; i < block; ++i )
+                {
+                    reader.read(end - 1 - i, keys[i], values[i], ttls[i]);
+                    homes[i] = _lru_cache_map.home_slot(keys[i]);
+                    _lru_cache_map.prefetch(homes[i]);
+                }
+
+                for ( size_t i = 0; i < block; ++i )
+                {
+                    restore_entry(homes[i], std::move(keys[i]), std::move(values[i]), ttls[i]);
+                }
+                end -= block;
+            }
+        }
+        catch ( ... )
+        {
+            clear();
+            throw;
+        }
+
+        return _lru_list.size();
+    }
+
+    // Adds an entry of a snapshot as the MRU one, unless the key is held already,
+    // evicting the victim when at capacity (or over the weight budget), without the
+    // update path, the sweep or the put stats of a put. ttl_ms is the ms it had left
+    // (NEVER_EXPIRES for ever), counted from now. Returns whether it was added
+    bool restore(Key&& key, Value&& value, uint64_t ttl_ms)
+    {
+        return restore_entry(_lru_cache_map.home_slot(key), std::move(key), std::move(value), ttl_ms);
+    }
+
+    // Looks up the keys (all count of them, or only the ones at the given positions)
+    // in one go, setting values[i] to the value of keys[i] or to empty for a miss,
+    // and returns the no. of hits. Found keys are made the MRU, in order
+    // Rather than one get after the other, which waits out the cache miss on each
+    // key's slot and then its Node in turn, a block of keys is hashed up front with
+    // the loads of their slots started, then probed, with the loads of the found
+    // Nodes started, and only then are the values read, so the misses overlap
+    // A tiered cache looks the misses up in the tier after the whole batch
+    size_t multi_get(const Key* keys, size_t count, std::optional<Value>* values)
+    {
+        auto const pick = [](size_t i) { return i; };
+        size_t const hits = multi_lookup<true>(*this, keys, pick, count, values);
+        return hits + promote_misses(keys, pick, count, values);
+    }
+
+    size_t multi_get(const Key* keys, const size_t* positions, size_t count, std::optional<Value>* values)
+    {
+        auto const pick = [positions](size_t i) { return positions[i]; };
+        size_t const hits = multi_lookup<true>(*this, keys, pick, count, values);
+        return hits + promote_misses(keys, pick, count, values);
+    }
+
+    // Same as multi_get, but leaves the recency order as is
+    size_t multi_peek(const Key* keys, size_t count, std::optional<Value>* values) const
+    {
+        return multi_lookup<false>(*this, keys, [](size_t i) { return i; }, count, values);
+    }
+
+    size_t multi_peek(const Key* keys, const size_t* positions, size_t count, std::optional<Value>* values) const
+    {
+        return multi_lookup<false>(*this, keys, [positions](size_t i) { return positions[i]; }, count, values);
+    }
+
+    // Puts values[i] for keys[i] (all count of them, or only the ones at the given
+    // positions), same as a put of each in order, but with the slots of a block of
+    // keys hashed and loaded up front. If a put throws, the ones before it stay put
+    void multi_put(const Key* keys, const Value* values, size_t count)
+    {
+        multi_store([keys](size_t i) -> const Key& { return keys[i]; },
+                    [values](size_t i) -> const Value& { return values[i]; }, count);
+    }
+
+    void multi_put(const Key* keys, const Value* values, const size_t* positions, size_t count)
+    {
+        multi_store([keys, positions](size_t i) -> const Key& { return keys[positions[i]]; },
+                    [values, positions](size_t i) -> const Value& { return values[positions[i]]; }, count);
+    }
+
+    // Same as multi_put, of the entries at the positions of a random access range of
+    // pairs of a key and a value (entries[positions[i]].first and .second)
+    template <class Iterator>
+    void multi_put_entries(Iterator entries, const size_t* positions, size_t count)
+    {
+        multi_store([&entries, positions](size_t i) -> const Key& { return entries[positions[i]].first; },
+                    [&entries, positions](size_t i) -> const Value& { return entries[positions[i]].second; }, count);
+    }
+
+    // Calls visit(key, value) for each of the entries, from the MRU to the LRU one,
+    // leaving the recency order as is. The expired ones are skipped, as with peek,
+    // and so are those demoted to the tier. visit shouldn't call back into the cache
+    template <class Visit>
+    void for_each(Visit&& visit) const
+    {
+        visit_mru_to_lru(_lru_list, [this, &visit](const auto& node)
+        {
+            if ( !expired(node) )
+            {
+                visit(static_cast<const Key&>(node._key), static_cast<const Value&>(value_of(node)));
+            }
+        });
+    }
+
+    // Erases the entries for which pred(key, value) holds, and returns their no.
+    // They're erased, not evicted: a dirty one is written back, but none is demoted to
+    // the tier or put on the eviction queue, nor counted as an eviction. The expired
+    // ones are left for the sweep, as with for_each
+    template <class Pred>
+    size_t erase_if(Pred&& pred)
+    {
+        // the keys are picked first, as an erase may move the Nodes (of a vector) around
+        std::vector<Key> erased;
+        for_each([&erased, &pred](const Key& key, const Value& value)
+        {
+            if ( pred(key, value) )
+            {
+                erased.push_back(key);
+            }
+        });
+
+        for ( Key const &key : erased )
+        {
+            remove_entry(*_lru_cache_map.find(key));
+        }
+        return erased.size();
+    }
+
+    constexpr size_t capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    constexpr size_t size() const noexcept
+    {
+        return _lru_list.size(); // return the size of the underlying list    
+    }
+
+    // the total weight of the entries held, just their no. when they aren't weighed
+    size_t weight() const noexcept
+    {
+        if constexpr ( WEIGHTED )
+        {
+            return _weights._total;
+        }
+        else
+        {
+            return size();
+        }
+    }
+
+    // the budget of the total weight, just the capacity when they aren't weighed
+    size_t weight_budget() const noexcept
+    {
+        if constexpr ( WEIGHTED )
+        {
+            return _weights._budget;
+        }
+        else
+        {
+            return capacity();
+        }
+    }
+
+    void clear() noexcept
+    {
+        flush_dirty(); // a write-back cache writes the dirty ones back first
+        _lru_cache_map.clear(); // clear the map
+        _lru_list.clear(); // and hand all the Nodes back to the list's allocator at once
+        _stats.clear_bytes();
+        if constexpr ( WEIGHTED )
+        {
+            _weights._total = 0;
+        }
+        if constexpr ( EXPIRING )
+        {
+            _expiry._swept = 0;
+        }
+        if constexpr ( TIERED )
+        {
+            if ( nullptr != _tier )
+            {
+                _tier->clear(this); // its own demoted entries, not those of the caches sharing the tier
+            }
+        }
+    }
+
+    // The counters of the hits, misses, puts, updates, evictions and bytes held, all
+    // zero unless the Policy has a stats_type that counts them (see CountedPolicy)
+    CacheStats stats() const noexcept
+    {
+        return _stats.snapshot();
+    }
+
+    // The histogram of the sampled latencies of the op, in ticks (see ticks_per_ns),
+    // empty unless the Policy has an instrument_type that times them (see InstrumentedPolicy)
+    LatencySnapshot latencies(CacheOp op) const
+    {
+        return _instruments.latencies(op);
+    }
+
+    // Has the hook called with the context after every op, or no more if nullptr
+    void set_trace_hook(CacheTraceHook hook, void *context = nullptr) noexcept
+    {
+        _instruments.set_trace_hook(hook, context);
+    }
+
+    // again, to write the internal state to the output stream to check results
+    template <class K, class V, class H, class P>
+    friend ostream& operator<< (ostream& os, const LRUCache<K, V, H, P>& cache);
+};
+
+// just call out to the underlying list to do the job
+template <class Key, class Value, class Hash, class Policy>
+ostream& operator<< (ostream& os, const LRUCache<Key, Value, Hash, Policy>& cache)
+{
+    return os << cache._lru_list;
+/*
+    os << "{";
+
+    for ( auto const &iter : cache._lru_cache_map  )
+    {
+        os << "[" << iter.first << "=" << iter.second->_value << "], ";
+    }
+
+    return os << "}";
+*/
+}
+
+// A Node of a FixedLRUCache, linked by the slots of its neighbours in the cache's
+// array, in as few bits as the N slots and the NIL past them need
+template <class Key, class Value, class Link>
+struct FixedListNode
+{
+    Key _key{};
+    Value _value{};
+    Link _prev{0};
+    Link _next{0};
+};
+
+// the smallest unsigned type that holds the slots 0 ... N - 1 and a NIL after them
+template <size_t N>
+using fixed_link_t = typename std::conditional<(N < UINT8_MAX), uint8_t,
+                     typename std::conditional<(N < UINT16_MAX), uint16_t, uint32_t>::type>::type;
+
+// An LRU cache of a capacity N fixed at compile time, for the small caches on the
+// latency critical paths, all of whose storage lives inside the object itself, so
+// that it can be embedded in another one, or be thread_local, and never allocates
+// (nor frees) anything of its own, not even when it's constructed:
+//   1. the Nodes are a std::array of N, filled in order and kept dense (an erase
+//      moves the last Node into the freed slot), and linked by their slots
+//   2. up to LINEAR_MAX entries, there's no hash table at all: a key's mixed hash
+//      gives it a 7-bit tag, kept in a std::array of the Nodes' tags, and a lookup
+//      matches a whole TagGroup of those at a time (32 or 16 with SIMD), and only
+//      compares the keys of the Nodes whose tags match
+//   3. past that, the keys are mapped to their Nodes by a TagHashIndex carved out
+//      of an InlineRegion, sized for N at compile time
+// The Key and the Value need to be default constructible (the Nodes not filled yet
+// hold the default ones) and nothrow movable. Copying the key or building the value
+// can still throw, and leaves the cache as it was, but nothing past that does
+template <class Key, class Value, size_t N, class Hash = std::hash<Key>>
+class FixedLRUCache
+{
+    static_assert((N > 0) && (N < UINT32_MAX), "FixedLRUCache holds 1 to 2^32 - 2 entries");
+    static_assert(std::is_default_constructible<Key>::value && std::is_default_constructible<Value>::value,
+                  "FixedLRUCache holds default built Keys and Values in the Nodes not filled yet");
+    static_assert(std::is_nothrow_move_assignable<Key>::value && std::is_nothrow_move_assignable<Value>::value,
+                  "FixedLRUCache moves the new entry into the reused Node, which must not throw");
+
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using link_type = fixed_link_t<N>;
+    using node_type = FixedListNode<Key, Value, link_type>;
+
+    // the most entries looked up by their tags alone, with no hash table
+    static constexpr size_t LINEAR_MAX = 64;
+
+  private:
+    static constexpr bool LINEAR = ( N <= LINEAR_MAX );
+    static constexpr link_type NIL = static_cast<link_type>(N);
+    // the tags of the Nodes, padded out to whole TagGroups, TAG_EMPTY past the last Node
+    using tag_array = std::array<int8_t, (N + TagGroup::WIDTH - 1) / TagGroup::WIDTH * TagGroup::WIDTH>;
+    using index_type = TagHashIndex<Key, link_type, Hash, InlineRegion<TagHashIndex<Key, link_type, Hash>::region_bytes(N)>>;
+
+    std::array<node_type, N> _nodes;
+    typename std::conditional<LINEAR, tag_array, index_type>::type _index;
+    LRUCACHE_NO_UNIQUE_ADDRESS Hash _hash;
+    link_type _front{NIL}; // slot of the MRU Node
+    link_type _back{NIL}; // slot of the LRU Node
+    link_type _size{0};
+
+    static auto make_index(const Hash& hash)
+    {
+        if constexpr ( LINEAR )
+        {
+            tag_array tags;
+            tags.fill(TAG_EMPTY);
+            return tags;
+        }
+        else
+        {
+            return index_type(N, hash);
+        }
+    }
+
+    // the tag of the key, for the linear lookup, or else its home slot in the index
+    size_t home_of(const Key& key) const noexcept
+    {
+        if constexpr ( LINEAR )
+        {
+            return static_cast<size_t>(mix_hash(static_cast<uint64_t>(_hash(key))) >> 57);
+        }
+        else
+        {
+            return _index.home_slot(key);
+        }
+    }
+
+    // the slot of the key's Node, or NIL if it isn't held
+    link_type find(const Key& key, size_t home) const noexcept
+    {
+        if constexpr ( LINEAR )
+        {
+            for ( size_t group = 0; group < _size; group += TagGroup::WIDTH )
+            {
+                TagGroup const tags(_index.data() + group);
+                for ( uint64_t matched = tags.match(static_cast<int8_t>(home)); 0 != matched; matched &= matched - 1 )
+                {
+                    size_t const slot = group + (lowest_bit(matched) >> TagGroup::LANE_SHIFT);
+                    if ( _nodes[slot]._key == key )
+                    {
+                        return static_cast<link_type>(slot);
+                    }
+                }
+            }
+            return NIL;
+        }
+        else
+        {
+            link_type const *const found = _index.find(key, home);
+            return ( nullptr == found ) ? NIL : *found;
+        }
+    }
+
+    void unlink(link_type slot) noexcept
+    {
+        node_type const &node = _nodes[slot];
+        (NIL == node._prev ? _front : _nodes[node._prev]._next) = node._next;
+        (NIL == node._next ? _back : _nodes[node._next]._prev) = node._prev;
+    }
+
+    void link_front(link_type slot) noexcept
+    {
+        _nodes[slot]._prev = NIL;
+        _nodes[slot]._next = _front;
+        (NIL == _front ? _back : _nodes[_front]._prev) = slot;
+        _front = slot;
+    }
+
+    void move_to_front(link_type slot) noexcept
+    {
+        if ( _front != slot )
+        {
+            unlink(slot);
+            link_front(slot);
+        }
+    }
+
+  public:
+    explicit FixedLRUCache(const Hash& hash = Hash())
+     : _index(make_index(hash)),
+       _hash(hash)
+    { }
+
+    FixedLRUCache(const FixedLRUCache&) = delete;
+    FixedLRUCache& operator=(const FixedLRUCache&) = delete;
+
+    // Returns the pointer to the value for the key, or nullptr if it isn't held, and
+    // makes the key the MRU. The pointer stays valid until the next put, emplace,
+    // erase or clear
+    Value* get_ptr(const Key& key) noexcept
+    {
+        link_type const slot = find(key, home_of(key));
+        if ( NIL == slot )
+        {
+            return nullptr;
+        }
+
+        move_to_front(slot);
+        return &_nodes[slot]._value;
+    }
+
+    // Returns the value for the key, or an empty optional on a miss, and makes it the MRU
+    std::optional<Value> get(const Key& key) noexcept(std::is_nothrow_copy_constructible<Value>::value)
+    {
+        Value const *const value = get_ptr(key);
+
+        if ( nullptr == value )
+        {
+            return std::nullopt;
+        }
+
+        return *value;
+    }
+
+    // Returns the pointer to the value for the key like get_ptr, but leaves the recency order as is
+    const Value* peek_ptr(const Key& key) const noexcept
+    {
+        link_type const slot = find(key, home_of(key));
+        return ( NIL == slot ) ? nullptr : &_nodes[slot]._value;
+    }
+
+    std::optional<Value> peek(const Key& key) const noexcept(std::is_nothrow_copy_constructible<Value>::value)
+    {
+        Value const *const value = peek_ptr(key);
+
+        if ( nullptr == value )
+        {
+            return std::nullopt;
+        }
+
+        return *value;
+    }
+
+    // Updates the value of the key if it's held, else adds it as the MRU, in the LRU
+    // one's Node when at capacity, with the value built from the args. The key and
+    // the value are built aside first, so if either throws, the cache is as it was
+    // Returns the reference to the value now held
+    template <class K, class... Args>
+    Value& emplace(K&& key, Args&&... args)
+    {
+        size_t const home = home_of(key);
+        link_type slot = find(key, home);
+        if ( NIL != slot )
+        {
+            _nodes[slot]._value = Value(std::forward<Args>(args)...);
+            move_to_front(slot);
+            return _nodes[slot]._value;
+        }
+
+        Key added(std::forward<K>(key));
+        Value value(std::forward<Args>(args)...);
+        link_type *handle = nullptr;
+        if constexpr ( !LINEAR )
+        {
+            handle = _index.try_emplace(added, NIL, home).first; // the one copy of the key that may throw
+        }
+
+        if ( N == _size ) // evict the LRU key, and reuse its Node
+        {
+            slot = _back;
+            unlink(slot);
+            if constexpr ( !LINEAR )
+            {
+                _index.erase(_nodes[slot]._key); // which leaves the new key's handle where it is
+            }
+        }
+        else
+        {
+            slot = _size++;
+        }
+
+        if constexpr ( LINEAR )
+        {
+            _index[slot] = static_cast<int8_t>(home);
+        }
+        else
+        {
+            *handle = slot;
+        }
+        _nodes[slot]._key = std::move(added);
+        _nodes[slot]._value = std::move(value);
+        link_front(slot);
+        return _nodes[slot]._value;
+    }
+
+    void put(const Key& key, const Value& value)
+    {
+        emplace(key, value);
+    }
+
+    void put(Key&& key, Value&& value)
+    {
+        emplace(std::move(key), std::move(value));
+    }
+
+    // Removes the key, if it's held, moving the last Node into the slot it frees
+    // Returns whether it was held
+    bool erase(const Key& key) noexcept
+    {
+        link_type const slot = find(key, home_of(key));
+        if ( NIL == slot )
+        {
+            return false;
+        }
+
+        unlink(slot);
+        if constexpr ( !LINEAR )
+        {
+            _index.erase(key);
+        }
+
+        link_type const last = --_size;
+        if ( slot != last )
+        {
+            node_type &moved = _nodes[slot];
+            moved = std::move(_nodes[last]);
+            (NIL == moved._prev ? _front : _nodes[moved._prev]._next) = slot;
+            (NIL == moved._next ? _back : _nodes[moved._next]._prev) = slot;
+            if constexpr ( LINEAR )
+            {
+                _index[slot] = _index[last];
+            }
+            else
+            {
+                *_index.find(moved._key) = slot;
+            }
+        }
+
+        // lets go of whatever the last Node's key and value hold on to
+        _nodes[last]._key = Key();
+        _nodes[last]._value = Value();
+        if constexpr ( LINEAR )
+        {
+            _index[last] = TAG_EMPTY;
+        }
+        return true;
+    }
+
+    static constexpr size_t capacity() noexcept
+    {
+        return N;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    void clear() noexcept
+    {
+        for ( size_t slot = 0; slot < _size; ++slot )
+        {
+            _nodes[slot]._key = Key();
+            _nodes[slot]._value = Value();
+        }
+
+        if constexpr ( LINEAR )
+        {
+            _index.fill(TAG_EMPTY);
+        }
+        else
+        {
+            _index.clear();
+        }
+        _front = _back = NIL;
+        _size = 0;
+    }
+
+    // Calls visit(key, value) for each of the entries, from the MRU to the LRU one
+    template <class Visit>
+    void for_each(Visit&& visit) const
+    {
+        for ( link_type slot = _front; slot != NIL; slot = _nodes[slot]._next )
+        {
+            visit(static_cast<const Key&>(_nodes[slot]._key), static_cast<const Value&>(_nodes[slot]._value));
+        }
+    }
+};
+
+// Write the entries from the MRU to the LRU one, as the other caches do
+template <class Key, class Value, size_t N, class Hash>
+ostream& operator<< (ostream& os, const FixedLRUCache<Key, Value, N, Hash>& cache)
+{
+    os << "{";
+
+    bool first = true;
+    cache.for_each([&os, &first](const Key& key, const Value& value)
+    {
+        os << (first ? "" : ", ") << key << "=" << value;
+        first = false;
+    });
+
+    return os << "}";
+}
+
+// How the ConcurrentLRUCache brings a Node to the front on a get hit
+enum class RecencyPromotion
+{
+    Immediate, // move_to_front right away, under the shard's lock held exclusively
+    Deferred   // record the hit, and replay the hits to the list in batches later
+};
+
+// Records the keys of the get hits of a shard from many threads at once, to be
+// replayed to the shard's list in a batch by whoever holds the shard's lock
+// exclusively next (as Caffeine and BP-Wrapper do)
+// The records are spread across a few stripes picked by the thread, each a small
+// ring of slots, so the threads mostly don't write to the same cache lines.
+// The buffer is lossy: a hit is dropped if its stripe is full or another thread
+// raced for the same slot, which only leaves the recency order a bit less exact
+template <class Key>
+class AccessRecordBuffer
+{
+    static constexpr size_t STRIPES = 4;
+    static constexpr uint32_t SLOTS = 64; // per stripe, a power of 2
+    static constexpr uint32_t DRAIN_THRESHOLD = SLOTS / 2;
+
+    struct Record
+    {
+        std::atomic<bool> _recorded{false}; // published once the key is stored
+        Key _key{};
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Stripe
+    {
+        std::atomic<uint32_t> _write{0}; // next slot to record into
+        std::atomic<uint32_t> _read{0}; // next slot to replay, moved only by the drain
+        Record _records[SLOTS];
+    };
+
+    Stripe _stripes[STRIPES];
+
+    // the stripe of the calling thread, worked out once per thread
+    static size_t thread_stripe() noexcept
+    {
+        thread_local size_t const stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % STRIPES;
+        return stripe;
+    }
+
+  public:
+    // Records a hit for the key, never blocks
+    // Returns true when the stripe is full enough that it's worth draining now
+    bool record(const Key& key) noexcept
+    {
+        Stripe &stripe = _stripes[thread_stripe()];
+        uint32_t write = stripe._write.load(std::memory_order_relaxed);
+        // acquire, so the drain is done with the slots it has moved past
+        uint32_t const read = stripe._read.load(std::memory_order_acquire);
+
+        if ( write - read >= SLOTS ) // full, drop this one and ask for a drain
+        {
+            return true;
+        }
+
+        if ( !stripe._write.compare_exchange_strong(write, write + 1, std::memory_order_relaxed) )
+        {
+            return false; // another thread took the slot, drop this one
+        }
+
+        Record &record = stripe._records[write % SLOTS];
+        try
+        {
+            record._key = key;
+        }
+        catch ( ... ) // the stale key left in the slot is only a wrong promotion hint
+        { }
+        record._recorded.store(true, std::memory_order_release);
+
+        return ( write + 1 - read ) >= DRAIN_THRESHOLD;
+    }
+
+    // Replays the recorded keys, oldest first per stripe, to the given promote(key)
+    // Has to be called with the shard's lock held exclusively, so one drain at a time
+    template <class Promote>
+    void drain(Promote &&promote) noexcept
+    {
+        for ( Stripe &stripe : _stripes )
+        {
+            uint32_t read = stripe._read.load(std::memory_order_relaxed);
+            uint32_t const write = stripe._write.load(std::memory_order_acquire);
+
+            for ( ; read != write; ++read )
+            {
+                Record &record = stripe._records[read % SLOTS];
+                if ( !record._recorded.load(std::memory_order_acquire) ) // taken, but not stored yet
+                {
+                    break; // so pick up from here on the next drain
+                }
+                promote(record._key);
+                record._recorded.store(false, std::memory_order_relaxed);
+            }
+
+            stripe._read.store(read, std::memory_order_release);
+        }
+    }
+};
+
+// Stands in for the AccessRecordBuffer in the shards that promote immediately
+struct NoAccessRecordBuffer
+{ };
+
+// Runs task(i) for each i in [0, tasks) on threads threads, the calling one among
+// them. Each thread takes the tasks of a run of its own first, and then steals the
+// ones left in the runs of the others, so that the threads done early take over from
+// those held up on heavy tasks (the shards with the most keys, say). The first
+// exception a task throws is rethrown once all the threads are done, the tasks that
+// hadn't started by then being skipped. If a thread can't be started, the others
+// steal its run, the caller alone doing all of the tasks at worst
+template <class Task>
+void run_work_stealing(size_t tasks, unsigned threads, Task&& task)
+{
+    if ( 0 == tasks )
+    {
+        return;
+    }
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, tasks)));
+
+    // a run's next task is taken by its owner and the thieves alike, with a fetch_add
+    struct alignas(CACHE_LINE_SIZE) Run
+    {
+        std::atomic<size_t> _next;
+        size_t _end;
+    };
+    std::unique_ptr<Run[]> const runs(new Run[threads]);
+    for ( unsigned t = 0; t < threads; ++t )
+    {
+        runs[t]._next.store(tasks * t / threads, std::memory_order_relaxed);
+        runs[t]._end = tasks * (t + 1) / threads;
+    }
+
+    std::atomic<bool> failed{false};
+    std::exception_ptr failure;
+    std::mutex failure_lock;
+    auto const work = [&](unsigned self) noexcept
+    {
+        for ( unsigned k = 0; k < threads; ++k ) // its own run, then the others' in turn
+        {
+            Run &run = runs[(self + k) % threads];
+            while ( !failed.load(std::memory_order_relaxed) )
+            {
+                size_t const i = run._next.fetch_add(1, std::memory_order_relaxed);
+                if ( i >= run._end )
+                {
+                    break;
+                }
+                try
+                {
+                    task(i);
+                }
+                catch ( ... )
+                {
+                    std::lock_guard<std::mutex> guard(failure_lock);
+                    if ( !failure )
+                    {
+                        failure = std::current_exception();
+                    }
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for ( unsigned t = 1; t < threads; ++t )
+    {
+        try
+        {
+            workers.emplace_back(work, t);
+        }
+        catch ( const std::system_error& )
+        {
+            break;
+        }
+    }
+    work(0);
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+
+    if ( failure )
+    {
+        std::rethrow_exception(failure);
+    }
+}
+
+#ifdef LRUCACHE_HAS_COROUTINES
+// The awaitables of ConcurrentLRUCache's async_get, async_get_or_compute and async_put
+// (C++20), co_awaited by the caller's coroutine. None is a coroutine itself, so none
+// allocates a frame: a hit on an entry held in memory completes in await_ready, with
+// no suspension, and it's only a miss that would block - on the tier, or the loader -
+// that suspends the caller and calls executor(task), with a task that makes the call
+// and then resumes the caller on whichever thread the executor ran the task on
+// The task is a small copyable callable, which the executor must run exactly once
+template <class Cache, class Executor>
+class [[nodiscard]] AsyncGet
+{
+    using key_type = typename Cache::key_type;
+    using mapped_type = typename Cache::mapped_type;
+
+    // a cache that isn't tiered has no miss to wait on
+    static constexpr bool TIERED = !std::is_same<typename Cache::shard_type::tier_type, NoFlashTier>::value;
+
+    Cache &_cache;
+    key_type _key;
+    Executor _executor;
+    std::optional<mapped_type> _value;
+    std::exception_ptr _error;
+
+  public:
+    AsyncGet(Cache& cache, const key_type& key, Executor executor)
+     : _cache(cache), _key(key), _executor(std::move(executor))
+    { }
+
+    bool await_ready()
+    {
+        if constexpr ( TIERED )
+        {
+            _value = _cache.get_held(_key);
+            return _value.has_value();
+        }
+        else
+        {
+            _value = _cache.get(_key);
+            return true;
+        }
+    }
+
+    void await_suspend(std::coroutine_handle<> caller)
+    {
+        _executor([this, caller]()
+        {
+            try
+            {
+                _value = _cache.get(_key);
+            }
+            catch ( ... )
+            {
+                _error = std::current_exception();
+            }
+            caller.resume();
+        });
+    }
+
+    std::optional<mapped_type> await_resume()
+    {
+        if ( _error )
+        {
+            std::rethrow_exception(_error);
+        }
+        return std::move(_value);
+    }
+};
+
+template <class Cache, class Loader, class Executor>
+class [[nodiscard]] AsyncGetOrCompute
+{
+    using key_type = typename Cache::key_type;
+    using mapped_type = typename Cache::mapped_type;
+
+    Cache &_cache;
+    key_type _key;
+    Loader _loader;
+    Executor _executor;
+    std::optional<mapped_type> _value;
+    std::exception_ptr _error;
+
+  public:
+    AsyncGetOrCompute(Cache& cache, const key_type& key, Loader loader, Executor executor)
+     : _cache(cache), _key(key), _loader(std::move(loader)), _executor(std::move(executor))
+    { }
+
+    bool await_ready()
+    {
+        _value = _cache.get_held(_key);
+        return _value.has_value();
+    }
+
+    void await_suspend(std::coroutine_handle<> caller)
+    {
+        _executor([this, caller]()
+        {
+            try
+            {
+                _value.emplace(_cache.get_or_compute(_key, _loader));
+            }
+            catch ( ... )
+            {
+                _error = std::current_exception();
+            }
+            caller.resume();
+        });
+    }
+
+    mapped_type await_resume()
+    {
+        if ( _error )
+        {
+            std::rethrow_exception(_error);
+        }
+        return std::move(*_value);
+    }
+};
+
+// A put never waits on anything but the shard's lock, so it's always done inline
+template <class Cache>
+class [[nodiscard]] AsyncPut
+{
+    using key_type = typename Cache::key_type;
+    using mapped_type = typename Cache::mapped_type;
+
+    Cache &_cache;
+    key_type _key;
+    mapped_type _value;
+
+  public:
+    AsyncPut(Cache& cache, key_type key, mapped_type value)
+     : _cache(cache), _key(std::move(key)), _value(std::move(value))
+    { }
+
+    bool await_ready() const noexcept
+    {
+        return true;
+    }
+
+    void await_suspend(std::coroutine_handle<>) const noexcept
+    { }
+
+    void await_resume()
+    {
+        _cache.put(std::move(_key), std::move(_value));
+    }
+};
+#endif
+
+// A thread safe LRUCache which splits the keys across N independently locked
+// LRUCache shards, so that threads working on different shards never wait on
+// each other. A reader/writer lock on a single LRUCache wouldn't help here, as
+// every get mutates the list by moving the found Node to the front.
+// The capacity is split evenly across the shards, so the recency order (and the
+// eviction) is LRU within each shard, and approximately LRU across the whole cache
+// With RecencyPromotion::Deferred, a get only takes the shard's lock in shared
+// mode to look the key up and records the hit in the shard's AccessRecordBuffer,
+// so concurrent gets on a shard don't serialize and the list isn't written on a hit
+// The recorded hits are replayed in a batch by the next put on the shard, or by
+// the get that fills its stripe up, if it gets the lock without waiting
+template <class Key, class Value, class Hash = std::hash<Key>, class Policy = LinkedLRUPolicy,
+          RecencyPromotion Promotion = RecencyPromotion::Immediate>
+class ConcurrentLRUCache
+{
+    static constexpr bool DEFERRED = ( RecencyPromotion::Deferred == Promotion );
+
+    using lock_type = typename std::conditional<DEFERRED, std::shared_mutex, std::mutex>::type;
+    using access_buffer_type = typename std::conditional<DEFERRED, AccessRecordBuffer<Key>,
+                                                         NoAccessRecordBuffer>::type;
+
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using shard_type = LRUCache<Key, Value, Hash, Policy>;
+
+  private:
+    // a shard is padded out to its own cache lines, so that the lock of one
+    // shard doesn't share a line with the lock or the list ends of the next
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+        mutable lock_type _lock;
+        shard_type _cache;
+        access_buffer_type _accesses; // the get hits yet to be replayed, when deferred
+        std::unordered_map<Key, std::shared_future<Value>, Hash> _loads; // of get_or_compute, under way
+        SnapshotBlock _snapshot; // the entries of the snapshot under way, once taken
+        bool _snapshot_pending{false}; // whether the snapshot under way is yet to take them
+        std::exception_ptr _snapshot_error; // of taking them, if that threw
+
+        // Takes the entries for the snapshot under way, if it's yet to, with the lock
+        // held exclusively, ahead of any change to them (see save_snapshot), so they
+        // are as of the point in time the snapshot was started at
+        void take_snapshot() noexcept
+        {
+            if ( _snapshot_pending )
+            {
+                _snapshot_pending = false;
+                try
+                {
+                    _cache.write_snapshot(_snapshot);
+                }
+                catch ( ... )
+                {
+                    _snapshot.clear();
+                    _snapshot_error = std::current_exception();
+                }
+            }
+        }
+
+        // replays the recorded hits to the list, with the lock held exclusively, the
+        // entries taken for a snapshot under way first, as each op that drains changes them
+        void drain_accesses() noexcept
+        {
+            take_snapshot();
+            if constexpr ( DEFERRED )
+            {
+                _accesses.drain([this](const Key& key) { _cache.touch(key); });
+            }
+        }
+
+        Shard(int capacity, const Hash& hash)
+         : _cache(capacity, hash), _loads(0, hash)
+        { }
+
+        Shard(int capacity, WeightBudget budget, const Hash& hash)
+         : _cache(capacity, budget, hash), _loads(0, hash)
+        { }
+
+        Shard(int capacity, typename shard_type::tier_type& tier, const Hash& hash)
+         : _cache(capacity, tier, hash), _loads(0, hash)
+        { }
+    };
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    Hash _hash;
+    // taken by save_snapshot throughout, as the shards hold the state of one snapshot
+    mutable std::mutex _snapshot_lock;
+
+    // a mixer of its own over the key's hash for picking the shard (murmur3's 64-bit
+    // finalizer), so that the keys of a shard don't all share the top bits the
+    // FlatHashIndex hashes by
+    size_t shard_index(const Key& key) const noexcept
+    {
+        uint64_t hash = static_cast<uint64_t>(_hash(key));
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return static_cast<size_t>(hash % _shards.size());
+    }
+
+    Shard& shard_for(const Key& key) const noexcept
+    {
+        return *_shards[shard_index(key)];
+    }
+
+    // Sorts the positions of the keys of a batch by their shard (a counting sort),
+    // so that each shard's part of the batch can be done under one take of its lock
+    // Returns the positions, with those of the s-th shard from starts[s] to starts[s + 1]
+    std::vector<size_t> positions_by_shard(const Key* keys, size_t count, std::vector<size_t> &starts) const
+    {
+        std::vector<size_t> shard_of(count);
+        starts.assign(_shards.size() + 1, 0);
+        for ( size_t i = 0; i < count; ++i )
+        {
+            shard_of[i] = shard_index(keys[i]);
+            ++starts[shard_of[i] + 1];
+        }
+
+        for ( size_t s = 1; s <= _shards.size(); ++s )
+        {
+            starts[s] += starts[s - 1];
+        }
+
+        std::vector<size_t> positions(count);
+        std::vector<size_t> next(starts.begin(), starts.end() - 1);
+        for ( size_t i = 0; i < count; ++i )
+        {
+            positions[next[shard_of[i]]++] = i;
+        }
+
+        return positions;
+    }
+
+    // The NUMA node the s-th shard's memory is bound to, the shards being split into
+    // as many runs as there are nodes, or -1 on a host of just the one node
+    // It's the HugePageRegions of a shard that are bound, as of a HugePageLRUPolicy
+    static int shard_numa_node(size_t s, size_t shard_count) noexcept
+    {
+        size_t const nodes = numa_node_count();
+        return ( 1 < nodes ) ? static_cast<int>(s * nodes / shard_count) : -1;
+    }
+
+    // no. of shards to use when not given: one per hardware thread
+    static size_t default_shard_count() noexcept
+    {
+        unsigned const hardware_threads = std::thread::hardware_concurrency();
+        return ( 0 == hardware_threads ) ? 1 : hardware_threads;
+    }
+
+  public:
+    // Each of the shard_count shards gets an equal part of the capacity, rounded up
+    // There are never more shards than the capacity, so each shard holds a key at least
+    explicit ConcurrentLRUCache(int capacity, size_t shard_count = default_shard_count(),
+                                const Hash& hash = Hash())
+     : _hash(hash)
+    {
+        if ( 0 >= capacity )
+        {
+            throw InvalidCapacityException; // capacity cannot be negative
+        }
+
+        shard_count = std::max<size_t>(1, std::min<size_t>(shard_count, capacity));
+        int const shard_capacity = static_cast<int>((capacity + shard_count - 1) / shard_count);
+
+        _shards.reserve(shard_count);
+        for ( size_t i = 0; i < shard_count; ++i )
+        {
+            NumaNodeScope const on_node(shard_numa_node(i, shard_count));
+            _shards.emplace_back(new Shard(shard_capacity, hash));
+        }
+    }
+
+    // A weighted one, each shard also getting an equal part of the budget, rounded up
+    // Needs a WeightedPolicy, like the weighted LRUCache
+    ConcurrentLRUCache(int capacity, WeightBudget budget, size_t shard_count = default_shard_count(),
+                       const Hash& hash = Hash())
+     : _hash(hash)
+    {
+        if ( 0 >= capacity )
+        {
+            throw InvalidCapacityException; // capacity cannot be negative
+        }
+
+        shard_count = std::max<size_t>(1, std::min<size_t>(shard_count, capacity));
+        int const shard_capacity = static_cast<int>((capacity + shard_count - 1) / shard_count);
+        WeightBudget const shard_budget{budget._weight / shard_count + (0 != budget._weight % shard_count)};
+
+        _shards.reserve(shard_count);
+        for ( size_t i = 0; i < shard_count; ++i )
+        {
+            NumaNodeScope const on_node(shard_numa_node(i, shard_count));
+            _shards.emplace_back(new Shard(shard_capacity, shard_budget, hash));
+        }
+    }
+
+    // A tiered one, all of the shards demoting to the one tier, which needs to outlive
+    // the cache. Needs a TieredPolicy, and the Immediate promotion, as a get that misses
+    // puts the tier's entry back, so can't do with the shard's lock shared
+    // The miss takes the entry from the tier (a pread from flash, and the allocation
+    // of its bytes) with the shard's lock held, so the other gets and puts of that
+    // shard stall behind the IO meanwhile. The async gets, which have the executor
+    // look the miss up, keep it off the awaiting thread, but not off the shard
+    ConcurrentLRUCache(int capacity, typename shard_type::tier_type& tier, size_t shard_count = default_shard_count(),
+                       const Hash& hash = Hash())
+     : _hash(hash)
+    {
+        static_assert(!DEFERRED, "a tiered ConcurrentLRUCache needs RecencyPromotion::Immediate");
+        if ( 0 >= capacity )
+        {
+            throw InvalidCapacityException; // capacity cannot be negative
+        }
+
+        shard_count = std::max<size_t>(1, std::min<size_t>(shard_count, capacity));
+        int const shard_capacity = static_cast<int>((capacity + shard_count - 1) / shard_count);
+
+        _shards.reserve(shard_count);
+        for ( size_t i = 0; i < shard_count; ++i )
+        {
+            NumaNodeScope const on_node(shard_numa_node(i, shard_count));
+            _shards.emplace_back(new Shard(shard_capacity, tier, hash));
+        }
+    }
+
+    // Same as LRUCache::get, under the lock of the key's shard only
+    // When deferred, the lock is shared and the Node is brought to the front later
+    std::optional<Value> get(const Key& key)
+    {
+        Shard &shard = shard_for(key);
+
+        if constexpr ( DEFERRED )
+        {
+            std::optional<Value> value;
+            {
+                std::shared_lock<lock_type> guard(shard._lock);
+                value = shard._cache.peek(key);
+            }
+
+            // drain here only if no one else holds the lock, else leave it to them
+            if ( value && shard._accesses.record(key) )
+            {
+                std::unique_lock<lock_type> guard(shard._lock, std::try_to_lock);
+                if ( guard.owns_lock() )
+                {
+                    shard.drain_accesses();
+                }
+            }
+
+            return value;
+        }
+        else
+        {
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.take_snapshot();
+            return shard._cache.get(key);
+        }
+    }
+
+    // Calls visit with the value for the key, if the key exists, under the lock of
+    // its shard, and returns whether it did - so the value is read in place, without
+    // being copied out, and no pointer into the shard outlives the lock
+    // visit should be quick and shouldn't call back into the cache
+    template <class Visit>
+    bool get_with(const Key& key, Visit&& visit)
+    {
+        Shard &shard = shard_for(key);
+
+        if constexpr ( DEFERRED )
+        {
+            bool found = false;
+            {
+                std::shared_lock<lock_type> guard(shard._lock);
+                Value const *const value = shard._cache.peek_ptr(key);
+                if ( nullptr != value )
+                {
+                    found = true;
+                    visit(*value);
+                }
+            }
+
+            if ( found && shard._accesses.record(key) )
+            {
+                std::unique_lock<lock_type> guard(shard._lock, std::try_to_lock);
+                if ( guard.owns_lock() )
+                {
+                    shard.drain_accesses();
+                }
+            }
+
+            return found;
+        }
+        else
+        {
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.take_snapshot();
+            Value const *const value = shard._cache.get_ptr(key);
+            if ( nullptr == value )
+            {
+                return false;
+            }
+            visit(*value);
+            return true;
+        }
+    }
+
+    // Same as get, if the cache holds the key in memory, but a miss is neither looked
+    // up in the tier nor counted, leaving that to a get made after it (a deferred
+    // cache can't be tiered, so is just got from, and its miss counted again later)
+    std::optional<Value> get_held(const Key& key)
+    {
+        if constexpr ( DEFERRED )
+        {
+            return get(key);
+        }
+        else
+        {
+            Shard &shard = shard_for(key);
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.take_snapshot();
+            Value const *const value = shard._cache.get_held_ptr(key);
+            if ( nullptr == value )
+            {
+                return std::nullopt;
+            }
+            return *value;
+        }
+    }
+
+    // Same as LRUCache::get_or_compute, with the misses of a key single flight: the
+    // first caller to miss it runs loader(key), outside the shard's lock, and those
+    // missing it meanwhile wait for that load instead of running one of their own,
+    // so a hot key that was just evicted is loaded once, not once per thread. They
+    // all get the loaded value (a copy, as with get), or the loader's exception
+    // When deferred, a hit takes the shared lock like get, and a miss is looked up
+    // (and counted) again under the exclusive one, as the load may have just landed
+    // The loader shouldn't get_or_compute the same key, as it would wait on itself
+    template <class Loader>
+    Value get_or_compute(const Key& key, Loader&& loader)
+    {
+        Shard &shard = shard_for(key);
+
+        if constexpr ( DEFERRED )
+        {
+            std::optional<Value> value = get(key);
+            if ( value )
+            {
+                return std::move(*value);
+            }
+        }
+
+        std::promise<Value> loaded;
+        std::shared_future<Value> pending_load;
+        {
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.take_snapshot();
+            Value const *const value = shard._cache.get_ptr(key);
+            if ( nullptr != value )
+            {
+                return *value;
+            }
+
+            auto const pending = shard._loads.find(key);
+            if ( shard._loads.end() != pending )
+            {
+                pending_load = pending->second;
+            }
+            else
+            {
+                shard._loads.emplace(key, loaded.get_future().share());
+            }
+        }
+
+        if ( pending_load.valid() ) // another caller is loading it
+        {
+            return pending_load.get();
+        }
+
+        std::optional<Value> value;
+        try
+        {
+            value.emplace(loader(key));
+        }
+        catch ( ... )
+        {
+            {
+                std::lock_guard<lock_type> guard(shard._lock);
+                shard._loads.erase(key); // so the next miss loads it afresh
+            }
+            loaded.set_exception(std::current_exception());
+            throw;
+        }
+
+        // the load is done with in the same take of the lock as the put, so no one
+        // misses the key in between, and the waiters get the value even if the put
+        // throws (it's only the caller that loaded it that sees that)
+        std::exception_ptr put_failure;
+        {
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard._loads.erase(key);
+            shard.drain_accesses();
+            try
+            {
+                shard._cache.fill(key, *value);
+            }
+            catch ( ... )
+            {
+                put_failure = std::current_exception();
+            }
+        }
+        loaded.set_value(*value);
+
+        if ( put_failure )
+        {
+            std::rethrow_exception(put_failure);
+        }
+        return std::move(*value);
+    }
+
+    // Puts the entries of a random access range of pairs of a key and a value, same
+    // as a put of each in order, on threads threads (one per hardware thread, if 0)
+    // The entries are partitioned by their shard in parallel, a chunk of them per task,
+    // keeping their order, and each shard then puts its part under one take of its
+    // lock, through multi_put's prefetched puts, the shards being the tasks stolen
+    template <class Iterator>
+    void bulk_load(Iterator first, Iterator last, unsigned threads = 0)
+    {
+        static_assert(std::is_base_of<std::random_access_iterator_tag,
+                                      typename std::iterator_traits<Iterator>::iterator_category>::value,
+                      "bulk_load needs a random access range");
+        constexpr size_t CHUNK = 1 << 16; // entries a partitioning task
+
+        size_t const count = static_cast<size_t>(last - first);
+        size_t const shards = _shards.size();
+        size_t const chunks = (count + CHUNK - 1) / CHUNK;
+        threads = ( 0 == threads ) ? static_cast<unsigned>(default_shard_count()) : threads;
+
+        // the no. of each chunk's entries of each shard, then where they go in positions:
+        // shard by shard, and chunk by chunk within the shard, so still in their order
+        std::vector<size_t> offsets(chunks * shards, 0);
+        run_work_stealing(chunks, threads, [&](size_t c)
+        {
+            size_t *const chunk_offsets = offsets.data() + c * shards;
+            for ( size_t i = c * CHUNK, end = std::min(count, i + CHUNK); i < end; ++i )
+            {
+                ++chunk_offsets[shard_index(first[i].first)];
+            }
+        });
+
+        std::vector<size_t> starts(shards + 1);
+        size_t offset = 0;
+        for ( size_t s = 0; s < shards; ++s )
+        {
+            starts[s] = offset;
+            for ( size_t c = 0; c < chunks; ++c )
+            {
+                size_t const chunk_count = offsets[c * shards + s];
+                offsets[c * shards + s] = offset;
+                offset += chunk_count;
+            }
+        }
+        starts[shards] = offset;
+
+        std::vector<size_t> positions(count);
+        run_work_stealing(chunks, threads, [&](size_t c)
+        {
+            size_t *const next = offsets.data() + c * shards;
+            for ( size_t i = c * CHUNK, end = std::min(count, i + CHUNK); i < end; ++i )
+            {
+                positions[next[shard_index(first[i].first)]++] = i;
+            }
+        });
+
+        run_work_stealing(shards, threads, [&](size_t s)
+        {
+            Shard &shard = *_shards[s];
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.drain_accesses();
+            shard._cache.multi_put_entries(first, positions.data() + starts[s], starts[s + 1] - starts[s]);
+        });
+    }
+
+    // Same as LRUCache::for_each, for each shard under its lock (shared, when deferred),
+    // the shards spread across threads threads (one per hardware thread, if 0), so
+    // visit is called from all of them at once, and needs to be thread safe
+    template <class Visit>
+    void for_each(Visit&& visit, unsigned threads = 0) const
+    {
+        threads = ( 0 == threads ) ? static_cast<unsigned>(default_shard_count()) : threads;
+        run_work_stealing(_shards.size(), threads, [this, &visit](size_t s)
+        {
+            Shard const &shard = *_shards[s];
+            if constexpr ( DEFERRED )
+            {
+                std::shared_lock<lock_type> guard(shard._lock);
+                shard._cache.for_each(visit);
+            }
+            else
+            {
+                std::lock_guard<lock_type> guard(shard._lock);
+                shard._cache.for_each(visit);
+            }
+        });
+    }
+
+    // Same as LRUCache::erase_if, for each shard under its lock, the shards spread across
+    // threads threads like for_each's, so pred needs to be thread safe too
+    template <class Pred>
+    size_t erase_if(Pred&& pred, unsigned threads = 0)
+    {
+        threads = ( 0 == threads ) ? static_cast<unsigned>(default_shard_count()) : threads;
+        std::atomic<size_t> erased{0};
+        run_work_stealing(_shards.size(), threads, [this, &pred, &erased](size_t s)
+        {
+            Shard &shard = *_shards[s];
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.drain_accesses();
+            erased.fetch_add(shard._cache.erase_if(pred), std::memory_order_relaxed);
+        });
+        return erased.load(std::memory_order_relaxed);
+    }
+
+#ifdef LRUCACHE_HAS_COROUTINES
+    // co_await async_get(key, executor) is get, without blocking the awaiting coroutine
+    // on the tier: a hit is had inline, and a miss of a tiered cache suspends it, to be
+    // looked up in the tier by a task given to the executor, which then resumes it
+    template <class Executor>
+    AsyncGet<ConcurrentLRUCache, typename std::decay<Executor>::type> async_get(const Key& key, Executor&& executor)
+    {
+        return { *this, key, std::forward<Executor>(executor) };
+    }
+
+    // co_await async_get_or_compute(key, loader, executor) is get_or_compute, a hit had
+    // inline, and a miss (of the tier too) suspending the awaiting coroutine for the
+    // executor's task to load it, single flight still, and resume it with the value
+    // The loader and the executor are copied into the awaitable
+    template <class Loader, class Executor>
+    AsyncGetOrCompute<ConcurrentLRUCache, typename std::decay<Loader>::type, typename std::decay<Executor>::type>
+    async_get_or_compute(const Key& key, Loader&& loader, Executor&& executor)
+    {
+        return { *this, key, std::forward<Loader>(loader), std::forward<Executor>(executor) };
+    }
+
+    // co_await async_put(key, value) is put, done inline and never suspending, for the
+    // coroutines to use alongside the async gets
+    AsyncPut<ConcurrentLRUCache> async_put(Key key, Value value)
+    {
+        return { *this, std::move(key), std::move(value) };
+    }
+#endif
+
+    // Same as LRUCache::multi_get, with the keys split up by their shard, and each
+    // shard's lock taken once (shared, when deferred) for all its keys of the batch
+    size_t multi_get(const Key* keys, size_t count, std::optional<Value>* values)
+    {
+        std::vector<size_t> starts;
+        std::vector<size_t> const positions = positions_by_shard(keys, count, starts);
+        size_t hits = 0;
+
+        for ( size_t s = 0; s < _shards.size(); ++s )
+        {
+            size_t const* const shard_positions = positions.data() + starts[s];
+            size_t const shard_count = starts[s + 1] - starts[s];
+            if ( 0 == shard_count )
+            {
+                continue;
+            }
+
+            Shard &shard = *_shards[s];
+            if constexpr ( DEFERRED )
+            {
+                {
+                    std::shared_lock<lock_type> guard(shard._lock);
+                    hits += shard._cache.multi_peek(keys, shard_positions, shard_count, values);
+                }
+
+                bool drain = false;
+                for ( size_t i = 0; i < shard_count; ++i )
+                {
+                    if ( values[shard_positions[i]] && shard._accesses.record(keys[shard_positions[i]]) )
+                    {
+                        drain = true;
+                    }
+                }
+
+                if ( drain )
+                {
+                    std::unique_lock<lock_type> guard(shard._lock, std::try_to_lock);
+                    if ( guard.owns_lock() )
+                    {
+                        shard.drain_accesses();
+                    }
+                }
+            }
+            else
+            {
+                std::lock_guard<lock_type> guard(shard._lock);
+                shard.take_snapshot();
+                hits += shard._cache.multi_get(keys, shard_positions, shard_count, values);
+            }
+        }
+
+        return hits;
+    }
+
+    // Same as LRUCache::multi_put, taking each shard's lock once for all its keys
+    void multi_put(const Key* keys, const Value* values, size_t count)
+    {
+        std::vector<size_t> starts;
+        std::vector<size_t> const positions = positions_by_shard(keys, count, starts);
+
+        for ( size_t s = 0; s < _shards.size(); ++s )
+        {
+            size_t const shard_count = starts[s + 1] - starts[s];
+            if ( 0 == shard_count )
+            {
+                continue;
+            }
+
+            Shard &shard = *_shards[s];
+            std::lock_guard<lock_type> guard(shard._lock);
+            shard.drain_accesses();
+            shard._cache.multi_put(keys, values, positions.data() + starts[s], shard_count);
+        }
+    }
+
+    // Same as LRUCache::put, under the lock of the key's shard only
+    // The recorded hits are replayed first, so the LRU to be evicted is up to date
+    void put(const Key& key, const Value& value)
+    {
+        emplace(key, value);
+    }
+
+    void put(Key&& key, Value&& value)
+    {
+        emplace(std::move(key), std::move(value));
+    }
+
+    // Same as LRUCache::put with a ttl, needs an ExpiringPolicy
+    void put(const Key& key, const Value& value, std::chrono::milliseconds ttl)
+    {
+        Shard &shard = shard_for(key);
+        std::lock_guard<lock_type> guard(shard._lock);
+        shard.drain_accesses();
+        shard._cache.put(key, value, ttl);
+    }
+
+    void put(Key&& key, Value&& value, std::chrono::milliseconds ttl)
+    {
+        Shard &shard = shard_for(key);
+        std::lock_guard<lock_type> guard(shard._lock);
+        shard.drain_accesses();
+        shard._cache.put(std::move(key), std::move(value), ttl);
+    }
+
+    // Same as LRUCache::expire for each shard in turn, under its lock, so it can be
+    // called from a thread of its own as a background sweep
+    size_t expire(size_t max_slots_per_shard)
+    {
+        size_t freed = 0;
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            shard->drain_accesses();
+            freed += shard->_cache.expire(max_slots_per_shard);
+        }
+        return freed;
+    }
+
+    // Same as LRUCache::save_snapshot, a shard after the other, without holding any
+    // lock while writing: each shard is encoded into a SnapshotBlock under its lock,
+    // and written out once that's let go, paced to bytes_per_second. So the gets and
+    // puts wait at most for their own shard being encoded, never for the IO
+    // It's consistent, as of the point in time it's started at: all of the shards are
+    // marked as pending under their locks at once, and a shard's entries are taken
+    // either by the snapshot when it gets to them, or by the first op to change them
+    // before then (a copy on write, a shard at a time), so what's put meanwhile goes
+    // in the next one. It takes the memory of the shards changed ahead of it, at most
+    // all of them, and can be taken while serving (see SnapshotCheckpointer), one at
+    // a time. Returns the no. of entries written
+    size_t save_snapshot(const std::string& path, size_t bytes_per_second = SIZE_MAX) const
+    {
+        std::lock_guard<std::mutex> snapshotting(_snapshot_lock);
+        SnapshotWriter writer(path, bytes_per_second);
+        {
+            std::vector<std::unique_lock<lock_type>> guards;
+            guards.reserve(_shards.size());
+            for ( auto const &shard : _shards )
+            {
+                guards.emplace_back(shard->_lock);
+                shard->_snapshot_pending = true;
+            }
+        }
+
+        try
+        {
+            SnapshotBlock block;
+            for ( auto const &shard : _shards )
+            {
+                std::exception_ptr error;
+                {
+                    std::lock_guard<lock_type> guard(shard->_lock);
+                    shard->take_snapshot();
+                    block = std::move(shard->_snapshot);
+                    shard->_snapshot.clear();
+                    std::swap(error, shard->_snapshot_error);
+                }
+                if ( error )
+                {
+                    std::rethrow_exception(error);
+                }
+                writer.add(block);
+            }
+        }
+        catch ( ... ) // the shards not got to yet are let go of, without taking their entries
+        {
+            for ( auto const &shard : _shards )
+            {
+                std::lock_guard<lock_type> guard(shard->_lock);
+                shard->_snapshot_pending = false;
+                shard->_snapshot = SnapshotBlock();
+                shard->_snapshot_error = nullptr;
+            }
+            throw;
+        }
+
+        writer.commit();
+        return writer.entries();
+    }
+
+    // Same as LRUCache::load_snapshot, with each entry (LRU first again) restored to
+    // its shard under the shard's lock. The entries are routed by their keys, so the
+    // snapshot of a cache with another no. of shards loads all the same, each shard
+    // keeping the MRU entries that fit it
+    size_t load_snapshot(const std::string& path)
+    {
+        SnapshotReader const reader(path);
+        clear();
+
+        try
+        {
+            for ( size_t i = reader.size(); 0 < i--; )
+            {
+                Key key{};
+                Value value{};
+                uint64_t ttl_ms = NEVER_EXPIRES;
+                reader.read(i, key, value, ttl_ms);
+
+                Shard &shard = shard_for(key);
+                std::lock_guard<lock_type> guard(shard._lock);
+                shard.take_snapshot();
+                shard._cache.restore(std::move(key), std::move(value), ttl_ms);
+            }
+        }
+        catch ( ... )
+        {
+            clear();
+            throw;
+        }
+
+        return size();
+    }
+
+    // Same as LRUCache::emplace, but without handing out the reference to the value,
+    // as that would outlive the shard's lock
+    template <class... Args>
+    void emplace(const Key& key, Args&&... args)
+    {
+        Shard &shard = shard_for(key);
+        std::lock_guard<lock_type> guard(shard._lock);
+        shard.drain_accesses();
+        shard._cache.emplace(key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    void emplace(Key&& key, Args&&... args)
+    {
+        Shard &shard = shard_for(key);
+        std::lock_guard<lock_type> guard(shard._lock);
+        shard.drain_accesses();
+        shard._cache.emplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    size_t shard_count() const noexcept
+    {
+        return _shards.size();
+    }
+
+    // The NUMA node that holds the key's shard (-1 if the host has just the one),
+    // for the callers to hand the work on a key to a thread on that node where they
+    // can. The cache itself can't route a key by the CPU it's called on, as the key
+    // has to be found in the one shard it was put in, whatever the CPU
+    int numa_node(const Key& key) const noexcept
+    {
+        return shard_numa_node(shard_index(key), _shards.size());
+    }
+
+    // the sum of the shard capacities, which the rounding up may make a bit more than asked
+    size_t capacity() const noexcept
+    {
+        return _shards.size() * _shards.front()->_cache.capacity();
+    }
+
+    // warm_reserve's each of the shards in turn
+    void warm_reserve() noexcept
+    {
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            shard->_cache.warm_reserve();
+        }
+    }
+
+    // the sum of the shards' stats, read without taking any of the shard locks, as
+    // the counters are atomics of their own
+    CacheStats stats() const noexcept
+    {
+        CacheStats total;
+        for ( auto const &shard : _shards )
+        {
+            total += shard->_cache.stats();
+        }
+        return total;
+    }
+
+    // the sum of the shards' latency histograms, read without their locks too
+    LatencySnapshot latencies(CacheOp op) const
+    {
+        LatencySnapshot total;
+        for ( auto const &shard : _shards )
+        {
+            total += shard->_cache.latencies(op);
+        }
+        return total;
+    }
+
+    // sets the hook of every shard, before the cache is shared between threads
+    void set_trace_hook(CacheTraceHook hook, void *context = nullptr) noexcept
+    {
+        for ( auto const &shard : _shards )
+        {
+            shard->_cache.set_trace_hook(hook, context);
+        }
+    }
+
+    // sets the eviction queue of every shard, the one all of them put on, before the
+    // cache is shared between threads. Needs a NotifyingPolicy
+    void set_eviction_queue(typename shard_type::eviction_queue_type& queue) noexcept
+    {
+        for ( auto const &shard : _shards )
+        {
+            shard->_cache.set_eviction_queue(queue);
+        }
+    }
+
+    // sets the write-back queue of every shard, the one all of them write back through,
+    // before the cache is shared between threads. Needs a WriteBackPolicy
+    void set_write_back_queue(typename shard_type::write_back_type& queue)
+    {
+        for ( auto const &shard : _shards )
+        {
+            shard->_cache.set_write_back_queue(queue);
+        }
+    }
+
+    // Same as LRUCache::flush_dirty, a shard at a time, each under its lock
+    size_t flush_dirty()
+    {
+        size_t flushed = 0;
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            flushed += shard->_cache.flush_dirty();
+        }
+        return flushed;
+    }
+
+    // takes the shard locks one at a time, so it's a moving total under concurrent puts
+    size_t dirty_count() const
+    {
+        size_t total = 0;
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            total += shard->_cache.dirty_count();
+        }
+        return total;
+    }
+
+    // takes the shard locks one at a time, so it's a moving total under concurrent puts
+    size_t size() const noexcept
+    {
+        size_t total = 0;
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            total += shard->_cache.size();
+        }
+        return total;
+    }
+
+    // the total weight across the shards, a moving total just like size()
+    size_t weight() const noexcept
+    {
+        size_t total = 0;
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            total += shard->_cache.weight();
+        }
+        return total;
+    }
+
+    void clear() noexcept
+    {
+        for ( auto const &shard : _shards )
+        {
+            std::lock_guard<lock_type> guard(shard->_lock);
+            shard->drain_accesses(); // the recorded hits are of no use anymore
+            shard->_cache.clear();
+        }
+    }
+
+    // writes each of the shards in turn, MRU to LRU within the shard
+    template <class K, class V, class H, class P, RecencyPromotion R>
+    friend ostream& operator<< (ostream& os, const ConcurrentLRUCache<K, V, H, P, R>& cache);
+};
+
+template <class Key, class Value, class Hash, class Policy, RecencyPromotion Promotion>
+ostream& operator<< (ostream& os, const ConcurrentLRUCache<Key, Value, Hash, Policy, Promotion>& cache)
+{
+    using cache_type = ConcurrentLRUCache<Key, Value, Hash, Policy, Promotion>;
+
+    os << "[";
+
+    for ( size_t i = 0; i < cache._shards.size(); ++i )
+    {
+        std::lock_guard<typename cache_type::lock_type> guard(cache._shards[i]->_lock);
+        os << ( (0 == i) ? "" : ", " ) << cache._shards[i]->_cache;
+    }
+
+    return os << "]";
+}
+
+// Snapshots a ConcurrentLRUCache to the path every period, from a thread of its own,
+// while the cache keeps on serving, paced to bytes_per_second (see save_snapshot
+// for how briefly that holds each shard's lock), so that a restart loads at most a
+// period's worth of changes short. A snapshot that fails leaves the last one in
+// place, keeps its error for last_error(), and is tried again the next period
+template <class Cache>
+class SnapshotCheckpointer
+{
+    Cache& _cache;
+    std::string const _path;
+    std::chrono::milliseconds const _period;
+    size_t const _bytes_per_second;
+
+    mutable std::mutex _lock;
+    std::condition_variable _wake;
+    bool _stopping{false};
+    bool _requested{false};
+    size_t _checkpoints{0};
+    size_t _entries{0};
+    std::string _last_error;
+    std::thread _thread; // started last, once the rest is in place
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        while ( !_stopping )
+        {
+            _wake.wait_for(guard, _period, [this]() { return _stopping || _requested; });
+            if ( _stopping )
+            {
+                break;
+            }
+            _requested = false;
+
+            guard.unlock();
+            size_t entries = 0;
+            std::string error;
+            try
+            {
+                entries = _cache.save_snapshot(_path, _bytes_per_second);
+            }
+            catch ( std::exception& except )
+            {
+                error = except.what();
+            }
+            guard.lock();
+
+            if ( error.empty() )
+            {
+                ++_checkpoints;
+                _entries = entries;
+            }
+            else
+            {
+                _last_error = error;
+            }
+        }
+    }
+
+  public:
+    SnapshotCheckpointer(Cache& cache, const std::string& path, std::chrono::milliseconds period,
+                         size_t bytes_per_second = SIZE_MAX)
+     : _cache(cache), _path(path), _period(period), _bytes_per_second(bytes_per_second),
+       _thread([this]() { run(); })
+    { }
+
+    SnapshotCheckpointer(const SnapshotCheckpointer&) = delete;
+    SnapshotCheckpointer& operator=(const SnapshotCheckpointer&) = delete;
+
+    // waits for the snapshot under way, if any, to be done
+    ~SnapshotCheckpointer()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+    }
+
+    // takes the next snapshot now, rather than at the end of the period (say, ahead
+    // of a planned restart), without waiting for it
+    void checkpoint_now()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _requested = true;
+        }
+        _wake.notify_one();
+    }
+
+    // the no. of snapshots taken, and the no. of entries in the last one
+    size_t checkpoints() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _checkpoints;
+    }
+
+    size_t entries() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _entries;
+    }
+
+    std::string last_error() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _last_error;
+    }
+};
+
+// Flushes the dirty entries of a write-back ConcurrentLRUCache every period, from a
+// thread of its own, so that an entry that stays in the cache is written back within
+// a period of its first put since it was last written (and just the once)
+template <class Cache>
+class WriteBackFlusher
+{
+    Cache& _cache;
+    std::chrono::milliseconds const _period;
+
+    mutable std::mutex _lock;
+    std::condition_variable _wake;
+    bool _stopping{false};
+    size_t _flushes{0};
+    size_t _flushed{0};
+    std::thread _thread; // started last, once the rest is in place
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        while ( !_stopping )
+        {
+            _wake.wait_for(guard, _period, [this]() { return _stopping; });
+            if ( _stopping )
+            {
+                break;
+            }
+
+            guard.unlock();
+            size_t const flushed = _cache.flush_dirty();
+            guard.lock();
+            ++_flushes;
+            _flushed += flushed;
+        }
+    }
+
+  public:
+    WriteBackFlusher(Cache& cache, std::chrono::milliseconds period)
+     : _cache(cache), _period(period), _thread([this]() { run(); })
+    { }
+
+    WriteBackFlusher(const WriteBackFlusher&) = delete;
+    WriteBackFlusher& operator=(const WriteBackFlusher&) = delete;
+
+    // waits for the flush under way, if any, to be done
+    ~WriteBackFlusher()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+    }
+
+    // the no. of flushes done, and of the entries they've written back in all
+    size_t flushes() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _flushes;
+    }
+
+    size_t flushed() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _flushed;
+    }
+};
+
+// The key streams to benchmark the caches with, keys drawn from 0 to key_space - 1
+// Uniform: every key equally likely, the worst case for any recency order
+inline std::vector<int> make_uniform_keys(size_t count, int key_space, uint64_t seed = 1)
+{
+    std::mt19937_64 random(seed);
+    std::uniform_int_distribution<int> pick(0, key_space - 1);
+
+    std::vector<int> keys(count);
+    for ( auto &key : keys )
+    {
+        key = pick(random);
+    }
+    return keys;
+}
+
+// Zipfian: the key of rank i drawn with the probability 1 / i^theta, the skew of
+// the real web and storage traffic (theta 0.99 being YCSB's default), as per the
+// generator of Gray et al. "Quickly Generating Billion-Record Synthetic Databases"
+inline std::vector<int> make_zipfian_keys(size_t count, int key_space, double theta = 0.99, uint64_t seed = 1)
+{
+    double zeta_n = 0;
+    for ( int i = 1; i <= key_space; ++i )
+    {
+        zeta_n += 1.0 / std::pow(i, theta);
+    }
+    double const zeta_2 = 1.0 + 1.0 / std::pow(2, theta);
+    double const alpha = 1.0 / (1.0 - theta);
+    double const eta = (1.0 - std::pow(2.0 / key_space, 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    std::vector<int> keys(count);
+    for ( auto &key : keys )
+    {
+        double const u = uniform(random);
+        double const uz = u * zeta_n;
+        if ( uz < 1.0 )
+        {
+            key = 0;
+        }
+        else if ( uz < zeta_2 )
+        {
+            key = 1;
+        }
+        else
+        {
+            key = std::min(key_space - 1, static_cast<int>(key_space * std::pow(eta * u - eta + 1.0, alpha)));
+        }
+    }
+    return keys;
+}
+
+// Scan heavy: the zipfian keys, broken every scan_every keys by a sequential scan
+// of scan_length keys never seen before, which flush a pure LRU of its hot keys
+inline std::vector<int> make_scan_keys(size_t count, int key_space, size_t scan_every, size_t scan_length,
+                                       uint64_t seed = 1)
+{
+    std::vector<int> keys = make_zipfian_keys(count, key_space, 0.99, seed);
+
+    int next_scanned = key_space; // the scanned keys are past the zipfian ones
+    for ( size_t begin = scan_every; begin < count; begin += scan_every + scan_length )
+    {
+        size_t const end = std::min(count, begin + scan_length);
+        for ( size_t i = begin; i < end; ++i )
+        {
+            keys[i] = next_scanned;
+            next_scanned = ( INT32_MAX == next_scanned ) ? key_space : next_scanned + 1;
+        }
+    }
+    return keys;
+}
+
+// Replayed trace: the keys read from a text file of whitespace separated int keys,
+// as captured from real traffic
+inline std::vector<int> load_trace_keys(const std::string& path)
+{
+    std::ifstream trace(path);
+    if ( !trace )
+    {
+        throw std::runtime_error("load_trace_keys: can't open " + path);
+    }
+
+    std::vector<int> keys;
+    int key;
+    while ( trace >> key )
+    {
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+// What a benchmark run measured: the throughput, the hit ratio, and the latency
+// percentiles of the sampled ops
+struct BenchmarkResult
+{
+    size_t _ops{0};
+    size_t _hits{0};
+    double _seconds{0};
+    uint64_t _p50_ns{0};
+    uint64_t _p99_ns{0};
+    uint64_t _p999_ns{0};
+
+    double ops_per_second() const noexcept
+    {
+        return ( 0 < _seconds ) ? _ops / _seconds : 0;
+    }
+
+    double hit_ratio() const noexcept
+    {
+        return ( 0 < _ops ) ? static_cast<double>(_hits) / _ops : 0;
+    }
+};
+
+inline ostream& operator<< (ostream& os, const BenchmarkResult& result)
+{
+    os << result.ops_per_second() / 1e6 << " Mops/s, hit ratio " << result.hit_ratio() * 100 << "%, ";
+    os << "p50/p99/p999 " << result._p50_ns << "/" << result._p99_ns << "/" << result._p999_ns << " ns";
+    return os;
+}
+
+// one op in this many gets its latency measured, as reading the clock around every
+// op would cost about as much as the op itself, and skew the throughput
+constexpr size_t LATENCY_SAMPLE_EVERY = 16;
+
+// Runs the keys through the cache, as a cache aside would: a get of each key, and
+// a put of it on a miss, split in contiguous slices over the given no. of threads
+// (just the one, unless the Cache is thread safe). The first tenth of the keys
+// goes through untimed, to warm the cache up, and isn't counted either
+template <class Cache>
+BenchmarkResult run_benchmark(Cache& cache, const std::vector<int>& keys, unsigned threads = 1)
+{
+    threads = std::max(1u, threads);
+    size_t const warm_up = keys.size() / 10;
+    for ( size_t i = 0; i < warm_up; ++i )
+    {
+        if ( !cache.get(keys[i]) )
+        {
+            cache.put(keys[i], keys[i]);
+        }
+    }
+
+    size_t const timed = keys.size() - warm_up;
+    std::vector<std::vector<uint32_t>> latencies(threads);
+    std::vector<size_t> hits(threads, 0);
+    std::atomic<unsigned> ready{0};
+
+    auto const run_slice = [&](unsigned t)
+    {
+        size_t const begin = warm_up + timed * t / threads;
+        size_t const end = warm_up + timed * (t + 1) / threads;
+        auto &samples = latencies[t];
+        samples.reserve((end - begin) / LATENCY_SAMPLE_EVERY + 1);
+
+        // all the threads start together, so that they contend from the first op
+        ready.fetch_add(1);
+        while ( ready.load() < threads )
+        {
+            std::this_thread::yield();
+        }
+
+        size_t slice_hits = 0;
+        for ( size_t i = begin; i < end; ++i )
+        {
+            bool const sampled = ( 0 == i % LATENCY_SAMPLE_EVERY );
+            auto const start_time = sampled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+            if ( cache.get(keys[i]) )
+            {
+                ++slice_hits;
+            }
+            else
+            {
+                cache.put(keys[i], keys[i]);
+            }
+
+            if ( sampled )
+            {
+                auto const time_taken = std::chrono::steady_clock::now() - start_time;
+                samples.push_back(static_cast<uint32_t>(std::min<int64_t>(UINT32_MAX,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(time_taken).count())));
+            }
+        }
+        hits[t] = slice_hits;
+    };
+
+    auto const start_time = std::chrono::steady_clock::now();
+    if ( 1 == threads )
+    {
+        run_slice(0);
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        for ( unsigned t = 0; t < threads; ++t )
+        {
+            workers.emplace_back(run_slice, t);
+        }
+        for ( auto &worker : workers )
+        {
+            worker.join();
+        }
+    }
+    auto const end_time = std::chrono::steady_clock::now();
+
+    BenchmarkResult result;
+    result._ops = timed;
+    result._seconds = std::chrono::duration<double>(end_time - start_time).count();
+    for ( unsigned t = 0; t < threads; ++t )
+    {
+        result._hits += hits[t];
+    }
+
+    std::vector<uint32_t> samples;
+    for ( auto const &slice_samples : latencies )
+    {
+        samples.insert(samples.end(), slice_samples.begin(), slice_samples.end());
+    }
+
+    auto const percentile = [&samples](double fraction) -> uint64_t
+    {
+        if ( samples.empty() )
+        {
+            return 0;
+        }
+        auto const nth = samples.begin() + static_cast<ptrdiff_t>(fraction * (samples.size() - 1));
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth;
+    };
+    result._p50_ns = percentile(0.50);
+    result._p99_ns = percentile(0.99);
+    result._p999_ns = percentile(0.999);
+
+    return result;
+}
+
+// The ops a trace records, with the key of each as an int64_t - the key itself for
+// the integral keys, else its hash, which tells the keys apart all the same for
+// the purpose of simulating the hit ratios
+enum class TraceOp : uint8_t
+{
+    Get = 0,
+    Put = 1
+};
+
+struct TraceRecord
+{
+    TraceOp _op;
+    int64_t _key;
+};
+
+template <class Key, class Hash>
+int64_t trace_key(const Key& key, const Hash& hash) noexcept
+{
+    if constexpr ( std::is_integral<Key>::value )
+    {
+        return static_cast<int64_t>(key);
+    }
+    else
+    {
+        return static_cast<int64_t>(hash(key));
+    }
+}
+
+// The trace file format: TRACE_MAGIC, then a varint per record of the zigzag of the
+// key's delta from the previous record's key (so the nearby keys of a scan or of a
+// hot range take a byte or two), with the record's op in the lowest bit of the
+// first byte, which leaves that byte 6 bits of the delta and each following one 7
+constexpr char TRACE_MAGIC[] = { 'L', 'R', 'U', 'T', 1 };
+
+// Writes the records of a trace file, buffered in memory and written out in blocks
+class TraceWriter
+{
+    std::ofstream _file;
+    std::vector<char> _buffer;
+    int64_t _previous_key{0};
+
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+  public:
+    explicit TraceWriter(const std::string& path)
+     : _file(path, std::ios::binary | std::ios::trunc)
+    {
+        if ( !_file )
+        {
+            throw std::runtime_error("TraceWriter: can't open " + path);
+        }
+        _buffer.reserve(BLOCK_SIZE + 16);
+        _buffer.insert(_buffer.end(), std::begin(TRACE_MAGIC), std::end(TRACE_MAGIC));
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    ~TraceWriter()
+    {
+        flush();
+    }
+
+    void record(TraceOp op, int64_t key)
+    {
+        uint64_t const delta = static_cast<uint64_t>(key) - static_cast<uint64_t>(_previous_key);
+        uint64_t zigzag = (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+        _previous_key = key;
+
+        uint8_t byte = static_cast<uint8_t>(static_cast<uint8_t>(op) | ((zigzag & 0x3F) << 1));
+        zigzag >>= 6;
+        while ( 0 != zigzag )
+        {
+            _buffer.push_back(static_cast<char>(byte | 0x80));
+            byte = static_cast<uint8_t>(zigzag & 0x7F);
+            zigzag >>= 7;
+        }
+        _buffer.push_back(static_cast<char>(byte));
+
+        if ( _buffer.size() >= BLOCK_SIZE )
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        _file.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _file.flush();
+        _buffer.clear();
+    }
+};
+
+// Reads the records of a trace file back, out of a MappedFile, so a big trace is
+// paged in as it's read
+class TraceReader
+{
+    MappedFile _file;
+    const unsigned char *_next{nullptr};
+    int64_t _previous_key{0};
+
+  public:
+    explicit TraceReader(const std::string& path)
+     : _file(path, FileAccess::Sequential, "TraceReader")
+    {
+        if ( _file.size() < sizeof(TRACE_MAGIC) || 0 != std::memcmp(_file.begin(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) )
+        {
+            throw std::runtime_error("TraceReader: not a trace file " + path);
+        }
+        rewind();
+    }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    // Reads the next record, returns false at the end of the trace (or at a record
+    // cut short, as a trace still being written may end with)
+    bool next(TraceRecord &record) noexcept
+    {
+        const unsigned char *at = _next;
+        if ( at == _file.end() )
+        {
+            return false;
+        }
+
+        uint8_t byte = *at++;
+        TraceOp const op = static_cast<TraceOp>(byte & 1);
+        uint64_t zigzag = (byte >> 1) & 0x3F;
+        for ( int shift = 6; 0 != (byte & 0x80); shift += 7 )
+        {
+            if ( at == _file.end() || 64 <= shift )
+            {
+                return false;
+            }
+            byte = *at++;
+            zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        }
+
+        uint64_t const delta = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+        _previous_key = static_cast<int64_t>(static_cast<uint64_t>(_previous_key) + delta);
+        _next = at;
+
+        record._op = op;
+        record._key = _previous_key;
+        return true;
+    }
+
+    // back to the first record, for another pass over the trace
+    void rewind() noexcept
+    {
+        _next = _file.begin() + sizeof(TRACE_MAGIC);
+        _previous_key = 0;
+    }
+
+    // all the records from the current one on, decoded
+    std::vector<TraceRecord> read_all()
+    {
+        std::vector<TraceRecord> records;
+        TraceRecord record;
+        while ( next(record) )
+        {
+            records.push_back(record);
+        }
+        return records;
+    }
+};
+
+// Wraps a live cache, recording the key of each get and put to the TraceWriter on
+// its way to the cache. The writer isn't thread safe, so neither is this, even
+// over a ConcurrentLRUCache
+template <class Cache, class Hash = std::hash<typename Cache::key_type>>
+class TracedCache
+{
+    using Key = typename Cache::key_type;
+    using Value = typename Cache::mapped_type;
+
+    Cache& _cache;
+    TraceWriter& _writer;
+    Hash _hash;
+
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    TracedCache(Cache& cache, TraceWriter& writer, const Hash& hash = Hash())
+     : _cache(cache), _writer(writer), _hash(hash)
+    { }
+
+    std::optional<Value> get(const Key& key)
+    {
+        _writer.record(TraceOp::Get, trace_key(key, _hash));
+        return _cache.get(key);
+    }
+
+    void put(const Key& key, const Value& value)
+    {
+        _writer.record(TraceOp::Put, trace_key(key, _hash));
+        _cache.put(key, value);
+    }
+
+    size_t capacity() const noexcept
+    {
+        return _cache.capacity();
+    }
+
+    size_t size() const noexcept
+    {
+        return _cache.size();
+    }
+
+    void clear() noexcept
+    {
+        _cache.clear();
+    }
+};
+
+// Works out the LRU hit ratio of a trace for every capacity in one pass, after
+// Mattson et al. "Evaluation Techniques for Storage Hierarchies": LRU is a stack
+// algorithm, so a get hits in a cache of capacity C exactly when its key's stack
+// distance - the no. of other keys used since the key's last use - is below C
+// The distances are counted with a Fenwick tree over the times of the records,
+// where only the time of each key's last use is marked, so that the marks between
+// a key's last use and now are the distinct keys used in between: O(log n) a record
+// Both the gets and the puts use the key, only the gets count as hits or misses
+class StackDistanceReplay
+{
+    std::vector<uint32_t> _marks; // the Fenwick tree, 1 based
+    std::unordered_map<int64_t, size_t> _last_use; // the time of its last use, by the key
+    std::vector<uint64_t> _gets_at_distance; // the no. of gets, by their stack distance
+    uint64_t _gets{0};
+    uint64_t _cold_gets{0}; // the gets of the keys never used before, a miss at any capacity
+    size_t _time{0};
+
+    void mark(size_t time, int32_t delta) noexcept
+    {
+        for ( ; time < _marks.size(); time += time & (~time + 1) )
+        {
+            _marks[time] += delta;
+        }
+    }
+
+    uint64_t marks_up_to(size_t time) const noexcept
+    {
+        uint64_t total = 0;
+        for ( ; 0 < time; time -= time & (~time + 1) )
+        {
+            total += _marks[time];
+        }
+        return total;
+    }
+
+  public:
+    // records is the no. of records the replay is to see, at most
+    explicit StackDistanceReplay(size_t records)
+     : _marks(records + 1, 0)
+    { }
+
+    void use(const TraceRecord& record)
+    {
+        ++_time;
+        if ( _time >= _marks.size() )
+        {
+            throw std::length_error("StackDistanceReplay: more records than were sized for");
+        }
+
+        auto const last = _last_use.try_emplace(record._key, _time);
+        if ( last.second ) // the first use of the key
+        {
+            _cold_gets += ( TraceOp::Get == record._op ) ? 1 : 0;
+        }
+        else
+        {
+            if ( TraceOp::Get == record._op )
+            {
+                uint64_t const distance = marks_up_to(_time - 1) - marks_up_to(last.first->second);
+                if ( _gets_at_distance.size() <= distance )
+                {
+                    _gets_at_distance.resize(distance + 1, 0);
+                }
+                ++_gets_at_distance[distance];
+            }
+            mark(last.first->second, -1);
+            last.first->second = _time;
+        }
+        mark(_time, +1);
+        _gets += ( TraceOp::Get == record._op ) ? 1 : 0;
+    }
+
+    // the distinct keys seen, past which any bigger capacity hits just as often
+    size_t key_count() const noexcept
+    {
+        return _last_use.size();
+    }
+
+    uint64_t gets() const noexcept
+    {
+        return _gets;
+    }
+
+    // the hit ratio an LRU of the given capacity would have had over the trace
+    double hit_ratio(size_t capacity) const noexcept
+    {
+        uint64_t hits = 0;
+        for ( size_t distance = 0; distance < std::min(capacity, _gets_at_distance.size()); ++distance )
+        {
+            hits += _gets_at_distance[distance];
+        }
+        return ( 0 < _gets ) ? static_cast<double>(hits) / _gets : 0;
+    }
+
+    // the hit ratios for each of the capacities, out of the same one pass
+    std::vector<double> hit_ratio_curve(const std::vector<size_t>& capacities) const
+    {
+        std::vector<double> curve;
+        for ( size_t const capacity : capacities )
+        {
+            curve.push_back(hit_ratio(capacity));
+        }
+        return curve;
+    }
+};
+
+// Runs the trace's records through a cache (the keys as int) and returns its
+// throughput and its hit ratio over the gets. A get that misses puts its key, as
+// the cache aside that recorded it would have - a get that hit at the recorded
+// capacity has no put after it in the trace, but may miss at the replayed one
+template <class Cache>
+BenchmarkResult replay_trace(Cache& cache, const std::vector<TraceRecord>& records)
+{
+    BenchmarkResult result;
+
+    auto const start_time = std::chrono::steady_clock::now();
+    for ( auto const &record : records )
+    {
+        int const key = static_cast<int>(record._key);
+        if ( TraceOp::Get == record._op )
+        {
+            ++result._ops;
+            if ( cache.get(key) )
+            {
+                ++result._hits;
+            }
+            else
+            {
+                cache.put(key, key);
+            }
+        }
+        else
+        {
+            cache.put(key, key);
+        }
+    }
+    auto const end_time = std::chrono::steady_clock::now();
+
+    result._seconds = std::chrono::duration<double>(end_time - start_time).count();
+    return result;
+}
+
+// A decorator-like testing class to test the LRUCache, with any of its engines
+template <class Cache>
+class LoggedOrTimedOpsTester
+{
+    Cache& _cache;
+
+  public:
+    explicit LoggedOrTimedOpsTester(Cache& cache) noexcept
+     : _cache(cache) // glue it to the given LRUCache object
+    { }
+
+    // logs the internal state of the cache before and after the call to put
+    void logged_put(int key, int value)
+    {
+        //cout << "Before:\t" << _cache << endl;
+        _cache.put(key, value);
+        log_capacity();
+        cout << "After Put(" << key << "," << value << "):\t" << _cache << endl;
+    }
+
+    // logs the internal state of the cache before and after the call to get
+    int logged_get(int key) noexcept
+    {
+        //cout << "Before:\t" << _cache << endl;
+        int value = _cache.get(key).value_or(KEY_NOT_FOUND_RET_VAL);
+        cout << "Get(" << key << ") Returned:\t" << value << endl;
+        log_capacity();
+        cout << "After Get(" << key << "):\t" << _cache << endl;
+        return value;
+    }
+
+    // Measures the time taken for a put opertion
+    void timed_put(int key, int value)
+    {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        _cache.put(key, value);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time);
+        log_capacity();
+        cout << "Time Taken for Put(" << key << "," << value << ") is:\t" << time_taken.count() << " ns" << endl;
+    }
+
+    // Measures the time taken for a get opertion
+    int timed_get(int key) noexcept
+    {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        int value = _cache.get(key).value_or(KEY_NOT_FOUND_RET_VAL);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time);
+        log_capacity();
+        cout << "Time Taken for Get(" << key << ") that Returned " << value << " is:\t" << time_taken.count() << " ns" << endl;
+        return value;
+    }
+
+    inline void log_capacity() const noexcept
+    {
+        cout << "LRUCache(" << _cache.capacity() << "): ";
+    }
+    
+    inline void log_initial_cache() const noexcept
+    {
+        log_capacity();
+        cout << "Initial Cache:\t" << _cache << endl;;
+    }
+
+    void populate_to_capacity() // populate the cache to it's full capacity for load test
+    {
+        for ( int i=1; i <= _cache.capacity(); ++i )
+            _cache.put(i, i);
+        assert( _cache.size() == _cache.capacity() );
+        cout << "LRUCache(" << _cache.capacity() << "): ";
+        cout << "Size is now at: " << _cache.size() << endl;
+    }
+
+    // Measures the throughput, hit ratio and latencies of the given load no. of
+    // uniformly random gets and puts (on a miss), over twice the capacity of keys
+    void time_test_load(int load)
+    {
+        int const key_space = static_cast<int>(std::min<size_t>(INT32_MAX / 2, _cache.capacity())) * 2;
+        BenchmarkResult const result = run_benchmark(_cache, make_uniform_keys(load, key_space));
+        assert( _cache.size() <= _cache.capacity() );
+        log_capacity();
+        cout << "Uniform Gets and Puts for " << load << " times:\t" << result << endl;
+    }
+};
+
+// Test the LRUCache with logging
+template <class Cache>
+void TEST_LOGGED(Cache& cache)
+{
+    LoggedOrTimedOpsTester<Cache> tester(cache);
+
+    cout << "\nTEST_LOGGED:" << endl;
+
+    tester.log_initial_cache();
+
+    tester.logged_put(1, 1); // cache is {1=1}
+    tester.logged_put(2, 2); // cache is {1=1, 2=2}
+    tester.logged_get(1);    // return 1
+    tester.logged_put(3, 3); // LRU key was 2, evicts key 2, cache is {1=1, 3=3}
+    tester.logged_get(2);    // returns -1 (not found)
+    tester.logged_put(4, 4); // LRU key was 1, evicts key 1, cache is {4=4, 3=3}
+    tester.logged_get(1);    // return -1 (not found)
+    tester.logged_get(3);    // return 3
+    tester.logged_get(4);    // return 4
+}
+
+// Test the LRUCache for the time taken for each operation and also load avg time
+template <class Cache>
+void TEST_TIMED_AND_LOADED(Cache& cache, int load)
+{
+    LoggedOrTimedOpsTester<Cache> tester(cache);
+
+    cout << "\nTEST_TIMED_AND_LOADED:" << endl;
+ 
+    cout << "\nStarting with empty cache:" << endl;
+    tester.timed_put(1,1);
+    tester.timed_get(1);
+    tester.timed_put(2,2);
+    tester.timed_get(2);
+    tester.timed_put(3,3);
+    tester.timed_get(4);
+    tester.timed_get(4);
+
+    cout << "\nPopulate to full capacity and time the Get and Put:" << endl;
+    tester.populate_to_capacity();
+    tester.timed_put(-1,-2);
+    tester.timed_get(-1);
+    tester.timed_get(-2);
+    tester.timed_put(1,2);
+
+    cout << "\nLoad tested and timed for " << load << " times of Get and Put:" << endl;
+    tester.time_test_load(load);
+}
+
+// Test the ConcurrentLRUCache with the given no. of threads putting and getting
+// overlapping ranges of keys, and time the whole load across all the threads
+template <class Cache>
+void TEST_CONCURRENT(Cache& cache, int threads, int load)
+{
+    cout << "\nTEST_CONCURRENT:" << endl;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        workers.emplace_back([&cache, t, load]()
+        {
+            for ( int i = 0; i < load; ++i )
+            {
+                int const key = t * (load / 2) + i; // each range overlaps the next one by half
+                cache.put(key, key);
+                auto const value = cache.get(key - (load / 50));
+                assert( !value || ((key - (load / 50)) == *value) );
+                (void)value;
+            }
+        });
+    }
+
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    assert( cache.size() <= cache.capacity() );
+    cout << "ConcurrentLRUCache(" << cache.capacity() << ", " << cache.shard_count() << " shards): ";
+    cout << "Time Taken for Put and Get for " << load << " times on " << threads;
+    cout << " threads is:\t" << time_taken.count() << " ms" << endl;
+}
+
+// Test get_or_compute's single flight: the threads all missing a key at once run
+// its loader once between them and all get its value, a failed load goes to all
+// of them and is retried by the next miss, and the keys load independently
+template <class Cache>
+void TEST_GET_OR_COMPUTE(Cache& cache, int threads)
+{
+    std::atomic<int> loads{0};
+    auto slow_loader = [&loads](int key)
+    {
+        ++loads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50)); // so the others pile up behind it
+        return key * 10;
+    };
+
+    std::atomic<int> started{0};
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        workers.emplace_back([&, t]()
+        {
+            ++started;
+            while ( started < threads ) // all miss at once
+            { }
+            int const shared = cache.get_or_compute(7, slow_loader);
+            int const own = cache.get_or_compute(100 + t % 2, slow_loader);
+            assert( 70 == shared );
+            assert( (100 + t % 2) * 10 == own );
+            (void)shared;
+            (void)own;
+        });
+    }
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+    assert( 3 == loads );
+    int const hit = cache.get_or_compute(7, slow_loader);
+    assert( 70 == hit && 3 == loads ); // a hit now
+    (void)hit;
+
+    std::atomic<int> failures{0};
+    auto failing_loader = [&loads](int key) -> int
+    {
+        ++loads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        throw std::runtime_error("backend down for " + std::to_string(key));
+    };
+    workers.clear();
+    for ( int t = 0; t < threads; ++t )
+    {
+        workers.emplace_back([&]()
+        {
+            try
+            {
+                cache.get_or_compute(8, failing_loader);
+            }
+            catch ( std::runtime_error& )
+            {
+                ++failures;
+            }
+        });
+    }
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+    assert( threads == failures && loads <= 3 + threads );
+    auto const failed = cache.get(8);
+    int const reloaded = cache.get_or_compute(8, slow_loader);
+    assert( !failed && 80 == reloaded ); // the next miss loads again
+    (void)failed;
+    (void)reloaded;
+
+    cout << "ConcurrentLRUCache(" << cache.capacity() << "): " << threads << " threads missing at once, "
+         << loads << " loads, " << failures << " failed" << endl;
+}
+
+// Test the batched multi_put and multi_get against one get after the other, with
+// batches of keys that go over the capacity, and repeat within a batch
+template <class Cache>
+void TEST_BATCHED(Cache& cache, int batches)
+{
+    cout << "\nTEST_BATCHED:" << endl;
+
+    constexpr size_t BATCH = 100;
+    int keys[BATCH];
+    int values[BATCH];
+    std::optional<int> found[BATCH];
+    size_t hits = 0;
+
+    auto const start_time = std::chrono::high_resolution_clock::now();
+    for ( int batch = 0; batch < batches; ++batch )
+    {
+        for ( size_t i = 0; i < BATCH; ++i )
+        {
+            keys[i] = static_cast<int>((batch * 37 + i * 13) % 500);
+            values[i] = keys[i];
+        }
+
+        cache.multi_put(keys, values, BATCH);
+        hits += cache.multi_get(keys, BATCH, found);
+
+        for ( size_t i = 0; i < BATCH; ++i )
+        {
+            auto const got = cache.get(keys[i]);
+            assert( found[i] == got ); // the gets don't evict, so they see the same keys
+            assert( !found[i] || keys[i] == *found[i] );
+            (void)got;
+        }
+    }
+    auto const end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> const time_taken = end_time - start_time;
+
+    cout << "Hits for " << batches << " batches of " << BATCH << " keys: " << hits;
+    cout << ", Time taken:\t" << time_taken.count() << " ms" << endl;
+}
+
+// Test the trace capture and replay: a zipfian cache aside run through a TracedCache,
+// with the stack distance replay of its trace checked against the actual LRUCache
+// replaying it at a few capacities, where the two must agree to the hit
+void TEST_TRACE_REPLAY()
+{
+    cout << "\nTEST_TRACE_REPLAY:" << endl;
+
+    std::string const path = (std::filesystem::temp_directory_path() / "LRUCache_test.trace").string();
+    {
+        LRUCache<int, int> cache(64);
+        TraceWriter writer(path);
+        TracedCache<LRUCache<int, int>> traced(cache, writer);
+        for ( int const key : make_zipfian_keys(20000, 1000) )
+        {
+            if ( !traced.get(key) )
+            {
+                traced.put(key, key);
+            }
+        }
+    }
+
+    TraceReader reader(path);
+    std::vector<TraceRecord> const records = reader.read_all();
+    reader.rewind();
+
+    StackDistanceReplay replay(records.size());
+    TraceRecord record;
+    while ( reader.next(record) )
+    {
+        replay.use(record);
+    }
+
+    for ( int const capacity : {16, 64, 256} )
+    {
+        LRUCache<int, int> cache(capacity);
+        BenchmarkResult const result = replay_trace(cache, records);
+        assert( result._hits == static_cast<size_t>(replay.hit_ratio(capacity) * replay.gets() + 0.5) );
+        cout << "LRUCache(" << capacity << "): hit ratio " << result.hit_ratio() * 100 << "% over ";
+        cout << records.size() << " records of " << replay.key_count() << " keys" << endl;
+    }
+
+    std::filesystem::remove(path);
+}
+
+// Test the warm_reserve'd engines through a fill and many evictions past it: only
+// the puts of the fill add a Node, the rest reuse the evicted ones, and the asserts
+// of the array engines are there to catch a reallocation
+template <class Policy>
+void TEST_WARM_RESERVE(const char* engine)
+{
+    LRUCache<int, std::string, std::hash<int>, InstrumentedPolicy<Policy, 1>> cache(1000);
+    cache.warm_reserve();
+
+    for ( int i = 0; i < 10000; ++i )
+    {
+        cache.put(i, std::to_string(i));
+    }
+
+    assert( 1000 == cache.latencies(CacheOp::Allocate).count() ); // the fill, and then no more
+    assert( 9000 == cache.latencies(CacheOp::Evict).count() );
+    cout << engine << ": " << cache.size() << " Nodes allocated by the fill, reused by the rest" << endl;
+}
+
+// Test how much of a working set that's been hit survives a scan of many more keys
+// than the capacity, each got once and put on the miss - all of it, for the
+// SegmentedLRUList, and none of it, for a plain LRU list
+template <class Policy>
+void TEST_SCAN_RESISTANCE(const char* engine)
+{
+    constexpr int HOT_KEYS = 100;
+    LRUCache<int, int, std::hash<int>, Policy> cache(2 * HOT_KEYS);
+
+    for ( int round = 0; round < 2; ++round ) // the hot keys are hit from the second round
+    {
+        for ( int key = 0; key < HOT_KEYS; ++key )
+        {
+            if ( !cache.get(key) )
+            {
+                cache.put(key, key);
+            }
+        }
+    }
+
+    for ( int key = HOT_KEYS; key < 100 * HOT_KEYS; ++key ) // the scan
+    {
+        if ( !cache.get(key) )
+        {
+            cache.put(key, key);
+        }
+    }
+
+    int survived = 0;
+    for ( int key = 0; key < HOT_KEYS; ++key )
+    {
+        survived += cache.peek(key) ? 1 : 0;
+    }
+
+    assert( survived == (std::is_same<Policy, SegmentedLRUPolicy>::value ? HOT_KEYS : 0) );
+    cout << engine << ": " << survived << " of the " << HOT_KEYS << " hot keys survived the scan" << endl;
+}
+
+// a clock the test winds on by hand, for the deadlines to be exact
+struct ManualClock
+{
+    static inline uint64_t _now_ms = 1000;
+
+    uint64_t now_ms() const noexcept
+    {
+        return _now_ms;
+    }
+};
+
+// Test the entries put with a ttl going at their deadline: a get of an expired
+// one is a miss and frees it, a peek is a miss, expire sweeps them all and the
+// puts sweep them too, bit by bit. The array engines relocate a Node on each erase
+template <class Policy>
+void TEST_EXPIRY(const char* engine)
+{
+    LRUCache<int, std::string, std::hash<int>, CountedPolicy<ExpiringPolicy<Policy, ManualClock>>> cache(100);
+    using std::chrono::milliseconds;
+
+    cache.put(1, "one", milliseconds(100));
+    cache.put(2, "two"); // never expires
+    cache.put(3, "three", milliseconds(50));
+    cache.put(4, "four", milliseconds(10));
+    cache.put(4, "for ever"); // the update keeps no deadline
+
+    ManualClock::_now_ms += 60;
+    auto const expired = cache.get(3);
+    assert( !expired && 3 == cache.size() );
+    (void)expired;
+    assert( "one" == *cache.peek(1) && "for ever" == *cache.peek(4) );
+
+    ManualClock::_now_ms += 50;
+    assert( !cache.peek(1) && 3 == cache.size() ); // left for the sweep
+    size_t const swept = cache.expire(SIZE_MAX);
+    assert( 1 == swept && 2 == cache.size() );
+    (void)swept;
+
+    for ( int key = 10; key < 60; ++key )
+    {
+        cache.put(key, std::to_string(key), milliseconds(key % 2 ? 10 : 1000));
+    }
+    ManualClock::_now_ms += 20;
+    for ( int i = 0; i < 1000; ++i ) // updates, which sweep a few slots each
+    {
+        cache.put(2, "two");
+    }
+    assert( 25 + 2 == cache.size() && 1 + 1 + 25 == cache.stats()._evictions );
+    for ( int key = 10; key < 60; ++key )
+    {
+        bool const held = cache.get(key).has_value();
+        assert( (key % 2 == 0) == held );
+        (void)held;
+    }
+
+    cout << engine << ": " << cache.stats()._evictions << " expired, " << cache.size() << " left" << endl;
+}
+
+// Test a snapshot round trip: the entries load back in their recency order (the
+// LRU one is the next evicted), the expired ones are left out, a smaller cache
+// keeps the MRU ones that fit, and a torn file throws and leaves the cache as is
+template <class Policy>
+void TEST_SNAPSHOT(const char* engine)
+{
+    std::string const path = (std::filesystem::temp_directory_path() / "lrucache_test.snapshot").string();
+    using Cache = LRUCache<int, std::string, std::hash<int>, ExpiringPolicy<Policy, ManualClock>>;
+    using std::chrono::milliseconds;
+
+    Cache saved(100);
+    for ( int key = 0; key < 100; ++key )
+    {
+        saved.put(key, std::string(key, 'x'));
+    }
+    saved.put(7, "seven", milliseconds(10));
+    saved.put(8, "eight", milliseconds(1000));
+    ManualClock::_now_ms += 20;
+    saved.save_snapshot(path);
+
+    Cache loaded(100);
+    size_t const loaded_count = loaded.load_snapshot(path);
+    assert( 99 == loaded_count && !loaded.peek(7) && "eight" == *loaded.peek(8) );
+    auto const contents = [](const std::string& file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    loaded.save_snapshot(path + ".again"); // the same entries in the same order, the same ms left
+    bool const same = ( contents(path) == contents(path + ".again") );
+    assert( same );
+    (void)same;
+    std::filesystem::remove(path + ".again");
+
+    ManualClock::_now_ms += 1000; // the ms it had left count on from the load
+    auto const expired = loaded.get(8);
+    assert( !expired );
+    (void)expired;
+
+    LRUCache<int, std::string, std::hash<int>, Policy> smaller(10);
+    size_t const fitted = smaller.load_snapshot(path);
+    assert( 10 == fitted );
+    (void)fitted;
+    {
+        SnapshotReader const reader(path);
+        for ( size_t i = 0; i < reader.size(); ++i )
+        {
+            int key = 0;
+            std::string value;
+            uint64_t ttl_ms = 0;
+            reader.read(i, key, value, ttl_ms);
+            assert( (i < 10) == smaller.peek(key).has_value() );
+        }
+    }
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+    bool torn = false;
+    try
+    {
+        smaller.load_snapshot(path);
+    }
+    catch ( std::runtime_error& )
+    {
+        torn = true;
+    }
+    assert( torn && 10 == smaller.size() );
+    (void)torn;
+    std::filesystem::remove(path);
+
+    ConcurrentLRUCache<int, std::string> concurrent(64, 4);
+    for ( int key = 0; key < 64; ++key )
+    {
+        concurrent.put(key, std::to_string(key));
+    }
+    concurrent.save_snapshot(path);
+    ConcurrentLRUCache<int, std::string> reloaded(64, 4);
+    size_t const reloaded_count = reloaded.load_snapshot(path);
+    auto const reloaded_value = reloaded.get(42);
+    assert( concurrent.size() == reloaded_count && "42" == *reloaded_value );
+    (void)reloaded_count;
+    std::filesystem::remove(path);
+
+    cout << engine << ": " << loaded_count << " loaded, in order" << endl;
+}
+
+// Test the SnapshotCheckpointer snapshotting a ConcurrentLRUCache while threads are
+// putting and getting: they carry on meanwhile, the writes take at least as long as
+// they're paced to, and the last snapshot loads back whole, with consistent entries
+// Then each snapshot taken while a thread puts laps of the keys is as of one point
+// in time, with the generations of the keys stepping down at most once, in key order
+void TEST_BACKGROUND_SNAPSHOT()
+{
+    cout << "\nTEST_BACKGROUND_SNAPSHOT:" << endl;
+    std::string const path = (std::filesystem::temp_directory_path() / "lrucache_background.snapshot").string();
+    using Cache = ConcurrentLRUCache<int, std::string>;
+
+    Cache cache(20000, 4);
+    for ( int key = 0; key < 20000; ++key )
+    {
+        cache.put(key, std::to_string(key));
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> ops{0};
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < 2; ++t )
+    {
+        workers.emplace_back([&cache, &done, &ops, t]()
+        {
+            std::minstd_rand random(t);
+            while ( !done )
+            {
+                int const key = static_cast<int>(random() % 40000);
+                cache.put(key, std::to_string(key));
+                auto const value = cache.get(key / 2);
+                assert( !value || (std::to_string(key / 2) == *value) );
+                ++ops;
+            }
+        });
+    }
+
+    size_t const bytes_per_second = 1 << 20;
+    size_t snapshot_entries = 0;
+    auto const start_time = std::chrono::steady_clock::now();
+    size_t ops_during = ops;
+    {
+        SnapshotCheckpointer<Cache> checkpointer(cache, path, std::chrono::milliseconds(20), bytes_per_second);
+        while ( 2 > checkpointer.checkpoints() )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        assert( checkpointer.last_error().empty() );
+        snapshot_entries = checkpointer.entries();
+    }
+    auto const time_taken = std::chrono::steady_clock::now() - start_time;
+    ops_during = ops - ops_during;
+    done = true;
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+
+    size_t const snapshot_bytes = std::filesystem::file_size(path);
+    assert( std::chrono::duration<double>(time_taken).count() >= static_cast<double>(snapshot_bytes) / bytes_per_second );
+    assert( 0 < ops_during );
+
+    Cache reloaded(20000, 4);
+    size_t const reloaded_count = reloaded.load_snapshot(path);
+    assert( snapshot_entries == reloaded_count );
+    (void)reloaded_count;
+    for ( int key = 0; key < 40000; ++key )
+    {
+        auto const value = reloaded.get(key);
+        assert( !value || (std::to_string(key) == *value) );
+    }
+
+    int const lap_keys = 4096;
+    ConcurrentLRUCache<int, int> laps(2 * lap_keys, 4);
+    for ( int key = 0; key < lap_keys; ++key )
+    {
+        laps.put(key, 0);
+    }
+
+    std::atomic<bool> lapping{true};
+    std::thread lapper([&laps, &lapping, lap_keys]()
+    {
+        for ( int generation = 1; lapping; ++generation )
+        {
+            for ( int key = 0; key < lap_keys; ++key )
+            {
+                laps.put(key, generation);
+            }
+        }
+    });
+
+    int last_generation = 0;
+    for ( int snapshot = 0; snapshot < 10; ++snapshot )
+    {
+        laps.save_snapshot(path, bytes_per_second); // a shard every few ms
+        ConcurrentLRUCache<int, int> loaded(2 * lap_keys, 4);
+        size_t const lap_count = loaded.load_snapshot(path);
+        assert( static_cast<size_t>(lap_keys) == lap_count );
+        (void)lap_count;
+
+        auto const first = loaded.get(0);
+        auto const last = loaded.get(lap_keys - 1);
+        assert( first && last && (*first - *last <= 1) );
+        int generation = *first;
+        for ( int key = 1; key < lap_keys; ++key )
+        {
+            auto const value = loaded.get(key);
+            assert( value && ((generation == *value) || (generation - 1 == *value)) );
+            generation = *value;
+        }
+        (void)last;
+        (void)generation;
+        last_generation = *first;
+    }
+    lapping = false;
+    lapper.join();
+    std::filesystem::remove(path);
+
+    cout << "ConcurrentLRUCache(" << cache.capacity() << "): snapshots of " << snapshot_entries << " entries ("
+         << snapshot_bytes << " bytes) paced to " << bytes_per_second << " bytes/s, while serving" << endl;
+    cout << "ConcurrentLRUCache(" << laps.capacity() << "): 10 snapshots of " << lap_keys
+         << " keys as of a point in time each, the last at generation " << last_generation << endl;
+}
+
+// Test the HugePageRegion (in huge pages where the pool has them to spare, else in
+// the transparent ones), and the caches of the HugePageLRUPolicy on top of it, one
+// with its shards spread over the NUMA nodes
+void TEST_HUGE_PAGES()
+{
+    cout << "\nTEST_HUGE_PAGES:" << endl;
+    size_t const region_bytes = size_t{4} << 20;
+    HugePageRegion region(region_bytes);
+    assert( 0 == reinterpret_cast<uintptr_t>(region.data()) % region.page_bytes() );
+    std::memset(region.data(), 0xAB, region_bytes);
+
+    LRUCache<std::string, std::string, std::hash<std::string>, HugePageLRUPolicy> cache(100000);
+    for ( int i = 0; i < 200000; ++i )
+    {
+        cache.put(std::to_string(i), std::to_string(i * 2));
+    }
+    auto const evicted = cache.get("0");
+    auto const held = cache.get("199999");
+    assert( 100000 == cache.size() && !evicted && "399998" == *held );
+
+    ConcurrentLRUCache<int, int, std::hash<int>, HugePageLRUPolicy> sharded(100000, 8);
+    for ( int key = 0; key < 100000; ++key )
+    {
+        sharded.put(key, key);
+        assert( sharded.numa_node(key) < static_cast<int>(numa_node_count()) );
+    }
+    auto const answer = sharded.get(42);
+    assert( 42 == *answer );
+    (void)answer;
+
+    cout << "HugePageRegion(" << (region_bytes >> 20) << " MB): in pages of " << region.page_bytes() / 1024
+         << " KB; " << sharded.shard_count() << " shards over " << numa_node_count() << " NUMA node(s)" << endl;
+}
+
+// Test the FlashTier under a tiered (LRU or CLOCK) cache: the evicted entries go to it, and
+// a get that misses takes them back, from the segments on flash or still in memory,
+// but not the expired ones, and once the ring laps, the oldest ones are gone for good
+// A clear drops the cache's own entries from the tier, not another cache's
+// The tier is flushed now and then, so that no demotion is dropped with its writer behind
+template <class Policy>
+void TEST_FLASH_TIER(const char* engine)
+{
+    std::string const path = (std::filesystem::temp_directory_path() / "lrucache_test.tier").string();
+    using Cache = LRUCache<int, std::string, std::hash<int>, TieredPolicy<ExpiringPolicy<Policy, ManualClock>>>;
+    using std::chrono::milliseconds;
+
+    FlashTier<int, std::string> tier(path, 1 << 20, 4096);
+    Cache cache(100, tier);
+    for ( int key = 0; key < 1000; ++key )
+    {
+        cache.put(key, "value " + std::to_string(key));
+    }
+    tier.flush();
+    assert( 100 == cache.size() && 900 == tier.size() && 0 == tier.stats()._dropped );
+
+    // the first ones from flash, the last ones from memory, all of them from the tier, as
+    // the ones promoted first have had the ones that were still held demoted by then
+    for ( int key = 0; key < 1000; ++key )
+    {
+        auto const promoted = cache.get(key);
+        assert( "value " + std::to_string(key) == *promoted );
+        if ( 0 == key % 100 )
+        {
+            tier.flush();
+        }
+    }
+    assert( 1000 == tier.stats()._hits && 900 == tier.size() && 0 == tier.stats()._dropped );
+
+    cache.put(5000, "short lived", milliseconds(10));
+    cache.put(5001, "long lived", milliseconds(1000));
+    for ( int key = 0; key < 100; ++key ) // evicts both
+    {
+        cache.put(key, "value " + std::to_string(key));
+    }
+    ManualClock::_now_ms += 20;
+    auto const short_lived = cache.get(5000);
+    auto const long_lived = cache.get(5001);
+    assert( !short_lived && "long lived" == *long_lived );
+    ManualClock::_now_ms += 1000;
+    auto const expired = cache.get(5001);
+    assert( !expired ); // the deadline came back with it
+
+    FlashTier<int, std::string> small_tier(path + ".small", 2 * 4096, 4096);
+    Cache lapped(10, small_tier);
+    for ( int key = 0; key < 10000; ++key )
+    {
+        lapped.put(key, "value " + std::to_string(key));
+        if ( 0 == key % 100 )
+        {
+            small_tier.flush();
+        }
+    }
+    assert( small_tier.size() < 2 * 4096 / 8 );
+    size_t found = 0;
+    for ( int key = 0; key < 10000; ++key )
+    {
+        auto const value = lapped.peek(key) ? lapped.peek(key) : lapped.get(key);
+        assert( !value || ("value " + std::to_string(key) == *value) );
+        found += value.has_value();
+    }
+    auto const lapped_first = lapped.get(0);
+    auto const lapped_last = lapped.get(9999);
+    assert( !lapped_first && lapped_last );
+
+    // a clear drops the cache's own entries from the tier, not those of another cache
+    // sharing it, of other keys
+    Cache sharing(10, tier);
+    for ( int key = 10000; key < 10020; ++key )
+    {
+        sharing.put(key, "value " + std::to_string(key));
+    }
+    cache.clear();
+    size_t const left = tier.size();
+    assert( 0 == cache.size() && 10 == left );
+    (void)left;
+    auto const kept = sharing.get(10000);
+    auto const dropped = cache.get(0);
+    assert( kept && ("value 10000" == *kept) && !dropped );
+    (void)kept;
+    (void)dropped;
+
+    cout << engine << ": " << tier.stats() << "; a ring of " << small_tier.segment_count() << " segments had "
+         << found << " of 10000 keys" << endl;
+}
+
+// Test the shards of a tiered ConcurrentLRUCache sharing the one tier, under threads
+// putting and getting keys of their own
+void TEST_CONCURRENT_FLASH_TIER()
+{
+    std::string const path = (std::filesystem::temp_directory_path() / "lrucache_concurrent.tier").string();
+    FlashTier<int, std::string> tier(path, 1 << 22, 1 << 16);
+    ConcurrentLRUCache<int, std::string, std::hash<int>, TieredPolicy<LinkedLRUPolicy>> cache(256, tier, 4);
+
+    std::vector<std::thread> workers;
+    std::atomic<size_t> hits{0};
+    for ( int t = 0; t < 4; ++t )
+    {
+        workers.emplace_back([&cache, &hits, t]()
+        {
+            for ( int i = 0; i < 2000; ++i )
+            {
+                int const key = t * 100000 + i;
+                cache.put(key, std::to_string(key));
+                auto const value = cache.get(key - 500);
+                assert( !value || (std::to_string(key - 500) == *value) );
+                hits += value.has_value();
+            }
+        });
+    }
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+    assert( 0 < hits );
+
+    cout << "ConcurrentLRUCache(" << cache.capacity() << "): " << hits << " of the gets past its capacity hit the tier, "
+         << tier.stats() << endl;
+}
+
+// Test the EvictionQueue: the entries a notifying cache evicts or expires reach the
+// listener in batches, in the order they left in, from the shards of a concurrent
+// one too, and a queue too small for a slow listener drops and counts the rest
+void TEST_EVICTION_LISTENER()
+{
+    cout << "\nTEST_EVICTION_LISTENER:" << endl;
+    using Queue = EvictionQueue<int, std::string>;
+    using std::chrono::milliseconds;
+
+    std::vector<Queue::entry_type> heard; // only ever touched by the listener, until flushed
+    size_t batches = 0;
+    Queue queue([&heard, &batches](std::vector<Queue::entry_type>& batch)
+    {
+        std::move(batch.begin(), batch.end(), std::back_inserter(heard));
+        ++batches;
+    }, 1 << 10, 64);
+
+    LRUCache<int, std::string, std::hash<int>, NotifyingPolicy<ExpiringPolicy<LinkedLRUPolicy, ManualClock>>> cache(100);
+    cache.set_eviction_queue(queue);
+    for ( int key = 0; key < 1000; ++key )
+    {
+        cache.put(key, std::to_string(key));
+    }
+    cache.put(1000, "short lived", milliseconds(10)); // evicts 900
+    ManualClock::_now_ms += 20;
+    auto const expired = cache.get(1000); // expires it, onto the queue
+    assert( !expired );
+    (void)expired;
+    queue.flush();
+
+    assert( 902 == heard.size() && 902 == queue.delivered() && 0 == queue.dropped() );
+    for ( int key = 0; key <= 900; ++key )
+    {
+        assert( (key == heard[key]._key) && (std::to_string(key) == heard[key]._value) );
+        assert( EvictionCause::Evicted == heard[key]._cause );
+    }
+    assert( 1000 == heard.back()._key && EvictionCause::Expired == heard.back()._cause );
+    size_t const single_batches = batches;
+
+    std::atomic<size_t> concurrent_heard{0};
+    std::atomic<bool> mismatched{false};
+    EvictionQueue<int, int> concurrent_queue([&concurrent_heard, &mismatched](std::vector<EvictedEntry<int, int>>& batch)
+    {
+        for ( auto const &entry : batch )
+        {
+            mismatched = mismatched || ( entry._value != -entry._key );
+        }
+        concurrent_heard += batch.size();
+    });
+    ConcurrentLRUCache<int, int, std::hash<int>, NotifyingPolicy<LinkedLRUPolicy>> sharded(256, 4);
+    sharded.set_eviction_queue(concurrent_queue);
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < 4; ++t )
+    {
+        workers.emplace_back([&sharded, t]()
+        {
+            for ( int key = t * 100000; key < t * 100000 + 5000; ++key )
+            {
+                sharded.put(key, -key);
+            }
+        });
+    }
+    for ( auto &worker : workers )
+    {
+        worker.join();
+    }
+    concurrent_queue.flush();
+    assert( 4 * 5000 == sharded.size() + concurrent_heard + concurrent_queue.dropped() && !mismatched );
+
+    EvictionQueue<int, int> slow_queue([](std::vector<EvictedEntry<int, int>>&)
+    {
+        std::this_thread::sleep_for(milliseconds(5));
+    }, 8, 4);
+    LRUCache<int, int, std::hash<int>, NotifyingPolicy<LinkedLRUPolicy>> slow(10);
+    slow.set_eviction_queue(slow_queue);
+    for ( int key = 0; key < 1010; ++key )
+    {
+        slow.put(key, key);
+    }
+    slow_queue.flush();
+    assert( 1000 == slow_queue.delivered() + slow_queue.dropped() && 0 < slow_queue.dropped() );
+
+    cout << "LRUCache(" << cache.capacity() << "): " << heard.size() << " evicted or expired, heard in " << single_batches
+         << " batches; ConcurrentLRUCache(" << sharded.capacity() << "): " << concurrent_heard << " heard, "
+         << concurrent_queue.dropped() << " dropped; a slow listener's queue of " << slow_queue.capacity() << ": "
+         << slow_queue.dropped() << " of 1000 dropped" << endl;
+}
+
+// Puts to a write-back cache of the Policy, erases a third of the entries, dirty and
+// clean (their slots then taken by others, in the engines that keep their Nodes dense),
+// and flushes, checking that each entry's last value is written back, the once
+// Returns the no. of writes
+template <class Policy>
+size_t check_write_back_after_erases()
+{
+    using Queue = WriteBackQueue<int, std::string>;
+    std::unordered_map<int, std::string> store;
+    size_t writes = 0;
+    Queue queue([&store, &writes](std::vector<Queue::entry_type>& batch)
+    {
+        for ( auto const &entry : batch )
+        {
+            store[entry.first] = entry.second;
+        }
+        writes += batch.size();
+    });
+
+    LRUCache<int, std::string, std::hash<int>, WriteBackPolicy<Policy>> cache(100);
+    cache.set_write_back_queue(queue);
+    for ( int key = 0; key < 100; ++key )
+    {
+        cache.put(key, std::to_string(key));
+    }
+    size_t const all_flushed = cache.flush_dirty();
+    queue.flush(); // so none of them is coalesced with the writes that follow
+    for ( int key = 0; key < 100; key += 2 )
+    {
+        cache.put(key, std::to_string(key + 1000));
+    }
+    size_t const erased = cache.erase_if([](int key, const std::string&) { return 0 == key % 3; }); // 17 of them dirty
+    size_t const dirty = cache.dirty_count();
+    size_t const flushed = cache.flush_dirty();
+    size_t const none_flushed = cache.flush_dirty();
+    queue.flush();
+    assert( 100 == all_flushed && 34 == erased && 33 == dirty && 33 == flushed && 0 == none_flushed );
+    assert( 100 + 17 + 33 == writes && 100 == store.size() );
+    for ( int key = 0; key < 100; ++key )
+    {
+        assert( std::to_string((0 == key % 2) ? key + 1000 : key) == store[key] );
+    }
+    (void)all_flushed;
+    (void)erased;
+    (void)dirty;
+    (void)flushed;
+    (void)none_flushed;
+    return writes;
+}
+
+// Test the write-back caches: the puts of a key collapse into one write, written back
+// by a flush or once evicted, the loaded values are held clean, clear and a failing
+// store lose nothing, and a flusher writes a concurrent cache's back as it's served
+// The dirty ones are tracked through the erases of each engine, which may move them
+void TEST_WRITE_BACK()
+{
+    cout << "\nTEST_WRITE_BACK:" << endl;
+    using Queue = WriteBackQueue<int, std::string>;
+
+    std::unordered_map<int, std::string> store; // only ever touched by the writer, until flushed
+    size_t writes = 0;
+    bool fail_next = false;
+    Queue queue([&store, &writes, &fail_next](std::vector<Queue::entry_type>& batch)
+    {
+        if ( fail_next )
+        {
+            fail_next = false;
+            throw std::runtime_error("store unavailable");
+        }
+        for ( auto &entry : batch )
+        {
+            store[entry.first] = std::move(entry.second);
+        }
+        writes += batch.size();
+    }, 64, std::chrono::milliseconds(1));
+
+    LRUCache<int, std::string, std::hash<int>, WriteBackPolicy<LinkedLRUPolicy>> cache(100);
+    cache.set_write_back_queue(queue);
+    for ( int round = 0; round < 10; ++round )
+    {
+        for ( int key = 0; key < 50; ++key )
+        {
+            cache.put(key, std::to_string(key * round));
+        }
+    }
+    size_t const dirty = cache.dirty_count();
+    size_t const flushed = cache.flush_dirty();
+    assert( 50 == dirty && 50 == flushed && 0 == cache.dirty_count() );
+    queue.flush();
+    assert( 50 == writes && 50 == store.size() && "45" == store[5] );
+
+    std::string const loaded = cache.get_or_compute(1000, [](int) { return std::string("loaded"); });
+    assert( "loaded" == loaded && 0 == cache.dirty_count() );
+    for ( int key = 100; key < 300; ++key ) // evicts the clean ones, then the first 100 dirty ones
+    {
+        cache.put(key, std::to_string(key));
+    }
+    queue.flush();
+    assert( 150 == writes && !store.count(1000) && "199" == store[199] && !store.count(200) );
+
+    fail_next = true;
+    cache.clear();
+    queue.flush();
+    assert( 250 == writes && "299" == store[299] && 1 == queue.failures() && "store unavailable" == queue.last_error() );
+    assert( 0 == queue.lost() );
+
+    // a put refused for its weight leaves the entry it was to update as clean as it was
+    LRUCache<int, std::string, std::hash<int>, WeightedPolicy<WriteBackPolicy<LinkedLRUPolicy>>> weighed(10, WeightBudget{4096});
+    weighed.set_write_back_queue(queue);
+    weighed.fill(1, "clean");
+    bool refused = false;
+    try
+    {
+        weighed.put(1, std::string(8192, 'x'));
+    }
+    catch ( std::length_error& )
+    {
+        refused = true;
+    }
+    size_t const refused_dirty = weighed.dirty_count();
+    size_t const refused_flushed = weighed.flush_dirty();
+    auto const kept = weighed.peek(1);
+    assert( refused && 0 == refused_dirty && 0 == refused_flushed && "clean" == *kept );
+    weighed.put(1, "dirty");
+    size_t const put_dirty = weighed.dirty_count();
+    size_t const put_flushed = weighed.flush_dirty();
+    assert( 1 == put_dirty && 1 == put_flushed );
+    (void)dirty;
+    (void)flushed;
+    (void)refused;
+    (void)refused_dirty;
+    (void)refused_flushed;
+    (void)put_dirty;
+    (void)put_flushed;
+
+    size_t const linked_writes = check_write_back_after_erases<LinkedLRUPolicy>();
+    size_t const indexed_writes = check_write_back_after_erases<IndexedLRUPolicy>();
+    size_t const clock_writes = check_write_back_after_erases<ClockPolicy>();
+    assert( linked_writes == indexed_writes && indexed_writes == clock_writes );
+    (void)indexed_writes;
+    (void)clock_writes;
+
+    std::atomic<size_t> concurrent_writes{0};
+    std::vector<std::atomic<int>> written(4 * 1000);
+    WriteBackQueue<int, int> concurrent_queue([&concurrent_writes, &written](std::vector<std::pair<int, int>>& batch)
+    {
+        for ( auto const &entry : batch )
+        {
+            written[entry.first] = entry.second;
+        }
+        concurrent_writes += batch.size();
+    });
+    using Concurrent = ConcurrentLRUCache<int, int, std::hash<int>, WriteBackPolicy<LinkedLRUPolicy>>;
+    size_t const puts = 4 * 50 * 1000;
+    {
+        Concurrent sharded(2000, 4);
+        sharded.set_write_back_queue(concurrent_queue);
+        WriteBackFlusher<Concurrent> flusher(sharded, std::chrono::milliseconds(2));
+        std::vector<std::thread> workers;
+        for ( int t = 0; t < 4; ++t )
+        {
+            workers.emplace_back([&sharded, t]()
+            {
+                for ( int round = 0; round < 50; ++round )
+                {
+                    for ( int key = t * 1000; key < (t + 1) * 1000; ++key )
+                    {
+                        sharded.put(key, round);
+                    }
+                }
+            });
+        }
+        for ( auto &worker : workers )
+        {
+            worker.join();
+        }
+    } // the flusher stops, and the shards write the rest back as they go
+    concurrent_queue.flush();
+    auto const latest = std::count_if(written.begin(), written.end(), [](const std::atomic<int>& last) { return 49 == last; });
+    assert( static_cast<size_t>(latest) == written.size() );
+    (void)latest;
+    assert( concurrent_writes < puts );
+
+    cout << "LRUCache(" << cache.capacity() << "): 500 puts of 50 keys written back as 50, " << queue.coalesced()
+         << " coalesced in the queue; ConcurrentLRUCache: " << puts << " puts written back as " << concurrent_writes << endl;
+    cout << "Linked, Indexed and Clock LRUCache(100): " << linked_writes << " writes each, through a third erased" << endl;
+}
+
+// Churns an index through random adds and erases of the keys make_key(0 ... key_space),
+// checking every lookup against an unordered_map, at up to max_size keys, so the
+// tombstones pile up and are rehashed away, and then walks its slots for the keys
+template <class Index, class MakeKey>
+void churn_hash_index(Index& index, size_t max_size, int key_space, MakeKey make_key)
+{
+    using Key = decltype(make_key(0));
+    std::unordered_map<Key, uint32_t> model;
+    std::mt19937_64 random(7);
+
+    for ( uint32_t op = 0; op < 200000; ++op )
+    {
+        Key const key = make_key(static_cast<int>(random() % key_space));
+        auto const held = model.find(key);
+        uint32_t *const found = index.find(key);
+        assert( (model.end() == held) ? (nullptr == found) : ((nullptr != found) && (held->second == *found)) );
+        (void)found;
+
+        if ( model.end() != held )
+        {
+            index.erase(key);
+            model.erase(held);
+        }
+        else if ( model.size() < max_size )
+        {
+            auto const emplaced = index.try_emplace(key, op);
+            assert( emplaced.second && (op == *emplaced.first) );
+            (void)emplaced;
+            model.emplace(key, op);
+        }
+        assert( model.size() == index.size() );
+    }
+
+    size_t walked = 0;
+    for ( size_t slot = 0; slot < index.slot_count(); ++slot )
+    {
+        walked += ( nullptr != index.handle_at(slot) );
+    }
+    assert( model.size() == walked );
+    for ( auto const &entry : model )
+    {
+        uint32_t const *const found = index.find(entry.first);
+        assert( (nullptr != found) && (entry.second == *found) );
+        (void)found;
+    }
+}
+
+// Test the TagHashIndex against a model of it, on strided int keys (which std::hash
+// leaves as they are) and on string keys, with the tombstones churned, and then as an
+// LRUCache's map, which has to make it a hit or a miss for each get just as the
+// FlatHashIndex does, and time the lookups of strided int and of string keys in both
+void TEST_TAG_INDEX()
 {
-    int _capacity{-1};
-    LRUTwoWayList _lru_list; // our custom two way list that contains MRU to LRU
-    // unordered hash map to hold the key and the corresponding Node in the list
-    // Again shared_ptr could have been used here, skipped for now
-    std::unordered_map<int, TwoWayListNode*> _lru_cache_map;
+    cout << "\nTEST_TAG_INDEX:" << endl;
 
-  public:
-    explicit LRUCache(int capacity)
-     : _capacity(capacity)
+    TagHashIndex<int, uint32_t> strided(1000);
+    churn_hash_index(strided, 1001, 4000, [](int i) { return i * 1024; });
+    TagHashIndex<std::string, uint32_t> named(100);
+    churn_hash_index(named, 101, 300, [](int i) { return std::to_string(i) + "-key"; });
+    TagHashIndex<int, uint32_t> tiny(1); // a single group of slots
+    churn_hash_index(tiny, 2, 8, [](int i) { return i; });
+
+    std::vector<int> keys = make_zipfian_keys(200000, 20000);
+    for ( int &key : keys )
     {
-        if ( 0 >= capacity )
+        key *= 4096;
+    }
+    LRUCache<int, int> flat(1000);
+    LRUCache<int, int, std::hash<int>, TagProbedPolicy<LinkedLRUPolicy>> tagged(1000);
+    for ( int const key : keys )
+    {
+        auto const hit = flat.get(key);
+        auto const tagged_hit = tagged.get(key);
+        assert( hit == tagged_hit );
+        (void)tagged_hit;
+        if ( !hit )
         {
-            throw InvalidCapacityException; // capacity cannot be negative
+            flat.put(key, key);
+            tagged.put(key, key);
         }
     }
+    assert( flat.size() == tagged.size() );
 
-    // Returns the value for the key, if the key exists. otherwise, returns -1.
-    // While doing so, moves the Node of the found key to the front of the list
-    // thus making it the MRU
-    int get(int key) noexcept
+    // lookups in random order, half of them misses, in tables at their 3/4 load factor
+    constexpr int KEYS = 98303;
+    auto const time_lookups = [](auto& index, const auto& lookups)
     {
-        auto const iter = _lru_cache_map.find(key); // find the key in the map
-
-        if (  iter == _lru_cache_map.end() ) // when the key is not found in the map
+        size_t found = 0;
+        auto const started = std::chrono::steady_clock::now();
+        for ( int round = 0; round < 4; ++round )
         {
-            return KEY_NOT_FOUND_RET_VAL; // return -1
+            for ( auto const &key : lookups )
+            {
+                found += ( nullptr != index.find(key) );
+            }
+        }
+        auto const elapsed = std::chrono::steady_clock::now() - started;
+        assert( 2 * lookups.size() == found );
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (4.0 * lookups.size());
+    };
+    auto const time_both = [&time_lookups](auto make_key)
+    {
+        using Key = decltype(make_key(0));
+        FlatHashIndex<Key, uint32_t> flat_index(KEYS);
+        TagHashIndex<Key, uint32_t> tag_index(KEYS);
+        std::vector<Key> lookups;
+        for ( int i = 0; i < 2 * KEYS; ++i )
+        {
+            lookups.push_back(make_key(i));
+            if ( i < KEYS )
+            {
+                flat_index.try_emplace(lookups.back(), i);
+                tag_index.try_emplace(lookups.back(), i);
+            }
         }
+        std::shuffle(lookups.begin(), lookups.end(), std::mt19937(3));
+        return std::make_pair(time_lookups(flat_index, lookups), time_lookups(tag_index, lookups));
+    };
+    auto const strided_ns = time_both([](int i) { return i * 1024; });
+    auto const named_ns = time_both([](int i) { return std::to_string(i) + "-key"; });
 
-        // When the key is found, pass the associated Node to the list to make it front
-        _lru_list.move_to_front(iter->second);
+    cout << "TagHashIndex(" << KEYS << "), " << TagGroup::WIDTH << " tags a probe: " << strided_ns.second
+         << "ns a lookup of strided int keys (the FlatHashIndex " << strided_ns.first << "ns), "
+         << named_ns.second << "ns of string keys (" << named_ns.first << "ns)" << endl;
+}
 
-        return iter->second->_value; // return the value from the node
-    }
+// The no. of allocations made by the thread so far, so a test can tell that a stretch
+// of code allocates nothing. They're counted by the operator new below, which replaces
+// the global one for the whole program, so it's only there in a test build, with
+// LRUCACHE_COUNT_ALLOCATIONS defined, and the count stays 0 otherwise
+inline size_t& thread_allocations() noexcept
+{
+    static thread_local size_t allocations = 0;
+    return allocations;
+}
 
-    // Updates the value of the key, if it already exists in the map.
-    // If the key doesn't exist in the map, it adds the key and makes it the MRU
-    // when the set capacity hasn't been reached yet
-    // If the set capacity has been reached, evicts the LRU key from map, and then
-    // adds the new key and value (i.e. Node) to map and makes the Node as front
-    void put(int key, int value)
+#ifdef LRUCACHE_COUNT_ALLOCATIONS
+#include <cstdlib>
+
+// Kept out of line, the operator new and deletes, or GCC takes the free of an inlined
+// delete for a mismatch
+[[gnu::noinline]] void* operator new(size_t bytes)
+{
+    ++thread_allocations();
+    if ( void *const allocated = std::malloc(bytes ? bytes : 1) )
     {
-        auto iter = _lru_cache_map.find(key); // find the key in the map
+        return allocated;
+    }
+    throw std::bad_alloc();
+}
 
-        if ( iter != _lru_cache_map.end() ) // when the key is found in the map
-        {
-            iter->second->_value = value; // just update the value
-            _lru_list.move_to_front(iter->second); // make the corresponding node MRU in the list
-            return;
-        }
+[[gnu::noinline]] void operator delete(void *allocated) noexcept
+{
+    std::free(allocated);
+}
 
-        TwoWayListNode* new_node{nullptr}; // to capture the new node to add to the map later
+[[gnu::noinline]] void operator delete(void *allocated, size_t) noexcept
+{
+    std::free(allocated);
+}
+#endif
 
-        if ( _lru_list.size() == _capacity ) // when the size has reached the capacity limits
-        {
-            new_node = _lru_list.back(); // get the Node at the back, which will be the LRU
-            _lru_cache_map.erase(new_node->_key); //remove the key from the map, but retain the node
-            new_node->_key = key; // update the new key to the removed node 
-            // set the corresponding value for the new key in the Node (reused)
-            // deleting the old value may be needed here, when the value type is a pointer
-            new_node->_value = value;
-            _lru_list.move_to_front(new_node); // make the new node the MRU in the list
-        }
-        else // when the key not found and the size has not reached the capacity limits
+// Runs zipfian gets, puts and erases on the FixedLRUCache and an LRUCache of the same
+// capacity, and returns the no. of allocations the FixedLRUCache's own ops made
+template <size_t N>
+size_t check_fixed_against_lru_cache(FixedLRUCache<int, int, N>& fixed)
+{
+    size_t fixed_allocations = 0;
+    LRUCache<int, int> model(static_cast<int>(N));
+    std::vector<int> keys = make_zipfian_keys(100000, 8 * static_cast<int>(N));
+    for ( size_t op = 0; op < keys.size(); ++op )
+    {
+        int const key = keys[op] * 1024; // strided, as std::hash leaves the ints as they are
+        if ( 0 == op % 7 )
         {
-            try // try adding a new node for the key to the front of the list
-            {
-                new_node = _lru_list.add_to_front(key, value);
-            }
-            catch(std::exception &except) // bad_alloc may be thrown, catch and propagate
-            {
-                cout << "LRUCache::put - add_to_front threw: " << except.what() << endl;
-                throw except;
-            }
-            catch(...)
+            bool const held = model.peek(key).has_value();
+            size_t const before = thread_allocations();
+            bool const erased = fixed.erase(key);
+            fixed_allocations += thread_allocations() - before;
+            assert( held == erased );
+            (void)erased;
+            if ( held )
             {
-                cout << "LRUCache::put - Unknown exception" << endl;
-                throw;
+                model.erase_if([key](int held_key, int) { return held_key == key; });
             }
+            continue;
         }
 
-        _lru_cache_map[key] = new_node; // add the key and it's corresponding node to the map
+        auto const hit = model.get(key);
+        size_t const before = thread_allocations();
+        auto const fixed_hit = fixed.get(key);
+        fixed_allocations += thread_allocations() - before;
+        assert( hit == fixed_hit );
+        (void)fixed_hit;
+        if ( !hit )
+        {
+            model.put(key, static_cast<int>(op));
+            size_t const before_put = thread_allocations();
+            fixed.put(key, static_cast<int>(op));
+            fixed_allocations += thread_allocations() - before_put;
+        }
+        assert( model.size() == fixed.size() );
     }
 
-    constexpr size_t capacity() const noexcept
+    std::vector<std::pair<int, int>> held, fixed_held;
+    model.for_each([&held](int key, int value) { held.emplace_back(key, value); });
+    fixed.for_each([&fixed_held](int key, int value) { fixed_held.emplace_back(key, value); });
+    assert( held == fixed_held );
+    return fixed_allocations;
+}
+
+// Test the FixedLRUCache, both looked up by its tags alone (N up to LINEAR_MAX) and
+// through its inline TagHashIndex, against an LRUCache, one of them thread_local, and
+// with string keys and values, all its storage inside the object itself, so the int
+// ones never allocate, as counted with LRUCACHE_COUNT_ALLOCATIONS defined
+void TEST_FIXED_CACHE()
+{
+    cout << "\nTEST_FIXED_CACHE:" << endl;
+
+    size_t const before_construction = thread_allocations();
+    FixedLRUCache<int, int, 1> single;
+    FixedLRUCache<int, int, 48> linear;
+    static thread_local FixedLRUCache<int, int, 4096> hashed;
+    size_t allocations = thread_allocations() - before_construction;
+    allocations += check_fixed_against_lru_cache(single);
+    allocations += check_fixed_against_lru_cache(linear);
+    allocations += check_fixed_against_lru_cache(hashed);
+    size_t const before_clear = thread_allocations();
+    hashed.clear();
+    bool const cleared = (0 == hashed.size()) && !hashed.peek(0);
+    allocations += thread_allocations() - before_clear;
+    assert( cleared );
+    (void)cleared;
+    allocations += check_fixed_against_lru_cache(hashed);
+    assert( 0 == allocations );
+#ifdef LRUCACHE_COUNT_ALLOCATIONS
+    cout << "FixedLRUCache<int, int, N>: " << allocations << " allocations" << endl;
+#else
+    cout << "FixedLRUCache<int, int, N>: allocations not counted (no LRUCACHE_COUNT_ALLOCATIONS)" << endl;
+#endif
+
+    FixedLRUCache<std::string, std::string, 2> named;
+    named.put("one", "1");
+    named.put("two", "2");
+    auto const one = named.get("one");
+    assert( one && ("1" == *one) );
+    (void)one;
+    named.emplace("three", 3, '3'); // evicts "two", the LRU one
+    auto const two = named.peek("two");
+    auto const three = named.peek("three");
+    assert( !two && three && ("333" == *three) );
+    (void)two;
+    (void)three;
+    cout << "FixedLRUCache<std::string, std::string, 2>: " << named << endl;
+
+    cout << "FixedLRUCache<int, int, 48>: " << sizeof(linear) << " bytes, looked up "
+         << TagGroup::WIDTH << " tags at a time; FixedLRUCache<int, int, 4096>: "
+         << sizeof(hashed) << " bytes, through a TagHashIndex" << endl;
+}
+
+// Test the bulk ops of the ConcurrentLRUCache, on several threads: a bulk_load puts
+// the same entries, in the same order, as a put of each in turn (so later entries of
+// a key win, and the evictions match), and for_each and erase_if see every entry,
+// as do those of an LRUCache, whose erase_if moves the Nodes it erases around
+void TEST_BULK_OPS()
+{
+    cout << "\nTEST_BULK_OPS:" << endl;
+
+    std::vector<std::pair<int, int>> entries;
+    for ( int key = 0; key < 200000; ++key )
     {
-        return _capacity;
+        entries.emplace_back(key, key);
     }
-
-    constexpr size_t size() const noexcept
+    for ( int key = 0; key < 1000; ++key ) // updated further on
     {
-        return _lru_list.size(); // return the size of the underlying list    
+        entries.emplace_back(key, -key);
     }
 
-    void clear() noexcept
+    ConcurrentLRUCache<int, int> loaded(400000, 8);
+    auto const started = std::chrono::steady_clock::now();
+    loaded.bulk_load(entries.begin(), entries.end(), 4);
+    auto const load_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    assert( 200000 == loaded.size() );
+    for ( int key = 0; key < 200000; ++key )
     {
-        for ( auto const &iter : _lru_cache_map ) // iterate through the map
-        {
-            delete iter.second; // clean all the Nodes
-        }
+        auto const value = loaded.get(key);
+        assert( value && (((key < 1000) ? -key : key) == *value) );
+        (void)value;
+    }
 
-        _lru_cache_map.clear(); // clear the map
+    // too small to hold them all, so it's the evictions that are compared
+    ConcurrentLRUCache<int, int> small_loaded(5000, 4), small_put(5000, 4);
+    small_loaded.bulk_load(entries.begin(), entries.end(), 3);
+    for ( auto const &entry : entries )
+    {
+        small_put.put(entry.first, entry.second);
+    }
+    assert( small_put.size() == small_loaded.size() );
+    for ( int key = 0; key < 200000; ++key )
+    {
+        auto const put_value = small_put.get(key);
+        auto const loaded_value = small_loaded.get(key);
+        assert( put_value == loaded_value );
+        (void)put_value;
+        (void)loaded_value;
     }
 
-    ~LRUCache()
+    std::atomic<size_t> visited{0};
+    std::atomic<long long> sum{0};
+    loaded.for_each([&visited, &sum](int, int value)
     {
-        this->clear();
+        visited.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }, 4);
+    long long const negated = 2LL * 999 * 1000 / 2; // the 1000 updated keys each count -key, not key
+    assert( (200000 == visited) && (200000LL * 199999 / 2 - negated == sum) );
+    (void)negated;
+
+    size_t const erased = loaded.erase_if([](int key, int) { return 0 != key % 2; }, 4);
+    auto const odd = loaded.get(1);
+    auto const even = loaded.get(2);
+    assert( (100000 == erased) && (100000 == loaded.size()) && !odd && even );
+    (void)odd;
+    (void)even;
+
+    LRUCache<int, int, std::hash<int>, IndexedLRUPolicy> cache(100);
+    for ( int key = 0; key < 100; ++key )
+    {
+        cache.put(key, key * 10);
+    }
+    size_t const erased_even = cache.erase_if([](int key, int) { return 0 == key % 2; });
+    assert( 50 == erased_even );
+    (void)erased_even;
+    std::vector<int> order;
+    std::vector<int> values;
+    cache.for_each([&order, &values](int key, int value)
+    {
+        order.push_back(key);
+        values.push_back(value);
+    });
+    assert( 50 == order.size() );
+    for ( size_t i = 0; i < order.size(); ++i ) // the odd keys, from the MRU 99 down
+    {
+        auto const held = cache.get(order[i]);
+        assert( 99 - 2 * static_cast<int>(i) == order[i] && order[i] * 10 == values[i] );
+        assert( held );
+        (void)held;
     }
+    auto const erased_key = cache.get(0);
+    assert( !erased_key );
+    (void)erased_key;
 
-    // again, to write the internal state to the output stream to check results
-    friend ostream& operator<< (ostream& os, const LRUCache& cache);
+    cout << "ConcurrentLRUCache(" << loaded.capacity() << "): bulk_load of " << entries.size() << " entries on 4 threads in "
+         << load_time.count() << "ms, " << visited << " visited, " << erased << " erased" << endl;
+}
+
+#ifdef LRUCACHE_HAS_COROUTINES
+// A fire and forget coroutine, to await the async ops of the test with
+struct AsyncTestTask
+{
+    struct promise_type
+    {
+        AsyncTestTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept { }
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
 };
 
-// just call out to the underlying list to do the job
-ostream& operator<< (ostream& os, const LRUCache& cache)
+// runs each task on a thread of its own, all joined once the test's coroutine is done
+struct AsyncTestExecutor
 {
-    return os << cache._lru_list;
-/*
-    os << "{";
+    std::mutex *_lock;
+    std::vector<std::thread> *_threads;
 
-    for ( auto const &iter : cache._lru_cache_map  )
+    template <class Task>
+    void operator() (Task task) const
     {
-        os << "[" << iter.first << "=" << iter.second->_value << "], ";
+        std::lock_guard<std::mutex> guard(*_lock);
+        _threads->emplace_back(std::move(task));
     }
+};
 
-    return os << "}";
-*/
+// the no. of tasks posted so far
+size_t async_test_posted(const AsyncTestExecutor& executor)
+{
+    std::lock_guard<std::mutex> guard(*executor._lock);
+    return executor._threads->size();
 }
 
-// A decorator-like testing class to test the LRUCache
-class LoggedOrTimedOpsTester
+template <class TieredCache, class Cache>
+AsyncTestTask async_test_run(TieredCache& tiered, Cache& cache, AsyncTestExecutor executor, std::promise<void>& done)
 {
-    LRUCache& _cache;
+    std::thread::id const caller = std::this_thread::get_id();
 
-  public:
-    explicit LoggedOrTimedOpsTester(LRUCache& cache) noexcept
-     : _cache(cache) // glue it to the given LRUCache object
-    { }
+    // a hit completes inline, on the caller's thread, with no task posted
+    std::optional<std::string> const hit = co_await tiered.async_get(7, executor);
+    assert( hit && ("7" == *hit) && (caller == std::this_thread::get_id()) && (0 == async_test_posted(executor)) );
 
-    // logs the internal state of the cache before and after the call to put
-    void logged_put(int key, int value)
+    // a miss is looked up in the tier by a task, which resumes the coroutine on its own thread
+    std::optional<std::string> const promoted = co_await tiered.async_get(0, executor);
+    assert( promoted && ("0" == *promoted) && (1 == async_test_posted(executor)) );
+    assert( caller != std::this_thread::get_id() );
+    std::optional<std::string> const missing = co_await tiered.async_get(100, executor);
+    assert( !missing && (2 == async_test_posted(executor)) );
+
+    // a load suspends once, and is held for the next one to hit inline
+    auto const loader = [](int key) { return std::to_string(key * 2); };
+    std::string const loaded = co_await tiered.async_get_or_compute(200, loader, executor);
+    assert( ("400" == loaded) && (3 == async_test_posted(executor)) );
+    std::thread::id const resumed_on = std::this_thread::get_id();
+    std::string const held = co_await tiered.async_get_or_compute(200, loader, executor);
+    assert( ("400" == held) && (3 == async_test_posted(executor)) && (resumed_on == std::this_thread::get_id()) );
+
+    // the loader's exception is rethrown into the coroutine
+    bool threw = false;
+    try
     {
-        //cout << "Before:\t" << _cache << endl;
-        _cache.put(key, value);
-        log_capacity();
-        cout << "After Put(" << key << "," << value << "):\t" << _cache << endl;
+        co_await tiered.async_get_or_compute(300, [](int) -> std::string { throw std::runtime_error("load"); }, executor);
     }
+    catch ( const std::runtime_error& )
+    {
+        threw = true;
+    }
+    assert( threw && (4 == async_test_posted(executor)) );
+    std::thread::id const rethrown_on = std::this_thread::get_id();
 
-    // logs the internal state of the cache before and after the call to get
-    int logged_get(int key) noexcept
+    // a put is inline, and so is any get of a cache that isn't tiered, even a miss
+    co_await tiered.async_put(500, "500");
+    std::string const put = co_await tiered.async_get_or_compute(500, loader, executor);
+    co_await cache.async_put(1, "1");
+    std::optional<std::string> const untiered_hit = co_await cache.async_get(1, executor);
+    std::optional<std::string> const untiered_miss = co_await cache.async_get(2, executor);
+    assert( ("500" == put) && untiered_hit && ("1" == *untiered_hit) && !untiered_miss );
+    assert( (4 == async_test_posted(executor)) && (rethrown_on == std::this_thread::get_id()) );
+    (void)caller;
+    (void)resumed_on;
+    (void)threw;
+    (void)rethrown_on;
+
+    done.set_value();
+}
+
+// Test the coroutine interface of the ConcurrentLRUCache: the hits complete inline,
+// without suspending, and only the misses of the tier and the loads are handed to
+// the executor, the coroutine resuming on the executor's thread with their result
+void TEST_ASYNC()
+{
+    cout << "\nTEST_ASYNC:" << endl;
+
+    std::string const path = (std::filesystem::temp_directory_path() / "lrucache_async.tier").string();
+    FlashTier<int, std::string> tier(path, 1 << 20, 1 << 12);
+    ConcurrentLRUCache<int, std::string, std::hash<int>, TieredPolicy<LinkedLRUPolicy>> tiered(4, tier, 1);
+    for ( int key = 0; key < 8; ++key ) // 0 to 3 are demoted to the tier
     {
-        //cout << "Before:\t" << _cache << endl;
-        int value = _cache.get(key);
-        cout << "Get(" << key << ") Returned:\t" << value << endl;
-        log_capacity();
-        cout << "After Get(" << key << "):\t" << _cache << endl;
-        return value;
+        tiered.put(key, std::to_string(key));
     }
+    ConcurrentLRUCache<int, std::string> cache(4, 1);
 
-    // Measures the time taken for a put opertion
-    void timed_put(int key, int value)
+    std::mutex lock;
+    std::vector<std::thread> threads;
+    std::promise<void> done;
+    std::future<void> finished = done.get_future();
+    async_test_run(tiered, cache, AsyncTestExecutor{&lock, &threads}, done);
+    finished.wait();
+    for ( auto &thread : threads ) // none is posted once the coroutine is done
     {
-        auto start_time = std::chrono::high_resolution_clock::now();
-        _cache.put(key, value);
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time);
-        log_capacity();
-        cout << "Time Taken for Put(" << key << "," << value << ") is:\t" << time_taken.count() << " ns" << endl;
+        thread.join();
     }
 
-    // Measures the time taken for a get opertion
-    int timed_get(int key) noexcept
+    cout << "ConcurrentLRUCache(" << tiered.capacity() << "): of the 11 ops awaited, " << 11 - threads.size()
+         << " completed inline and " << threads.size() << " suspended for the executor, " << tier.stats() << endl;
+}
+#endif
+
+// Test the FrequencySketch's estimates, saturation and aging, and the hit ratio
+// of the WindowTinyLFUList against a plain LRU list on skewed keys with scans
+void TEST_TINY_LFU()
+{
+    cout << "\nTEST_TINY_LFU:" << endl;
+
+    FrequencySketch sketch(1000);
+    for ( int i = 0; i < 5; ++i )
     {
-        auto start_time = std::chrono::high_resolution_clock::now();
-        int value = _cache.get(key);
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time);
-        log_capacity();
-        cout << "Time Taken for Get(" << key << ") that Returned " << value << " is:\t" << time_taken.count() << " ns" << endl;
-        return value;
+        sketch.increment(42);
     }
+    assert( 5 == sketch.frequency(42) && 0 == sketch.frequency(43) );
 
-    inline void log_capacity() const noexcept
+    for ( int i = 0; i < 20; ++i )
     {
-        cout << "LRUCache(" << _cache.capacity() << "): ";
+        sketch.increment(42);
     }
-    
-    inline void log_initial_cache() const noexcept
+    assert( 15 == sketch.frequency(42) ); // saturated
+
+    for ( size_t hash = 0; hash < 10000; ++hash ) // the 10 * capacity increments that age it
     {
-        log_capacity();
-        cout << "Initial Cache:\t" << _cache << endl;;
+        sketch.increment(1000000 + hash);
     }
+    assert( 7 <= sketch.frequency(42) && sketch.frequency(42) < 15 );
 
-    void populate_to_capacity() // populate the cache to it's full capacity for load test
+    std::vector<int> const keys = make_scan_keys(1000000, 100000, 50000, 5000);
+    LRUCache<int, int> lru(1000);
+    LRUCache<int, int, std::hash<int>, WindowTinyLFUPolicy> tiny_lfu(1000);
+    double const lru_hit_ratio = run_benchmark(lru, keys).hit_ratio();
+    double const tiny_lfu_hit_ratio = run_benchmark(tiny_lfu, keys).hit_ratio();
+    assert( lru_hit_ratio < tiny_lfu_hit_ratio );
+    cout << "LRUCache(1000) hit ratios on zipfian keys with scans: LinkedLRUPolicy " << lru_hit_ratio * 100;
+    cout << "%, WindowTinyLFUPolicy " << tiny_lfu_hit_ratio * 100 << "%" << endl;
+}
+
+// weighs an entry by its value's length alone, to keep the weights of the test exact
+struct ValueLengthWeigher
+{
+    size_t operator() (int, const std::string& value) const noexcept
     {
-        for ( int i=1; i <= _cache.capacity(); ++i )
-            _cache.put(i, i);
-        assert( _cache.size() == _cache.capacity() );
-        cout << "LRUCache(" << _cache.capacity() << "): ";
-        cout << "Size is now at: " << _cache.size() << endl;
+        return value.size();
     }
+};
 
-    // Measures the time taken for a set of put and get operations for the given load no. of times
-    void time_test_load(int load)
+// Test a weighted engine against a model of its budget: a heavy put evicts as many
+// light entries as it takes, an update that makes its entry heavier evicts the
+// others but not it, and an entry over the whole budget is refused. The array
+// engines move a Node into each one removed, so the later gets check the map was
+// told of the moves
+template <class Policy>
+void TEST_WEIGHTED(const char* engine)
+{
+    LRUCache<int, std::string, std::hash<int>, WeightedPolicy<Policy, ValueLengthWeigher>> cache(100, WeightBudget{50});
+
+    for ( int i = 0; i < 10; ++i )
     {
-        auto start_time = std::chrono::high_resolution_clock::now();
-        for (int i = 0; i < load; ++i)
+        cache.put(i, std::string(5, 'a' + i)); // fills up the budget
+    }
+    assert( 10 == cache.size() && 50 == cache.weight() );
+
+    cache.put(10, std::string(23, 'k')); // evicts 5 of them, the first 5 for an LRU engine
+    assert( 6 == cache.size() && 48 == cache.weight() && cache.peek(10) );
+    int evicted = 0;
+    for ( int i = 0; i < 10; ++i )
+    {
+        evicted += cache.peek(i) ? 0 : 1;
+    }
+    assert( 5 == evicted );
+
+    cache.put(7, std::string(40, 'h')); // evicts the others till it fits, but never 7
+    std::string const *const heavy = cache.get_ptr(7);
+    assert( 4 > cache.size() && cache.weight() <= cache.weight_budget() && 40 == heavy->size() );
+    (void)heavy;
+
+    for ( int i = 11; i < 1000; ++i )
+    {
+        cache.put(i, std::string(i % 7 + 1, 'x'));
+        assert( cache.weight() <= cache.weight_budget() );
+        std::string const *const light = cache.get_ptr(i);
+        assert( (i % 7 + 1) == static_cast<int>(light->size()) );
+        (void)light;
+    }
+
+    bool refused = false;
+    try
+    {
+        cache.put(0, std::string(51, 'o'));
+    }
+    catch(std::length_error&)
+    {
+        refused = true;
+    }
+    auto const refused_key = cache.get(0);
+    assert( refused && !refused_key && cache.weight() <= cache.weight_budget() );
+    (void)refused;
+    (void)refused_key;
+
+    size_t total = 0;
+    for ( int i = 11; i < 1000; ++i )
+    {
+        if ( auto const value = cache.peek(i) )
         {
-            _cache.put(i, i);
-            _cache.get(i % (load / 50));
+            total += value->size();
         }
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-        assert( _cache.size() == _cache.capacity() );
-        log_capacity();
-        cout << "Time Taken for Put and Get for " << load << " times is:\t" << time_taken.count() << " ms" << endl;
     }
-};
+    assert( total == cache.weight() );
+    cout << engine << ": " << cache.size() << " entries weighing " << cache.weight() << " of " << cache.weight_budget() << endl;
+}
 
-// Test the LRUCache with logging
-void TEST_LOGGED(LRUCache& cache)
+// Test the stats counted with a CountedPolicy, for the same ops as TEST_LOGGED
+void TEST_STATS()
 {
-    LoggedOrTimedOpsTester tester(cache);
+    cout << "\nTEST_STATS:" << endl;
 
-    cout << "\nTEST_LOGGED:" << endl;
+    LRUCache<int, int, std::hash<int>, CountedPolicy<LinkedLRUPolicy>> cache(2);
+    cache.put(1, 1);
+    cache.put(2, 2);
+    cache.get(1);    // a hit
+    cache.put(3, 3); // evicts 2
+    cache.get(2);    // a miss
+    cache.put(3, 4); // an update
 
-    tester.log_initial_cache();
+    CacheStats const stats = cache.stats();
+    assert( 1 == stats._hits && 1 == stats._misses && 1 == stats._evictions );
+    assert( 4 == stats._puts && 1 == stats._updates && 3 == stats.inserts() );
+    assert( 2 * (sizeof(int) + sizeof(int)) == stats._bytes );
+    cout << "LRUCache(2): " << stats << endl;
 
-    tester.logged_put(1, 1); // cache is {1=1}
-    tester.logged_put(2, 2); // cache is {1=1, 2=2}
-    tester.logged_get(1);    // return 1
-    tester.logged_put(3, 3); // LRU key was 2, evicts key 2, cache is {1=1, 3=3}
-    tester.logged_get(2);    // returns -1 (not found)
-    tester.logged_put(4, 4); // LRU key was 1, evicts key 1, cache is {4=4, 3=3}
-    tester.logged_get(1);    // return -1 (not found)
-    tester.logged_get(3);    // return 3
-    tester.logged_get(4);    // return 4
+    ConcurrentLRUCache<std::string, std::string, std::hash<std::string>, CountedPolicy<IndexedLRUPolicy>,
+                       RecencyPromotion::Deferred> concurrent(8, 2);
+    concurrent.put("key", std::string(100, 'v'));
+    concurrent.get("key");
+    concurrent.get("other key");
+    assert( 1 == concurrent.stats()._hits && 1 == concurrent.stats()._misses );
+    assert( 100 < concurrent.stats()._bytes );
+    concurrent.clear();
+    assert( 0 == concurrent.stats()._bytes );
+    cout << "ConcurrentLRUCache(8): " << concurrent.stats() << endl;
 }
 
-// Test the LRUCache for the time taken for each operation and also load avg time
-void TEST_TIMED_AND_LOADED(LRUCache& cache, int load)
+// Test the latencies timed with an InstrumentedPolicy, sampling every op, and the
+// trace hook being told of every op
+void TEST_INSTRUMENTED()
 {
-    LoggedOrTimedOpsTester tester(cache);
+    cout << "\nTEST_INSTRUMENTED:" << endl;
 
-    cout << "\nTEST_TIMED_AND_LOADED:" << endl;
- 
-    cout << "\nStarting with empty cache:" << endl;
-    tester.timed_put(1,1);
-    tester.timed_get(1);
-    tester.timed_put(2,2);
-    tester.timed_get(2);
-    tester.timed_put(3,3);
-    tester.timed_get(4);
-    tester.timed_get(4);
+    LRUCache<int, int, std::hash<int>, InstrumentedPolicy<LinkedLRUPolicy, 1>> cache(100);
 
-    cout << "\nPopulate to full capacity and time the Get and Put:" << endl;
-    tester.populate_to_capacity();
-    tester.timed_put(-1,-2);
-    tester.timed_get(-1);
-    tester.timed_get(-2);
-    tester.timed_put(1,2);
+    size_t events[CACHE_OP_COUNT] = {};
+    cache.set_trace_hook([](void *context, const CacheTraceEvent& event) noexcept
+    {
+        ++static_cast<size_t*>(context)[static_cast<size_t>(event._op)];
+    }, events);
 
-    cout << "\nLoad tested and timed for " << load << " times of Get and Put:" << endl;
-    tester.time_test_load(load);
+    for ( int i = 0; i < 1000; ++i )
+    {
+        cache.put(i, i);
+        cache.get(i / 2);
+    }
+
+    assert( 1000 == cache.latencies(CacheOp::Get).count() && 1000 == events[0] );
+    assert( 1000 == cache.latencies(CacheOp::Put).count() && 1000 == events[1] );
+    assert( 900 == cache.latencies(CacheOp::Evict).count() ); // all the puts past the first 100
+    assert( 100 == cache.latencies(CacheOp::Allocate).count() );
+    assert( 0 == cache.latencies(CacheOp::Rehash).count() ); // the FlatHashIndex never rehashes
+
+    for ( CacheOp const op : {CacheOp::Get, CacheOp::Put, CacheOp::Evict, CacheOp::Allocate} )
+    {
+        LatencySnapshot const latencies = cache.latencies(op);
+        cout << "CacheOp " << static_cast<int>(op) << ": p50/p99/p999 " << latencies.percentile_ns(0.5);
+        cout << "/" << latencies.percentile_ns(0.99) << "/" << latencies.percentile_ns(0.999) << " ns" << endl;
+    }
+
+    // the TagHashIndex clears the DELETED slots its erases leave out in place, now and
+    // then, each time timed (and traced) as a rehash of its own, apart from the put
+    LRUCache<int, int, std::hash<int>, InstrumentedPolicy<TagProbedPolicy<LinkedLRUPolicy>, 1>> probed(1000);
+    size_t probed_events[CACHE_OP_COUNT] = {};
+    probed.set_trace_hook([](void *context, const CacheTraceEvent& event) noexcept
+    {
+        ++static_cast<size_t*>(context)[static_cast<size_t>(event._op)];
+    }, probed_events);
+    std::mt19937 random(1);
+    for ( int i = 0; i < 200000; ++i )
+    {
+        int const key = static_cast<int>(random() % 4000); // evicting at random spots of the map
+        probed.put(key, i);
+    }
+    LatencySnapshot const rehashes = probed.latencies(CacheOp::Rehash);
+    size_t const rehash_index = static_cast<size_t>(CacheOp::Rehash);
+    assert( (0 < rehashes.count()) && (rehashes.count() == probed_events[rehash_index]) );
+    (void)rehash_index;
+    cout << "TagHashIndex of 1000: " << rehashes.count() << " rehashes in place in 200000 puts of 4000 keys, p50 "
+         << rehashes.percentile_ns(0.5) << " ns" << endl;
+}
+
+// Test the LRUCache with keys and values other than int, where a miss is
+// told apart from a stored -1 by the empty optional returned from get
+void TEST_GENERIC_KEYS_AND_VALUES()
+{
+    cout << "\nTEST_GENERIC_KEYS_AND_VALUES:" << endl;
+
+    LRUCache<std::string, int> cache(2);
+    cache.put("one", 1);
+    cache.put("minus one", -1);
+    auto const minus_one = cache.get("minus one");
+    assert( minus_one == -1 ); // a hit, even though the value is -1
+    cache.put("two", 2); // LRU key was "one", evicts it
+    auto const one = cache.get("one");
+    assert( !one ); // a miss
+    (void)minus_one;
+    (void)one;
+
+    LRUCache<int, std::string, std::hash<int>, IndexedLRUPolicy> names(2);
+    names.put(1, "one");
+    names.put(2, "two");
+    names.get(1);
+    names.put(3, "three"); // LRU key was 2, evicts it
+    names.emplace(4, 3, 'x'); // the value built in place as std::string(3, 'x'), evicts 1
+    std::string const *const three = names.get_ptr(3);
+    assert( nullptr != three && "three" == *three ); // read in place
+    (void)three;
+    assert( nullptr == names.peek_ptr(1) );
+
+    cout << "LRUCache<std::string, int>(2): " << cache << endl;
+    cout << "LRUCache<int, std::string>(2): " << names << endl;
 }
 
 // Just to run and test the LRUCache, so as to keep the main short and sweet!
@@ -513,9 +10541,107 @@ int run_and_test_lru_cache_impl()
         cout << "\nEnter LRUCache's Capacity: ";
         cin >> capacity;
         
-        auto sp_obj = std::make_shared<LRUCache>(capacity);
+        auto sp_obj = std::make_shared<LRUCache<int, int>>(capacity);
         TEST_LOGGED(*sp_obj);
         TEST_TIMED_AND_LOADED(*sp_obj, 10000);
+
+        cout << "\nWith the IndexedTwoWayList engine:" << endl;
+        auto sp_indexed_obj = std::make_shared<LRUCache<int, int, std::hash<int>, IndexedLRUPolicy>>(capacity);
+        TEST_LOGGED(*sp_indexed_obj);
+        TEST_TIMED_AND_LOADED(*sp_indexed_obj, 10000);
+
+        cout << "\nWith the ClockList (approximate LRU) engine:" << endl;
+        auto sp_clock_obj = std::make_shared<LRUCache<int, int, std::hash<int>, ClockPolicy>>(capacity);
+        TEST_LOGGED(*sp_clock_obj);
+        TEST_TIMED_AND_LOADED(*sp_clock_obj, 10000);
+
+        cout << "\nWith the SegmentedLRUList (scan resistant) engine:" << endl;
+        auto sp_segmented_obj = std::make_shared<LRUCache<int, int, std::hash<int>, SegmentedLRUPolicy>>(capacity);
+        TEST_LOGGED(*sp_segmented_obj);
+        TEST_TIMED_AND_LOADED(*sp_segmented_obj, 10000);
+
+        cout << "\nWith the WindowTinyLFUList (frequency admitted) engine:" << endl;
+        auto sp_tiny_lfu_obj = std::make_shared<LRUCache<int, int, std::hash<int>, WindowTinyLFUPolicy>>(capacity);
+        TEST_LOGGED(*sp_tiny_lfu_obj);
+        TEST_TIMED_AND_LOADED(*sp_tiny_lfu_obj, 10000);
+
+        auto sp_concurrent_obj = std::make_shared<ConcurrentLRUCache<int, int>>(capacity);
+        TEST_CONCURRENT(*sp_concurrent_obj, 4, 10000);
+
+        cout << "\nWith the get hits promoted in deferred batches:" << endl;
+        auto sp_deferred_obj = std::make_shared<ConcurrentLRUCache<int, int, std::hash<int>, LinkedLRUPolicy,
+                                                                   RecencyPromotion::Deferred>>(capacity);
+        TEST_CONCURRENT(*sp_deferred_obj, 4, 10000);
+
+        cout << "\nTEST_GET_OR_COMPUTE:" << endl;
+        int const computed = sp_obj->get_or_compute(-3, [](int key) { return -key; });
+        assert( 3 == computed && 3 == *sp_obj->peek(-3) );
+        (void)computed;
+        ConcurrentLRUCache<int, int> single_flight_obj(64);
+        TEST_GET_OR_COMPUTE(single_flight_obj, 8);
+        ConcurrentLRUCache<int, int, std::hash<int>, LinkedLRUPolicy, RecencyPromotion::Deferred> deferred_flight_obj(64);
+        TEST_GET_OR_COMPUTE(deferred_flight_obj, 8);
+
+        TEST_BATCHED(*sp_obj, 1000);
+        TEST_BATCHED(*sp_concurrent_obj, 1000);
+
+        TEST_TRACE_REPLAY();
+        cout << "\nTEST_WARM_RESERVE:" << endl;
+        TEST_WARM_RESERVE<LinkedLRUPolicy>("LinkedLRUPolicy");
+        TEST_WARM_RESERVE<HeapLinkedLRUPolicy>("HeapLinkedLRUPolicy");
+        TEST_WARM_RESERVE<HugePageLRUPolicy>("HugePageLRUPolicy");
+        TEST_WARM_RESERVE<IndexedLRUPolicy>("IndexedLRUPolicy");
+        TEST_WARM_RESERVE<ClockPolicy>("ClockPolicy");
+        TEST_WARM_RESERVE<SegmentedLRUPolicy>("SegmentedLRUPolicy");
+        TEST_WARM_RESERVE<WindowTinyLFUPolicy>("WindowTinyLFUPolicy");
+
+        cout << "\nTEST_WEIGHTED:" << endl;
+        TEST_WEIGHTED<LinkedLRUPolicy>("LinkedLRUPolicy");
+        TEST_WEIGHTED<HeapLinkedLRUPolicy>("HeapLinkedLRUPolicy");
+        TEST_WEIGHTED<HugePageLRUPolicy>("HugePageLRUPolicy");
+        TEST_WEIGHTED<IndexedLRUPolicy>("IndexedLRUPolicy");
+        TEST_WEIGHTED<ClockPolicy>("ClockPolicy");
+        TEST_WEIGHTED<SegmentedLRUPolicy>("SegmentedLRUPolicy");
+        TEST_WEIGHTED<WindowTinyLFUPolicy>("WindowTinyLFUPolicy");
+
+        cout << "\nTEST_SCAN_RESISTANCE:" << endl;
+        TEST_SCAN_RESISTANCE<LinkedLRUPolicy>("LinkedLRUPolicy");
+        TEST_SCAN_RESISTANCE<SegmentedLRUPolicy>("SegmentedLRUPolicy");
+        TEST_TINY_LFU();
+
+        cout << "\nTEST_EXPIRY:" << endl;
+        TEST_EXPIRY<LinkedLRUPolicy>("LinkedLRUPolicy");
+        TEST_EXPIRY<IndexedLRUPolicy>("IndexedLRUPolicy");
+        TEST_EXPIRY<ClockPolicy>("ClockPolicy");
+        TEST_EXPIRY<WindowTinyLFUPolicy>("WindowTinyLFUPolicy");
+
+        cout << "\nTEST_SNAPSHOT:" << endl;
+        TEST_SNAPSHOT<LinkedLRUPolicy>("LinkedLRUPolicy");
+        TEST_SNAPSHOT<HugePageLRUPolicy>("HugePageLRUPolicy");
+        TEST_SNAPSHOT<IndexedLRUPolicy>("IndexedLRUPolicy");
+        TEST_SNAPSHOT<ClockPolicy>("ClockPolicy");
+        TEST_SNAPSHOT<SegmentedLRUPolicy>("SegmentedLRUPolicy");
+        TEST_SNAPSHOT<WindowTinyLFUPolicy>("WindowTinyLFUPolicy");
+        TEST_BACKGROUND_SNAPSHOT();
+        TEST_HUGE_PAGES();
+
+        cout << "\nTEST_FLASH_TIER:" << endl;
+        TEST_FLASH_TIER<LinkedLRUPolicy>("LinkedLRUPolicy");
+        TEST_FLASH_TIER<IndexedLRUPolicy>("IndexedLRUPolicy");
+        TEST_FLASH_TIER<ClockPolicy>("ClockPolicy");
+        TEST_CONCURRENT_FLASH_TIER();
+        TEST_EVICTION_LISTENER();
+        TEST_WRITE_BACK();
+        TEST_TAG_INDEX();
+        TEST_FIXED_CACHE();
+        TEST_BULK_OPS();
+#ifdef LRUCACHE_HAS_COROUTINES
+        TEST_ASYNC();
+#endif
+
+        TEST_STATS();
+        TEST_INSTRUMENTED();
+        TEST_GENERIC_KEYS_AND_VALUES();
     }
     catch(std::exception &excp)
     {
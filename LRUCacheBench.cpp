@@ -0,0 +1,105 @@
+/*******************************************************************************
+ *                              LRUCache Benchmarks
+ *******************************************************************************
+ * Runs each of the cache engines through the uniform, zipfian, scan heavy and,
+ * when given, replayed trace key streams, sweeping the capacities (and, for the
+ * ConcurrentLRUCache, the no. of threads), and writes a row of the throughput,
+ * hit ratio and p50/p99/p999 latencies for each run - see run_benchmark
+ *
+ * Build: g++ -O2 -std=c++17 -pthread LRUCacheBench.cpp -o LRUCacheBench
+ * Run:   ./LRUCacheBench [no. of ops per run] [trace file of int keys]
+ *******************************************************************************/
+#include "LRUCache.cpp"
+
+#include <iomanip>
+
+// the key streams are drawn from this many keys, a bit over the largest capacity
+constexpr int BENCH_KEY_SPACE = 1 << 20;
+constexpr int BENCH_CAPACITIES[] = { 1 << 10, 1 << 14, 1 << 18 };
+
+void print_header()
+{
+    cout << std::left << std::setw(28) << "engine" << std::setw(10) << "keys" << std::right
+         << std::setw(10) << "capacity" << std::setw(8) << "threads" << std::setw(10) << "Mops/s"
+         << std::setw(8) << "hit%" << std::setw(8) << "p50" << std::setw(8) << "p99"
+         << std::setw(8) << "p999" << endl;
+}
+
+void print_row(const std::string& engine, const std::string& keys, int capacity, unsigned threads,
+               const BenchmarkResult& result)
+{
+    cout << std::left << std::setw(28) << engine << std::setw(10) << keys << std::right
+         << std::setw(10) << capacity << std::setw(8) << threads << std::fixed << std::setprecision(2)
+         << std::setw(10) << result.ops_per_second() / 1e6 << std::setprecision(1)
+         << std::setw(8) << result.hit_ratio() * 100 << std::setw(8) << result._p50_ns
+         << std::setw(8) << result._p99_ns << std::setw(8) << result._p999_ns << endl;
+}
+
+// a single threaded run on a fresh cache of the engine
+template <class Policy>
+void bench_engine(const std::string& engine, const std::string& name, const std::vector<int>& keys, int capacity)
+{
+    LRUCache<int, int, std::hash<int>, Policy> cache(capacity);
+    print_row(engine, name, capacity, 1, run_benchmark(cache, keys));
+}
+
+template <RecencyPromotion Promotion>
+void bench_concurrent(const std::string& engine, const std::string& name, const std::vector<int>& keys,
+                      int capacity, unsigned threads)
+{
+    ConcurrentLRUCache<int, int, std::hash<int>, LinkedLRUPolicy, Promotion> cache(capacity);
+    print_row(engine, name, capacity, threads, run_benchmark(cache, keys, threads));
+}
+
+void bench_keys(const std::string& name, const std::vector<int>& keys, const std::vector<unsigned>& thread_counts)
+{
+    for ( int const capacity : BENCH_CAPACITIES )
+    {
+        bench_engine<LinkedLRUPolicy>("LinkedLRUPolicy", name, keys, capacity);
+        bench_engine<HeapLinkedLRUPolicy>("HeapLinkedLRUPolicy", name, keys, capacity);
+        bench_engine<HugePageLRUPolicy>("HugePageLRUPolicy", name, keys, capacity);
+        bench_engine<IndexedLRUPolicy>("IndexedLRUPolicy", name, keys, capacity);
+        bench_engine<ClockPolicy>("ClockPolicy", name, keys, capacity);
+        bench_engine<SegmentedLRUPolicy>("SegmentedLRUPolicy", name, keys, capacity);
+        bench_engine<WindowTinyLFUPolicy>("WindowTinyLFUPolicy", name, keys, capacity);
+
+        for ( unsigned const threads : thread_counts )
+        {
+            bench_concurrent<RecencyPromotion::Immediate>("ConcurrentLRUCache", name, keys, capacity, threads);
+            bench_concurrent<RecencyPromotion::Deferred>("ConcurrentLRUCache/Deferred", name, keys, capacity, threads);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        size_t const ops = ( 1 < argc ) ? std::stoul(argv[1]) : 2000000;
+
+        // 1, 2, 4 ... up to the no. of hardware threads, and that one too
+        unsigned const hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> thread_counts;
+        for ( unsigned threads = 1; threads < hardware_threads; threads *= 2 )
+        {
+            thread_counts.push_back(threads);
+        }
+        thread_counts.push_back(hardware_threads);
+
+        print_header();
+        bench_keys("uniform", make_uniform_keys(ops, BENCH_KEY_SPACE), thread_counts);
+        bench_keys("zipfian", make_zipfian_keys(ops, BENCH_KEY_SPACE), thread_counts);
+        bench_keys("scan", make_scan_keys(ops, BENCH_KEY_SPACE, 100000, BENCH_KEY_SPACE / 4), thread_counts);
+        if ( 2 < argc )
+        {
+            bench_keys("trace", load_trace_keys(argv[2]), thread_counts);
+        }
+    }
+    catch(std::exception &excp)
+    {
+        cout << "LRUCacheBench threw: " << excp.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ *                              LRUCache Trace Replay
+ *******************************************************************************
+ * Replays a trace recorded through a TracedCache, to size a cache from real
+ * traffic before deploying it:
+ *   1. The LRU hit ratio curve over the capacities 1, 2, 4 ... up to the no. of
+ *      the trace's distinct keys, all out of one stack distance pass
+ *   2. For each capacity given, the hit ratio and the throughput of each of the
+ *      engines actually replaying the trace at it (ClockPolicy, only being an
+ *      approximate LRU, and SegmentedLRUPolicy and WindowTinyLFUPolicy, not
+ *      being LRU at all, may differ from the curve there)
+ * With --record, it instead records a zipfian cache aside run to a trace, to
+ * try it out without a live cache at hand
+ *
+ * Build: g++ -O2 -std=c++17 -pthread LRUCacheReplay.cpp -o LRUCacheReplay
+ * Run:   ./LRUCacheReplay <trace file> [capacity ...]
+ *        ./LRUCacheReplay --record <trace file> [no. of ops] [no. of keys]
+ *******************************************************************************/
+#include "LRUCache.cpp"
+
+#include <iomanip>
+
+void record_zipfian_trace(const std::string& path, size_t ops, int key_space)
+{
+    LRUCache<int, int> cache(std::max(1, key_space / 16));
+    TraceWriter writer(path);
+    TracedCache<LRUCache<int, int>> traced(cache, writer);
+
+    for ( int const key : make_zipfian_keys(ops, key_space) )
+    {
+        if ( !traced.get(key) )
+        {
+            traced.put(key, key);
+        }
+    }
+}
+
+void print_hit_ratio_curve(const StackDistanceReplay& replay)
+{
+    std::vector<size_t> capacities;
+    for ( size_t capacity = 1; capacity < replay.key_count(); capacity *= 2 )
+    {
+        capacities.push_back(capacity);
+    }
+    capacities.push_back(std::max<size_t>(1, replay.key_count()));
+
+    std::vector<double> const curve = replay.hit_ratio_curve(capacities);
+
+    cout << "LRU hit ratio curve over " << replay.gets() << " gets of " << replay.key_count() << " keys:" << endl;
+    cout << std::setw(12) << "capacity" << std::setw(10) << "hit%" << endl;
+    for ( size_t i = 0; i < capacities.size(); ++i )
+    {
+        cout << std::setw(12) << capacities[i] << std::fixed << std::setprecision(2)
+             << std::setw(10) << curve[i] * 100 << endl;
+    }
+}
+
+template <class Policy>
+void replay_engine(const std::string& engine, const std::vector<TraceRecord>& records, int capacity)
+{
+    LRUCache<int, int, std::hash<int>, Policy> cache(capacity);
+    BenchmarkResult const result = replay_trace(cache, records);
+
+    cout << std::left << std::setw(22) << engine << std::right << std::setw(12) << capacity
+         << std::fixed << std::setprecision(2) << std::setw(10) << result.hit_ratio() * 100
+         << std::setw(10) << records.size() / result._seconds / 1e6 << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        if ( 2 > argc )
+        {
+            cout << "Usage: " << argv[0] << " <trace file> [capacity ...]" << endl;
+            cout << "       " << argv[0] << " --record <trace file> [no. of ops] [no. of keys]" << endl;
+            return -1;
+        }
+
+        if ( std::string("--record") == argv[1] )
+        {
+            if ( 3 > argc )
+            {
+                cout << "--record needs the trace file to write" << endl;
+                return -1;
+            }
+            size_t const ops = ( 3 < argc ) ? std::stoul(argv[3]) : 1000000;
+            int const key_space = ( 4 < argc ) ? std::stoi(argv[4]) : 100000;
+            record_zipfian_trace(argv[2], ops, key_space);
+            return 0;
+        }
+
+        TraceReader reader(argv[1]);
+        std::vector<TraceRecord> const records = reader.read_all();
+        reader.rewind();
+
+        StackDistanceReplay replay(records.size());
+        TraceRecord record;
+        while ( reader.next(record) )
+        {
+            replay.use(record);
+        }
+        print_hit_ratio_curve(replay);
+
+        if ( 2 < argc )
+        {
+            cout << endl << std::left << std::setw(22) << "engine" << std::right << std::setw(12) << "capacity"
+                 << std::setw(10) << "hit%" << std::setw(10) << "Mrec/s" << endl;
+        }
+        for ( int i = 2; i < argc; ++i )
+        {
+            int const capacity = std::stoi(argv[i]);
+            replay_engine<LinkedLRUPolicy>("LinkedLRUPolicy", records, capacity);
+            replay_engine<HeapLinkedLRUPolicy>("HeapLinkedLRUPolicy", records, capacity);
+            replay_engine<HugePageLRUPolicy>("HugePageLRUPolicy", records, capacity);
+            replay_engine<IndexedLRUPolicy>("IndexedLRUPolicy", records, capacity);
+            replay_engine<ClockPolicy>("ClockPolicy", records, capacity);
+            replay_engine<SegmentedLRUPolicy>("SegmentedLRUPolicy", records, capacity);
+            replay_engine<WindowTinyLFUPolicy>("WindowTinyLFUPolicy", records, capacity);
+        }
+    }
+    catch(std::exception &excp)
+    {
+        cout << "LRUCacheReplay threw: " << excp.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}